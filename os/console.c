@@ -2,12 +2,15 @@
 
 #include "debug.h"
 #include "defs.h"
+#include "lockstat.h"
 #include "riscv-io.h"
 #include "sbi.h"
+#include "workqueue.h"
 
 int uart0_irq;
 static int uart_inited = false;
 static void uart_putchar(int);
+static void cons_rx_work(struct work *);
 extern void acquire_kprint(void);
 extern void release_kprint(void);
 
@@ -28,6 +31,21 @@ struct {
     uint e;  // Edit index
 } cons;
 
+// Characters received by uart_intr(), for the console work, which edits the line and echoes them
+// with interrupts on. Control keys for debugging are still handled in the interrupt, they must work
+// when the system is stuck.
+#define RX_BUF_SIZE 64
+
+struct {
+    spinlock_t lock;
+    uchar buf[RX_BUF_SIZE];
+    uint r;
+    uint w;
+} rx;
+
+static struct work cons_work;
+static struct mutex cons_echo;  // one console work at a time, so echoes keep their order
+
 void consputc(int c) {
     if (!uart_inited || panicked)  // when panicked, use SBI output
         sbi_putchar(c);
@@ -88,6 +106,9 @@ void console_init() {
     assert(!uart_inited);
     spinlock_init(&uart_tx_lock, "uart_tx");
     spinlock_init(&cons.lock, "cons");
+    spinlock_init(&rx.lock, "cons_rx");
+    mutex_init(&cons_echo, "cons_echo");
+    init_work(&cons_work, cons_rx_work);
 
     // no need to init uart8250, they are already inited by OpenSBI.
 
@@ -109,26 +130,25 @@ void console_init() {
     uart_inited = true;
 }
 
+// Edit the input line with c, and echo it once cons.lock is released.
 static void consintr(int c) {
+    int echo = 0, n = 0;
+
     acquire(&cons.lock);
 
     switch (c) {
-        case C('P'):
-            print_procs();
-            break;
-        case C('Q'):
-            print_kpgmgr();
-            break;
         case C('U'):  // Kill line.
             while (cons.e != cons.w && cons.buf[(cons.e - 1) % INPUT_BUF_SIZE] != '\n') {
                 cons.e--;
-                consputc(BACKSPACE);
+                n++;
             }
+            echo = BACKSPACE;
             break;
         case '\x7f':  // Delete key
             if (cons.e != cons.w) {
                 cons.e--;
-                consputc(BACKSPACE);
+                n    = 1;
+                echo = BACKSPACE;
             }
             break;
         default:
@@ -136,7 +156,8 @@ static void consintr(int c) {
                 c = (c == '\r') ? '\n' : c;
 
                 // echo back to the user.
-                consputc(c);
+                n    = 1;
+                echo = c;
 
                 // store for consumption by consoleread().
                 cons.buf[cons.e++ % INPUT_BUF_SIZE] = c;
@@ -152,16 +173,51 @@ static void consintr(int c) {
     }
 
     release(&cons.lock);
+    while (n-- > 0)
+        consputc(echo);
+}
+
+static void cons_rx_work(struct work *w) {
+    mutex_lock(&cons_echo);
+    for (;;) {
+        int c = -1;
+        acquire(&rx.lock);
+        if (rx.r != rx.w)
+            c = rx.buf[rx.r++ % RX_BUF_SIZE];
+        release(&rx.lock);
+        if (c == -1)
+            break;
+        consintr(c);
+    }
+    mutex_unlock(&cons_echo);
 }
 
 void uart_intr() {
+    acquire(&rx.lock);
     while (1) {
         int c = uartgetc();
         if (c == -1)
             break;
         // infof("uart: %c", c);
-        consintr(c);
+        switch (c) {
+            case C('P'):
+                print_procs();
+                break;
+            case C('Q'):
+                print_kpgmgr();
+                break;
+            case C('L'):
+                print_lockstat();
+                break;
+            default:
+                // dropped if the console work falls that far behind.
+                if (rx.w - rx.r < RX_BUF_SIZE)
+                    rx.buf[rx.w++ % RX_BUF_SIZE] = c;
+                break;
+        }
     }
+    release(&rx.lock);
+    queue_work(&cons_work);
 }
 
 int64 user_console_write(uint64 __user buf, int64 len) {
@@ -179,16 +235,9 @@ int64 user_console_write(uint64 __user buf, int64 len) {
     }
     kbuf = (char *)PA_TO_KVA(kbuf);
 
-    acquire(&p->lock);
     mm = p->mm;
-    acquire(&mm->lock);
-    release(&p->lock);
-
-    if ((ret = copy_from_user(mm, kbuf, buf, len)) < 0) {
-        release(&mm->lock);
+    if ((ret = copy_from_user(mm, kbuf, buf, len)) < 0)
         goto err;
-    }
-    release(&mm->lock);
 
     // do not interfere with kernel panic's print.
     acquire_kprint();
@@ -212,58 +261,66 @@ err:
 
 int64 user_console_read(uint64 __user buf, int64 n) {
     uint target;
-    int c;
-    char cbuf;
+    int c, ret, done = 0;
+    char kbuf[INPUT_BUF_SIZE];
+    struct proc *p = curr_proc();
 
     target = n;
-    acquire(&cons.lock);
-    while (n > 0) {
-        // wait until interrupt handler has put some
-        // input into cons.buffer.
-        while (cons.r == cons.w) {
-            // if (curr_proc()->state != SLEEPING) {
-            // 	release(&cons.lock);
-            // 	return -1;
-            // }
-            sleep(&cons, &cons.lock);
-        }
+    while (n > 0 && !done) {
+        int cnt = 0;
+
+        acquire(&cons.lock);
+        while (n - cnt > 0 && cnt < INPUT_BUF_SIZE) {
+            // wait until interrupt handler has put some
+            // input into cons.buffer.
+            while (cons.r == cons.w) {
+                if (cnt > 0)
+                    break;
+                sleep(&cons, &cons.lock);
+            }
+            if (cons.r == cons.w)
+                break;
 
-        c = cons.buf[cons.r++ % INPUT_BUF_SIZE];
+            c = cons.buf[cons.r++ % INPUT_BUF_SIZE];
 
-        if (c == C('D')) {  // end-of-file
-            if (n < target) {
-                // Save ^D for next time, to make sure
-                // caller gets a 0-byte result.
-                cons.r--;
+            if (c == C('D')) {  // end-of-file
+                if (n - cnt < target) {
+                    // Save ^D for next time, to make sure
+                    // caller gets a 0-byte result.
+                    cons.r--;
+                }
+                done = 1;
+                break;
             }
-            break;
-        }
 
-        // copy the input byte to the user-space buffer.
-        cbuf = c;
+            kbuf[cnt++] = c;
 
-        struct proc *p = curr_proc();
-        acquire(&p->lock);
-        struct mm *mm = p->mm;
-        acquire(&mm->lock);
-        release(&p->lock);
-
-        if (copy_to_user(mm, (uint64)buf, &cbuf, 1) < 0) {
-            release(&mm->lock);
-            break;
+            if (c == '\n') {
+                // a whole line has arrived, return to
+                // the user-level read().
+                done = 1;
+                break;
+            }
         }
-        release(&mm->lock);
-
-        buf++;
-        --n;
-
-        if (c == '\n') {
-            // a whole line has arrived, return to
-            // the user-level read().
-            break;
+        uint r = cons.r;
+        release(&cons.lock);
+
+        // copy the input bytes to the user-space buffer at once, without holding cons.lock.
+        if (cnt > 0 && (ret = copy_to_user(p->mm, buf, kbuf, cnt)) < 0) {
+            // put them back for the next read. That is only possible if no other reader took input since,
+            // and the interrupt handler did not reuse their slots: else they are lost, like the rest of a
+            // line that does not fit in the buffer.
+            acquire(&cons.lock);
+            if (cons.r == r && cons.e - (r - cnt) <= INPUT_BUF_SIZE)
+                cons.r = r - cnt;
+            else
+                warnf("console read: %d input bytes lost on a bad buffer", cnt);
+            release(&cons.lock);
+            return n == target ? ret : target - n;
         }
+        buf += cnt;
+        n -= cnt;
     }
-    release(&cons.lock);
 
     return target - n;
-}
\ No newline at end of file
+}
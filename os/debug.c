@@ -29,18 +29,24 @@ void print_ktrapframe(struct ktrapframe *tf) {
 void print_procs() {
     extern struct proc *pool[];
 
+    // lockless, so it works from the console interrupt and with any lock held.
+    rcu_read_lock();
     for (int i = 0; i < NPROC; i++) {
         struct proc *p = pool[i];
         if (p->state == UNUSED)
             continue;
+        struct proc *parent = rcu_dereference(p->parent);
         printf("proc %d: %p\n", i, p);
         printf("  pid: %d, state: %d\n", p->pid, p->state);
+        if (p->kthread)
+            printf("  kthread: %s\n", p->kthread);
         printf("  mm: %p\n", p->mm);
-        printf("  parent: %p", p->parent);
-        if (p->parent)
-            printf(" pid: %d", p->parent->pid);
+        printf("  parent: %p", parent);
+        if (parent)
+            printf(" pid: %d", parent->pid);
         printf("\n");
     }
+    rcu_read_unlock();
 }
 void print_kpgmgr() {
     extern int64 freepages_count;
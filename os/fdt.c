@@ -0,0 +1,162 @@
+#include "fdt.h"
+#include "riscv.h"
+#include "string.h"
+
+// A minimal flattened device tree (DTB) reader.
+// It only looks at the /cpus/cpu@N nodes to find out which ISA extensions we can use.
+// fdt_scan_isa() runs on the boot hart before relocation, with paging disabled,
+// so it must not keep any pointer into the DTB: the results are plain integers.
+
+#define FDT_MAGIC      0xd00dfeed
+#define FDT_BEGIN_NODE 1
+#define FDT_END_NODE   2
+#define FDT_PROP       3
+#define FDT_NOP        4
+#define FDT_END        9
+
+struct fdt_header {
+    uint32 magic;
+    uint32 totalsize;
+    uint32 off_dt_struct;
+    uint32 off_dt_strings;
+    uint32 off_mem_rsvmap;
+    uint32 version;
+    uint32 last_comp_version;
+    uint32 boot_cpuid_phys;
+    uint32 size_dt_strings;
+    uint32 size_dt_struct;
+};
+
+uint64 isa_extensions;
+uint64 fdt_cboz_block_size;
+
+static uint32 be32(const void *p) {
+    const uchar *b = p;
+    return ((uint32)b[0] << 24) | ((uint32)b[1] << 16) | ((uint32)b[2] << 8) | b[3];
+}
+
+static int streq(const char *a, const char *b) {
+    while (*a && *a == *b)
+        a++, b++;
+    return *a == *b;
+}
+
+// Compare the length-bounded token [s, s+len) with a NUL-terminated name.
+static int tokeq(const char *s, int len, const char *name) {
+    return strlen(name) == len && strncmp(s, name, len) == 0;
+}
+
+static uint64 ext_of_token(const char *s, int len) {
+    if (tokeq(s, len, "zicboz"))
+        return ISA_EXT_ZICBOZ;
+    return 0;
+}
+
+// "riscv,isa" looks like "rv64imafdcv_zicbom_zicboz":
+// single-letter extensions follow the base, multi-letter ones are separated by '_'.
+static uint64 parse_isa_string(const char *isa, int len) {
+    uint64 ext = 0;
+    int i      = 4;  // skip "rv64"
+
+    if (len < 4 || strncmp(isa, "rv64", 4) != 0)
+        return 0;
+    for (; i < len && isa[i] != '_' && isa[i] != '\0'; i++)
+        ext |= ext_of_token(&isa[i], 1);
+    while (i < len && isa[i] == '_') {
+        int start = ++i;
+        while (i < len && isa[i] != '_' && isa[i] != '\0')
+            i++;
+        ext |= ext_of_token(&isa[start], i - start);
+    }
+    return ext;
+}
+
+// "riscv,isa-extensions" is a list of NUL-separated strings.
+static uint64 parse_isa_extensions(const char *list, int len) {
+    uint64 ext = 0;
+    for (int i = 0; i < len;) {
+        int n = strlen(&list[i]);
+        ext |= ext_of_token(&list[i], n);
+        i += n + 1;
+    }
+    return ext;
+}
+
+void fdt_scan_isa(uint64 dtb) {
+    const struct fdt_header *hdr = (const struct fdt_header *)dtb;
+    uint64 all_ext               = ~0ull;
+    uint64 block_size            = 0;
+    int ncpu                     = 0;
+
+    if (dtb == 0 || be32(&hdr->magic) != FDT_MAGIC)
+        return;
+
+    const char *structs = (const char *)dtb + be32(&hdr->off_dt_struct);
+    const char *strings = (const char *)dtb + be32(&hdr->off_dt_strings);
+    const char *p       = structs;
+    const char *end     = structs + be32(&hdr->size_dt_struct);
+
+    int depth = 0;
+    int in_cpus = 0, in_cpu = 0;
+    uint64 cpu_ext = 0, cpu_disabled = 0;
+
+    while (p < end) {
+        uint32 token = be32(p);
+        p += 4;
+        switch (token) {
+            case FDT_BEGIN_NODE: {
+                const char *name = p;
+                p += ROUNDUP_2N(strlen(name) + 1, 4);
+                depth++;
+                if (depth == 2 && streq(name, "cpus"))
+                    in_cpus = 1;
+                else if (in_cpus && depth == 3 && strncmp(name, "cpu@", 4) == 0) {
+                    in_cpu       = 1;
+                    cpu_ext      = 0;
+                    cpu_disabled = 0;
+                }
+                break;
+            }
+            case FDT_END_NODE:
+                if (in_cpu && depth == 3) {
+                    in_cpu = 0;
+                    if (!cpu_disabled) {
+                        all_ext &= cpu_ext;
+                        ncpu++;
+                    }
+                } else if (in_cpus && depth == 2) {
+                    in_cpus = 0;
+                }
+                depth--;
+                break;
+            case FDT_PROP: {
+                uint32 len        = be32(p);
+                const char *pname = strings + be32(p + 4);
+                const char *val   = p + 8;
+                p += 8 + ROUNDUP_2N(len, 4);
+                if (!in_cpu || depth != 3)
+                    break;
+                if (streq(pname, "riscv,isa-extensions"))
+                    cpu_ext |= parse_isa_extensions(val, len);
+                else if (streq(pname, "riscv,isa"))
+                    cpu_ext |= parse_isa_string(val, len);
+                else if (streq(pname, "riscv,cboz-block-size") && len == 4)
+                    block_size = be32(val);
+                else if (streq(pname, "status") && !streq(val, "okay"))
+                    cpu_disabled = 1;
+                break;
+            }
+            case FDT_NOP:
+                break;
+            case FDT_END:
+            default:
+                p = end;
+                break;
+        }
+    }
+
+    if (ncpu == 0)
+        return;
+    isa_extensions      = all_ext;
+    fdt_cboz_block_size = block_size;
+}
@@ -0,0 +1,15 @@
+#ifndef FDT_H
+#define FDT_H
+
+#include "types.h"
+
+// ISA extensions present on every hart, as reported by the device tree.
+#define ISA_EXT_ZICBOZ (1ull << 0)
+
+extern uint64 isa_extensions;
+extern uint64 fdt_cboz_block_size;
+
+// dtb is a physical address, call before paging is enabled.
+void fdt_scan_isa(uint64 dtb);
+
+#endif  // FDT_H
@@ -0,0 +1,84 @@
+#include "fpu.h"
+
+#include "defs.h"
+
+// The floating-point registers are switched lazily, following sstatus.FS:
+//  - a process that never used them runs with FS Off. Its first F/D instruction traps,
+//    and fpu_first_use turns the FPU on for it, with zeroed registers.
+//  - a process is switched out with its registers saved only if FS is Dirty, i.e. it wrote them.
+//  - they are restored when it returns to user space, unless this hart still holds them:
+//    cpu->fp_owner is the last process loaded on the hart, and p->fp_cpu the hart that holds p's registers.
+// Integer-only processes never pay for the 33 registers. The kernel itself runs with the FS of the last
+// user process, so it must not use the FPU.
+
+static inline void fs_set(uint64 fs) {
+    asm volatile("csrc sstatus, %0" ::"r"(SSTATUS_FS));
+    asm volatile("csrs sstatus, %0" ::"r"(fs));
+}
+
+static inline uint64 fs_get() {
+    return r_sstatus() & SSTATUS_FS;
+}
+
+// Fresh, unused registers, e.g. after exec.
+void fpu_reset(struct proc *p) {
+    memset(&p->fp, 0, sizeof(p->fp));
+    p->fp_used = 0;
+    p->fp_cpu  = -1;
+    if (p == curr_proc())
+        fs_set(SSTATUS_FS_OFF);
+}
+
+// Give to a child the registers of from, the current process.
+void fpu_copy(struct proc *from, struct proc *to) {
+    to->fp_used = from->fp_used;
+    to->fp_cpu  = -1;
+    if (!from->fp_used)
+        return;
+
+    push_off();
+    if (fs_get() == SSTATUS_FS_DIRTY) {
+        fp_save(&from->fp);
+        fs_set(SSTATUS_FS_CLEAN);
+    }
+    pop_off();
+    to->fp = from->fp;
+}
+
+// Called on an illegal instruction from user space.
+// Return 1 if it was the first F/D instruction of p: it runs again, with the FPU on.
+int fpu_first_use(struct proc *p) {
+    if (p->fp_used || fs_get() != SSTATUS_FS_OFF)
+        return 0;
+    p->fp_used = 1;
+    p->fp_cpu  = -1;
+    return 1;
+}
+
+// Called by sched() before p leaves the hart, with interrupts off.
+void fpu_switch_out(struct proc *p) {
+    if (p->fp_used && fs_get() == SSTATUS_FS_DIRTY) {
+        fp_save(&p->fp);
+        fs_set(SSTATUS_FS_CLEAN);
+    }
+}
+
+// Called when p returns to user space, with interrupts off.
+void fpu_user_enter(struct proc *p) {
+    struct cpu *c = mycpu();
+
+    if (!p->fp_used) {
+        fs_set(SSTATUS_FS_OFF);
+        return;
+    }
+    if (c->fp_owner != p || p->fp_cpu != c->cpuid) {
+        fs_set(SSTATUS_FS_CLEAN);
+        fp_restore(&p->fp);
+        c->fp_owner = p;
+        p->fp_cpu   = c->cpuid;
+        fs_set(SSTATUS_FS_CLEAN);
+    } else if (fs_get() == SSTATUS_FS_OFF) {
+        // the registers are still ours, but an integer-only process ran here meanwhile.
+        fs_set(SSTATUS_FS_CLEAN);
+    }
+}
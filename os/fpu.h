@@ -0,0 +1,24 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include "types.h"
+
+// Floating-point registers of a process, saved lazily: see fpu.c.
+struct fpstate {
+    uint64 f[32];
+    uint64 fcsr;
+};
+
+struct proc;
+
+void fpu_reset(struct proc *p);
+void fpu_copy(struct proc *from, struct proc *to);
+int fpu_first_use(struct proc *p);
+void fpu_switch_out(struct proc *p);
+void fpu_user_enter(struct proc *p);
+
+// fpu.S
+void fp_save(struct fpstate *fp);
+void fp_restore(struct fpstate *fp);
+
+#endif  // FPU_H
@@ -0,0 +1,182 @@
+#include "futex.h"
+
+#include "defs.h"
+#include "syscall.h"
+#include "trap.h"
+
+// Waiters sleep on hashed wait queues, each protected by its own lock.
+// FUTEX_WAIT checks the user word under the lock of its queue, and the wakers take it too,
+// so a wakeup that follows a change of the word cannot be missed.
+
+#define FUTEX_HASH 64
+
+struct futex_waiter {
+    uint64 key;                 // kernel address of the word, i.e. its physical address
+    spinlock_t *lock;           // lock of the queue we are in, NULL once woken up
+    struct futex_waiter *next;
+};
+
+struct futex_queue {
+    spinlock_t lock;
+    struct futex_waiter *head;
+};
+
+static struct futex_queue queues[FUTEX_HASH];
+
+void futex_init() {
+    for (int i = 0; i < FUTEX_HASH; i++)
+        spinlock_init(&queues[i].lock, "futex");
+}
+
+static struct futex_queue *futex_queue(uint64 key) {
+    return &queues[((key >> 2) ^ (key >> 12)) & (FUTEX_HASH - 1)];
+}
+
+// Append w, oldest waiters are woken up first. Called with q->lock held.
+static void futex_enqueue(struct futex_queue *q, struct futex_waiter *w) {
+    struct futex_waiter **pp = &q->head;
+    while (*pp != NULL)
+        pp = &(*pp)->next;
+    w->next = NULL;
+    w->lock = &q->lock;
+    *pp     = w;
+}
+
+static void futex_dequeue(struct futex_queue *q, struct futex_waiter *w) {
+    struct futex_waiter **pp = &q->head;
+    while (*pp != w)
+        pp = &(*pp)->next;
+    *pp = w->next;
+}
+
+// Lock the queue w is in, which FUTEX_REQUEUE may change under us.
+// Return the lock held, or NULL, without any lock, if w was woken up.
+static spinlock_t *futex_lock_waiter(struct futex_waiter *w) {
+    for (;;) {
+        spinlock_t *lk = __atomic_load_n(&w->lock, __ATOMIC_ACQUIRE);
+        if (lk == NULL)
+            return NULL;
+        acquire(lk);
+        if (lk == w->lock)
+            return lk;
+        release(lk);
+    }
+}
+
+static int futex_wait(uint64 __user uaddr, uint32 val, uint64 timeout) {
+    struct proc *p = curr_proc();
+    struct futex_waiter w;
+    uint32 *word;
+    int ret;
+
+    if ((ret = uaccess_word(p->mm, uaddr, &word)) < 0)
+        return ret;
+    uint64 deadline = timeout ? ticks + timeout : 0;
+
+    w.key                 = (uint64)word;
+    struct futex_queue *q = futex_queue(w.key);
+    acquire(&q->lock);
+    if (__atomic_load_n(word, __ATOMIC_SEQ_CST) != val) {
+        release(&q->lock);
+        return -EAGAIN;
+    }
+    futex_enqueue(q, &w);
+
+    spinlock_t *lk = &q->lock;
+    for (;;) {
+        // we hold lk, the lock of the queue we are still in.
+        if (iskilled(p)) {
+            ret = -EINTR;
+            break;
+        }
+        if (deadline != 0 && ticks >= deadline) {
+            ret = -ETIMEDOUT;
+            break;
+        }
+        sleep_until(&w, lk, deadline);
+        release(lk);
+        if ((lk = futex_lock_waiter(&w)) == NULL)
+            return 0;
+    }
+    futex_dequeue(futex_queue(w.key), &w);
+    release(lk);
+    return ret;
+}
+
+// Called with the lock of w's queue held, after w was dequeued.
+static void futex_wake_waiter(struct futex_waiter *w) {
+    // w lives on the waiter's stack: once w->lock is cleared, it may return and w is gone.
+    void *chan = w;
+    __atomic_store_n(&w->lock, NULL, __ATOMIC_RELEASE);
+    wakeup(chan);
+}
+
+// Wake up at most nwake waiters on key, then move at most nrequeue others to key2, if q2 is not NULL.
+// Called with the locks of q and q2 held. Return the number of waiters woken up.
+static int futex_wake_locked(struct futex_queue *q, uint64 key, int nwake, struct futex_queue *q2, uint64 key2, int nrequeue) {
+    struct futex_waiter **pp = &q->head;
+    int woken                = 0;
+
+    while (*pp != NULL) {
+        struct futex_waiter *w = *pp;
+        if (w->key != key) {
+            pp = &w->next;
+            continue;
+        }
+        if (woken < nwake) {
+            *pp = w->next;
+            futex_wake_waiter(w);
+            woken++;
+        } else if (q2 != NULL && nrequeue > 0) {
+            *pp    = w->next;
+            w->key = key2;
+            futex_enqueue(q2, w);
+            nrequeue--;
+        } else {
+            break;
+        }
+    }
+    return woken;
+}
+
+static int futex_wake(uint64 __user uaddr, int nwake, uint64 __user uaddr2, int nrequeue, int requeue) {
+    struct proc *p = curr_proc();
+    uint32 *word, *word2 = NULL;
+    int ret;
+
+    if (nwake < 0 || nrequeue < 0)
+        return -EINVAL;
+    if ((ret = uaccess_word(p->mm, uaddr, &word)) < 0)
+        return ret;
+    if (requeue && (ret = uaccess_word(p->mm, uaddr2, &word2)) < 0)
+        return ret;
+
+    struct futex_queue *q  = futex_queue((uint64)word);
+    struct futex_queue *q2 = requeue ? futex_queue((uint64)word2) : NULL;
+
+    // take both queue locks in address order.
+    struct futex_queue *first  = q2 != NULL && q2 < q ? q2 : q;
+    struct futex_queue *second = q2 != NULL && q2 != q ? (first == q ? q2 : q) : NULL;
+
+    acquire(&first->lock);
+    if (second)
+        acquire(&second->lock);
+    ret = futex_wake_locked(q, (uint64)word, nwake, q2, (uint64)word2, nrequeue);
+    if (second)
+        release(&second->lock);
+    release(&first->lock);
+    return ret;
+}
+
+int64 sys_futex(uint64 __user uaddr, int op, uint32 val, uint64 timeout, uint64 __user uaddr2) {
+    switch (op) {
+        case FUTEX_WAIT:
+            return futex_wait(uaddr, val, timeout);
+        case FUTEX_WAKE:
+            return futex_wake(uaddr, val, 0, 0, false);
+        case FUTEX_REQUEUE:
+            return futex_wake(uaddr, val, uaddr2, timeout, true);
+        default:
+            return -EINVAL;
+    }
+}
@@ -0,0 +1,12 @@
+// This file is shared by Kernel and User-space application.
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+// futex(uaddr, op, val, timeout, uaddr2) operations.
+// Waiters are keyed by the physical address of the 32-bit word at uaddr.
+#define FUTEX_WAIT    0  // sleep while *uaddr == val, for at most timeout ticks (0: no timeout)
+#define FUTEX_WAKE    1  // wake up at most val waiters on uaddr, return how many were woken up
+#define FUTEX_REQUEUE 2  // as FUTEX_WAKE, then move at most timeout other waiters to uaddr2
+
+#endif  // FUTEX_H
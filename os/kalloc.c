@@ -1,6 +1,7 @@
 #include "kalloc.h"
 
 #include "defs.h"
+#include "workqueue.h"
 
 struct linklist {
     struct linklist *next;
@@ -14,11 +15,37 @@ int kalloc_inited = 0;
 
 extern uint64 __kva kpage_allocator_base;
 extern uint64 __kva kpage_allocator_size;
-static spinlock_t kpagelock;
+static mcslock_t kpagelock;  // the hottest lock of all, queued
 int64 freepages_count;
 
+// Reference counts of allocated pages, for pages shared copy-on-write.
+// kallocpage returns a page with one reference, kfreepage drops one.
+static uint16 kpage_ref[PHYS_MEM_SIZE / PGSIZE];
+
+#define NSHRINKER 4
+static int (*shrinkers[NSHRINKER])(void);
+static int nshrinker;
+
+// Pages zeroed ahead of time by a worker, for kallocpage_zeroed(). Refilled up to ZEROED_HIGH
+// when they fall under ZEROED_LOW, and given back by a shrinker under memory pressure.
+// Linked through their first word, under kpagelock: that word is cleared when a page is taken.
+#define ZEROED_LOW  16
+#define ZEROED_HIGH 64
+static struct linklist *zeroed;
+static int nzeroed;
+static struct work zero_work;
+static void zero_pages(struct work *w);
+static int zeroed_shrink();
+
+static uint16 *page_ref(void *__pa pa) {
+    uint64 __kva kvaddr = PA_TO_KVA(pa);
+    if (!PGALIGNED((uint64)pa) || !(kpage_allocator_base <= kvaddr && kvaddr < kpage_allocator_base + kpage_allocator_size))
+        panic("invalid page %p", pa);
+    return &kpage_ref[(kvaddr - kpage_allocator_base) / PGSIZE];
+}
+
 void kpgmgrinit() {
-    spinlock_init(&kpagelock, "pageallocator");
+    mcslock_init(&kpagelock, "pageallocator");
 
     uint64 kpage_allocator_end = kpage_allocator_base + kpage_allocator_size;
 
@@ -26,10 +53,13 @@ void kpgmgrinit() {
 
     assert(PGALIGNED(kpage_allocator_base));
     assert(PGALIGNED(kpage_allocator_end));
+    assert(kpage_allocator_size / PGSIZE <= sizeof(kpage_ref) / sizeof(kpage_ref[0]));
 
     for (uint64 p = kpage_allocator_end - PGSIZE; p >= kpage_allocator_base; p -= PGSIZE) {
         kfreepage((void *)KVA_TO_PA(p));
     }
+    init_work(&zero_work, zero_pages);
+    register_shrinker(zeroed_shrink);
     kalloc_inited = 1;
 }
 
@@ -42,19 +72,70 @@ void kfreepage(void *__pa pa) {
     struct linklist *l;
 
     uint64 __kva kvaddr = PA_TO_KVA(pa);
-    if (!PGALIGNED((uint64)pa) || !(kpage_allocator_base <= kvaddr && kvaddr < kpage_allocator_base + kpage_allocator_size))
-        panic("invalid page %p", pa);
+    uint16 *ref         = page_ref(pa);
+
+    mcs_acquire(&kpagelock);
+    if (*ref > 1) {
+        // still shared
+        (*ref)--;
+        mcs_release(&kpagelock);
+        return;
+    }
+    *ref = 0;
+    mcs_release(&kpagelock);
+
     memset((void *)kvaddr, 0xdd, PGSIZE);
 
     if (kalloc_inited)
         debugf("free: %p, called by %p", pa, ra);
 
-    acquire(&kpagelock);
+    mcs_acquire(&kpagelock);
     l             = (struct linklist *)kvaddr;
     l->next       = kmem.freelist;
     kmem.freelist = l;
     freepages_count++;
-    release(&kpagelock);
+    mcs_release(&kpagelock);
+}
+
+// Drop a reference to each of the n pages, for teardowns freeing many pages at once:
+// kpagelock is taken twice for the whole batch, instead of twice per page.
+void kfreepages(void *__pa pages[], int n) {
+    uint64 ra = r_ra();
+    struct linklist *head = NULL, *tail = NULL;
+    int nfreed = 0;
+
+    mcs_acquire(&kpagelock);
+    for (int i = 0; i < n; i++) {
+        uint16 *ref = page_ref(pages[i]);
+        if (*ref > 1) {
+            (*ref)--;
+            pages[i] = NULL;
+        } else {
+            *ref = 0;
+        }
+    }
+    mcs_release(&kpagelock);
+
+    for (int i = 0; i < n; i++) {
+        if (pages[i] == NULL)
+            continue;
+        struct linklist *l = (struct linklist *)PA_TO_KVA(pages[i]);
+        memset(l, 0xdd, PGSIZE);
+        debugf("free: %p, called by %p", pages[i], ra);
+        l->next = head;
+        head    = l;
+        if (tail == NULL)
+            tail = l;
+        nfreed++;
+    }
+    if (head == NULL)
+        return;
+
+    mcs_acquire(&kpagelock);
+    tail->next    = kmem.freelist;
+    kmem.freelist = head;
+    freepages_count += nfreed;
+    mcs_release(&kpagelock);
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -62,15 +143,21 @@ void kfreepage(void *__pa pa) {
 // Returns 0 if the memory cannot be allocated.
 void *__pa kallocpage() {
     uint64 ra = r_ra();  // who calls me?
-
-    acquire(&kpagelock);
     struct linklist *l;
-    l = kmem.freelist;
-    if (l) {
-        kmem.freelist = l->next;
-        freepages_count--;
+
+    for (int retry = 0;; retry++) {
+        mcs_acquire(&kpagelock);
+        l = kmem.freelist;
+        if (l) {
+            kmem.freelist = l->next;
+            freepages_count--;
+            kpage_ref[((uint64)l - kpage_allocator_base) / PGSIZE] = 1;
+        }
+        mcs_release(&kpagelock);
+        // under memory pressure, let the caches give some pages back, once.
+        if (l != NULL || retry > 0 || kpage_shrink() == 0)
+            break;
     }
-    release(&kpagelock);
     
     debugf("alloc: %p, by %p", KVA_TO_PA(l), ra);
 
@@ -83,6 +170,99 @@ void *__pa kallocpage() {
     return (void *)KVA_TO_PA((uint64)l);
 }
 
+static void zero_pages(struct work *w) {
+    while (__atomic_load_n(&nzeroed, __ATOMIC_RELAXED) < ZEROED_HIGH) {
+        mcs_acquire(&kpagelock);
+        struct linklist *l = kmem.freelist;
+        if (l) {
+            kmem.freelist = l->next;
+            freepages_count--;
+        }
+        mcs_release(&kpagelock);
+        if (l == NULL)
+            break;
+
+        pagezero(l);
+        mcs_acquire(&kpagelock);
+        l->next = zeroed;
+        zeroed  = l;
+        nzeroed++;
+        mcs_release(&kpagelock);
+        cond_resched();
+    }
+}
+
+// Like kallocpage, but the page is zeroed, most often ahead of time.
+void *__pa kallocpage_zeroed() {
+    struct linklist *l;
+
+    mcs_acquire(&kpagelock);
+    if ((l = zeroed) != NULL) {
+        zeroed = l->next;
+        nzeroed--;
+        kpage_ref[((uint64)l - kpage_allocator_base) / PGSIZE] = 1;
+    }
+    int low = nzeroed < ZEROED_LOW;
+    mcs_release(&kpagelock);
+    if (low)
+        queue_work(&zero_work);
+
+    if (l != NULL) {
+        l->next = NULL;
+        return (void *)KVA_TO_PA((uint64)l);
+    }
+    void *pa = kallocpage();
+    if (pa != NULL)
+        pagezero((void *)PA_TO_KVA(pa));
+    return pa;
+}
+
+// The shrinker of the zeroed pages: give them all back.
+static int zeroed_shrink() {
+    int n = 0;
+
+    mcs_acquire(&kpagelock);
+    while (zeroed != NULL) {
+        struct linklist *l = zeroed;
+        zeroed             = l->next;
+        l->next            = kmem.freelist;
+        kmem.freelist      = l;
+        freepages_count++;
+        n++;
+    }
+    nzeroed = 0;
+    mcs_release(&kpagelock);
+    return n;
+}
+
+// Take one more reference on an allocated page.
+void kpage_dup(void *__pa pa) {
+    uint16 *ref = page_ref(pa);
+
+    mcs_acquire(&kpagelock);
+    assert(*ref > 0 && *ref < 0xffff);
+    (*ref)++;
+    mcs_release(&kpagelock);
+}
+
+int kpage_refcnt(void *__pa pa) {
+    return *page_ref(pa);
+}
+
+// Caches of pages register a shrinker, which frees what it can and returns the number of pages freed.
+// A shrinker may be called from any kallocpage, so it must give up when the caller holds its locks.
+void register_shrinker(int (*fn)(void)) {
+    assert(nshrinker < NSHRINKER);
+    shrinkers[nshrinker++] = fn;
+}
+
+int kpage_shrink() {
+    int freed = 0;
+    for (int i = 0; i < nshrinker; i++)
+        freed += shrinkers[i]();
+    return freed;
+}
+
 // Object Allocator
 static uint64 allocator_mapped_va = KERNEL_ALLOCATOR_BASE;
 
@@ -5,7 +5,13 @@
 
 void kpgmgrinit();
 void kfreepage(void *pa);
+void kfreepages(void *__pa pages[], int n);
 void *__pa kallocpage();
+void *__pa kallocpage_zeroed();
+void kpage_dup(void *__pa pa);
+int kpage_refcnt(void *__pa pa);
+void register_shrinker(int (*fn)(void));
+int kpage_shrink();
 
 // Object Allocator:
 
@@ -8,5 +8,61 @@ uint64 ktest_syscall(uint64 args[6]);
 #define KTEST_PRINT_KERNPGT 2
 #define KTEST_GET_NRFREEPGS 3
 #define KTEST_GET_NRSTRBUF  4
+#define KTEST_BENCH_STRING  5
+#define KTEST_BENCH_LOCK    6
+#define KTEST_LOCKSTAT      7
+#define KTEST_LOCKSTAT_RESET 8
+#define KTEST_SCHEDSTAT     9
+#define KTEST_TEMPLATESTAT  10
+
+// KTEST_BENCH_STRING: `time` ticks spent on BENCH_STRING_ROUNDS calls of each variant.
+// The *_byte fields are the plain byte-at-a-time loops, for comparison.
+#define BENCH_STRING_ROUNDS 256
+
+struct bench_string {
+    uint64 memset_byte, memset_word;
+    uint64 pagezero_words, pagezero_cboz;
+    uint64 memmove_byte, memmove_word, memmove_unaligned;
+    uint64 memcmp_byte, memcmp_word;
+    uint64 strlen_byte, strlen_word;
+    uint64 has_cboz;
+};
+
+// KTEST_BENCH_LOCK(kind, nharts): nharts callers, each running on its own hart, meet in the kernel,
+// then take a shared lock of that kind BENCH_LOCK_ROUNDS times each.
+// All of them return the `time` ticks from the start until the last one is done.
+#define BENCH_LOCK_TAS    0  // test-and-set spinning, what acquire() used to do
+#define BENCH_LOCK_TICKET 1  // spinlock_t
+#define BENCH_LOCK_MCS    2  // mcslock_t
+#define BENCH_LOCK_ROUNDS 20000
+
+// KTEST_LOCKSTAT(buf, len): fill buf with up to len bytes of lockstat_entry, one per lock class,
+// summed over all cpus. Return the number of entries, or -EINVAL if the kernel is built without LOCKSTAT=y.
+// KTEST_LOCKSTAT_RESET: clear the statistics.
+struct lockstat_entry {
+    char name[16];
+    uint64 acquisitions;
+    uint64 contended;
+    uint64 spin_total, spin_max;  // in `time` ticks
+    uint64 hold_total, hold_max;
+};
+
+// KTEST_SCHEDSTAT(buf, len): fill buf with up to len bytes of schedstat_cpu, one per cpu.
+// Return the number of entries.
+struct schedstat_cpu {
+    uint64 online;
+    uint64 nr_queued;     // tasks waiting in its run queue
+    uint64 load_avg;      // decayed average of the runnable tasks, 1024 per task
+    uint64 migrations;    // tasks pulled from other cpus by the balancer
+    uint64 idle_pulls;    // of which when it had nothing to run
+    uint64 balance_runs;  // periodic balancer runs
+};
+
+// KTEST_TEMPLATESTAT(buf, len): the app template cache of exec, see os/loader.c.
+struct template_stat {
+    uint64 cached;  // templates held now
+    uint64 builds;  // since boot
+    uint64 clones;  // execs served from a template
+};
 
 #endif  // __KTEST_H__
\ No newline at end of file
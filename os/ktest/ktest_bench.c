@@ -0,0 +1,187 @@
+#include "defs.h"
+#include "fdt.h"
+#include "ktest.h"
+#include "timer.h"
+
+// Byte-at-a-time reference implementations, the way string.c used to be.
+// Keep GCC from turning them back into calls to the optimized versions.
+#define REFERENCE __attribute__((noinline, optimize("no-tree-loop-distribute-patterns")))
+
+static REFERENCE void memset_byte(void *dst, int c, uint n) {
+    volatile char *d = dst;
+    for (uint i = 0; i < n; i++)
+        d[i] = c;
+}
+
+static REFERENCE void memmove_byte(void *dst, const void *src, uint n) {
+    volatile char *d = dst;
+    const char *s    = src;
+    while (n-- > 0)
+        *d++ = *s++;
+}
+
+static REFERENCE int memcmp_byte(const void *v1, const void *v2, uint n) {
+    const volatile uchar *s1 = v1, *s2 = v2;
+    for (uint i = 0; i < n; i++)
+        if (s1[i] != s2[i])
+            return s1[i] - s2[i];
+    return 0;
+}
+
+static REFERENCE int strlen_byte(const char *s) {
+    const volatile char *p = s;
+    int n;
+    for (n = 0; p[n]; n++)
+        ;
+    return n;
+}
+
+#define BENCH(field, stmt)                                \
+    do {                                                  \
+        uint64 start = r_time();                          \
+        for (int i = 0; i < BENCH_STRING_ROUNDS; i++) {   \
+            stmt;                                         \
+            asm volatile("" ::: "memory");                \
+        }                                                 \
+        res->field = r_time() - start;                    \
+    } while (0)
+
+// Run the string micro-benchmarks on two scratch pages.
+// Return 0 on success, -ENOMEM if the scratch pages cannot be allocated.
+int ktest_bench_string(struct bench_string *res) {
+    void *pa1 = kallocpage();
+    void *pa2 = kallocpage();
+    if (pa1 == NULL || pa2 == NULL) {
+        if (pa1)
+            kfreepage(pa1);
+        if (pa2)
+            kfreepage(pa2);
+        return -ENOMEM;
+    }
+    char *a = (char *)PA_TO_KVA(pa1);
+    char *b = (char *)PA_TO_KVA(pa2);
+    volatile int sink;
+
+    memset(res, 0, sizeof(*res));
+    res->has_cboz = !!(isa_extensions & ISA_EXT_ZICBOZ);
+
+    BENCH(memset_byte, memset_byte(a, 0x5a, PGSIZE));
+    BENCH(memset_word, memset(a, 0x5a, PGSIZE));
+    BENCH(pagezero_words, pagezero_variant(PAGEZERO_WORDS, a));
+    if (res->has_cboz)
+        BENCH(pagezero_cboz, pagezero_variant(PAGEZERO_CBOZ, a));
+
+    memset(a, 'x', PGSIZE);
+    BENCH(memmove_byte, memmove_byte(b, a, PGSIZE));
+    BENCH(memmove_word, memmove(b, a, PGSIZE));
+    // relative misalignment: falls back to bytes.
+    BENCH(memmove_unaligned, memmove(b + 1, a, PGSIZE - 8));
+
+    memmove(b, a, PGSIZE);
+    BENCH(memcmp_byte, sink = memcmp_byte(a, b, PGSIZE));
+    BENCH(memcmp_word, sink = memcmp(a, b, PGSIZE));
+
+    a[PGSIZE - 1] = '\0';
+    BENCH(strlen_byte, sink = strlen_byte(a));
+    BENCH(strlen_word, sink = strlen(a));
+    (void)sink;
+
+    kfreepage(pa1);
+    kfreepage(pa2);
+    return 0;
+}
+
+// Lock contention benchmark.
+
+// all-zero is an unlocked lock of every kind.
+static struct {
+    uint64 tas;
+    spinlock_t ticket;
+    mcslock_t mcs;
+    uint64 counter;  // the critical section
+
+    // barrier, arrived and generation under barrier_lock
+    spinlock_t barrier_lock;
+    int arrived;
+    int generation;
+    uint64 start, end;
+} lockbench;
+
+#define BENCH_BARRIER_TIMEOUT (2 * CPU_FREQ)
+
+// Wait until n callers are here. The last one to arrive records the time in *stamp.
+// A caller that waited BENCH_BARRIER_TIMEOUT leaves, and returns -ETIMEDOUT:
+// the others may share its hart, or not come at all.
+static int bench_barrier(int n, uint64 *stamp) {
+    uint64 deadline = r_time() + BENCH_BARRIER_TIMEOUT;
+
+    acquire(&lockbench.barrier_lock);
+    int gen = lockbench.generation;
+    if (++lockbench.arrived == n) {
+        *stamp            = r_time();
+        lockbench.arrived = 0;
+        __atomic_store_n(&lockbench.generation, gen + 1, __ATOMIC_RELEASE);
+        release(&lockbench.barrier_lock);
+        return 0;
+    }
+    release(&lockbench.barrier_lock);
+
+    while (__atomic_load_n(&lockbench.generation, __ATOMIC_ACQUIRE) == gen) {
+        if (r_time() > deadline) {
+            acquire(&lockbench.barrier_lock);
+            int left = lockbench.generation == gen;
+            if (left)
+                lockbench.arrived--;
+            release(&lockbench.barrier_lock);
+            return left ? -ETIMEDOUT : 0;
+        }
+        cpu_relax();
+    }
+    return 0;
+}
+
+static REFERENCE void tas_acquire(uint64 *lk) {
+    push_off();
+    while (__sync_lock_test_and_set(lk, 1) != 0)
+        ;
+    __sync_synchronize();
+}
+
+static REFERENCE void tas_release(uint64 *lk) {
+    __sync_synchronize();
+    __sync_lock_release(lk);
+    pop_off();
+}
+
+// The callers must run on different harts: the barriers give up after BENCH_BARRIER_TIMEOUT.
+int64 ktest_bench_lock(int kind, int nharts) {
+    int ret;
+
+    if (kind < BENCH_LOCK_TAS || kind > BENCH_LOCK_MCS || nharts < 1 || nharts > nr_cpus)
+        return -EINVAL;
+
+    if ((ret = bench_barrier(nharts, &lockbench.start)) < 0)
+        return ret;
+    for (int i = 0; i < BENCH_LOCK_ROUNDS; i++) {
+        switch (kind) {
+            case BENCH_LOCK_TAS:
+                tas_acquire(&lockbench.tas);
+                lockbench.counter++;
+                tas_release(&lockbench.tas);
+                break;
+            case BENCH_LOCK_TICKET:
+                acquire(&lockbench.ticket);
+                lockbench.counter++;
+                release(&lockbench.ticket);
+                break;
+            case BENCH_LOCK_MCS:
+                mcs_acquire(&lockbench.mcs);
+                lockbench.counter++;
+                mcs_release(&lockbench.mcs);
+                break;
+        }
+    }
+    if ((ret = bench_barrier(nharts, &lockbench.end)) < 0)
+        return ret;
+    return lockbench.end - lockbench.start;
+}
@@ -1,9 +1,15 @@
 #include "defs.h"
 #include "ktest.h"
+#include "lockstat.h"
+#include "workqueue.h"
 
 extern int64 freepages_count;
 extern allocator_t kstrbuf;
 
+int ktest_bench_string(struct bench_string *res);
+int64 ktest_bench_lock(int kind, int nharts);
+void template_stat(struct template_stat *st);
+
 uint64 ktest_syscall(uint64 args[6]) {
     uint64 which = args[0];
     switch (which) {
@@ -14,9 +20,60 @@ uint64 ktest_syscall(uint64 args[6]) {
             vm_print(kernel_pagetable);
             break;
         case KTEST_GET_NRFREEPGS:
+            // pages held by caches (e.g. app templates) are not leaked, give them back first.
+            // Address spaces of exited processes are freed by the workers, wait for them too.
+            flush_workqueues();
+            kpage_shrink();
             return freepages_count;
         case KTEST_GET_NRSTRBUF:
             return kstrbuf.available_count;
+        case KTEST_BENCH_STRING: {
+            struct bench_string res;
+            int ret = ktest_bench_string(&res);
+            if (ret < 0)
+                return ret;
+            if (args[2] < sizeof(res))
+                return -EINVAL;
+            return copy_to_user(curr_proc()->mm, args[1], (char *)&res, sizeof(res));
+        }
+        case KTEST_BENCH_LOCK:
+            return ktest_bench_lock(args[1], args[2]);
+        case KTEST_TEMPLATESTAT: {
+            struct template_stat st;
+            if (args[2] < sizeof(st))
+                return -EINVAL;
+            template_stat(&st);
+            return copy_to_user(curr_proc()->mm, args[1], (char *)&st, sizeof(st));
+        }
+        case KTEST_SCHEDSTAT: {
+            struct schedstat_cpu st;
+            int n;
+            for (n = 0; (n + 1) * sizeof(st) <= args[2] && sched_stat(n, &st) == 0; n++) {
+                int ret = copy_to_user(curr_proc()->mm, args[1] + n * sizeof(st), (char *)&st, sizeof(st));
+                if (ret < 0)
+                    return ret;
+            }
+            return n;
+        }
+#ifdef LOCKSTAT
+        case KTEST_LOCKSTAT: {
+            struct lockstat_entry e;
+            int n;
+            for (n = 0; (n + 1) * sizeof(e) <= args[2] && lockstat_get(n, &e) == 0; n++) {
+                int ret = copy_to_user(curr_proc()->mm, args[1] + n * sizeof(e), (char *)&e, sizeof(e));
+                if (ret < 0)
+                    return ret;
+            }
+            return n;
+        }
+        case KTEST_LOCKSTAT_RESET:
+            lockstat_reset();
+            break;
+#else
+        case KTEST_LOCKSTAT:
+        case KTEST_LOCKSTAT_RESET:
+            return -EINVAL;
+#endif
     }
     return 0;
 }
\ No newline at end of file
@@ -2,192 +2,461 @@
 
 #include "defs.h"
 #include "elf.h"
+#include "ktest/ktest.h"
 #include "trap.h"
 
+static mutex_t template_lock;
+static int template_shrink();
+
+// Check the segment table of app against the program headers of its ELF,
+// and that exec can map each segment as is: page-aligned, and inside the image.
+static int check_segs(struct user_app *app, Elf64_Ehdr *ehdr) {
+    Elf64_Phdr *phdr = (Elf64_Phdr *)(app->elf_address + ehdr->e_phoff);
+    uint64 n         = 0;
+
+    if (app->nsegs > APP_MAX_SEGS)
+        return -1;
+    for (int i = 0; i < ehdr->e_phnum; i++, phdr++) {
+        if (phdr->p_type != PT_LOAD)
+            continue;
+        if (n == app->nsegs)
+            return -1;
+        struct app_seg *seg = &app->segs[n++];
+        if (seg->vaddr != phdr->p_vaddr || seg->memsz != phdr->p_memsz || seg->filesz != phdr->p_filesz ||
+            seg->offset != phdr->p_offset || seg->flags != phdr->p_flags)
+            return -1;
+        if (!PGALIGNED(seg->vaddr) || seg->filesz > seg->memsz ||
+            seg->offset + seg->filesz > app->elf_length || !IS_USER_VA(seg->vaddr + seg->memsz))
+            return -1;
+    }
+    return n == app->nsegs ? 0 : -1;
+}
+
 // Get user progs' infomation through pre-defined symbol in `link_app.S`
 void loader_init() {
+    mutex_init(&template_lock, "template");
+    register_shrinker(template_shrink);
+
     printf("applist:\n");
     for (struct user_app *app = user_apps; app->name != NULL; app++) {
         printf("\t%s\n", app->name);
         Elf64_Ehdr *ehdr = (Elf64_Ehdr *)app->elf_address;
         assert_str(ehdr->e_ident[0] == 0x7F && ehdr->e_ident[1] == 'E' && ehdr->e_ident[2] == 'L' && ehdr->e_ident[3] == 'F', "invalid elf header: %s", app->name);
         assert_equals(ehdr->e_phentsize, sizeof(Elf64_Phdr), "invalid program header size");
+        // exec trusts the summary made by pack.py, check it once here.
+        assert_str(ehdr->e_entry == app->entry && get_elf(app->name) == app, "stale app table: %s", app->name);
+        assert_str(check_segs(app, ehdr) == 0, "stale segment table: %s", app->name);
     }
 }
 
-struct user_app *get_elf(char *name) {
-    if (strlen(name) == 0)
-        return NULL;
-    for (struct user_app *app = user_apps; app->name != NULL; app++) {
-        if (strncmp(name, app->name, strlen(name)) == 0)
-            return app;
+// FNV-1a, seeded. Must match fnv1a() in scripts/pack.py.
+static uint32 app_name_hash(const char *name, uint64 seed, uint64 *len) {
+    uint32 h = 2166136261u ^ (uint32)seed;
+    const char *s;
+    for (s = name; *s; s++) {
+        h ^= (uchar)*s;
+        h *= 16777619u;
     }
-    return NULL;
+    *len = s - name;
+    return h;
 }
 
-/**
- * Try to load the user program into the process.acquire
- * 
- * If succeed, the process's mm is freed and set to a new struct mm.
- * Otherwise, the process's mm is unchanged.
- */
-int load_user_elf(struct user_app *app, struct proc *p, char *args[]) {
-    if (p == NULL || p->state == UNUSED)
-        panic("...");
+// Look up an app by its exact name, in constant time.
+struct user_app *get_elf(char *name) {
+    uint64 len;
+    uint32 hash = app_name_hash(name, user_apps_hash_seed, &len);
 
-    // create a new mm for the process
-    struct mm *new_mm = mm_create(p->trapframe);
-    if (new_mm == NULL) {
-        errorf("mm_create");
-        return -ENOMEM;
-    }
+    int slot = user_apps_hash[hash & user_apps_hash_mask];
+    if (slot == 0)
+        return NULL;
+    struct user_app *app = &user_apps[slot - 1];
+    if (app->hash != hash || app->name_len != len || memcmp(app->name, name, len) != 0)
+        return NULL;
+    return app;
+}
 
-    struct vma* vma_brk;
-    uint64 brk;
+// Build the address space of app in mm: its segments, an empty brk and a zeroed stack.
+// On failure, VMAs already created are left in mm, for the caller to free.
+static int setup_mm(struct user_app *app, struct mm *mm, uint64 *brk) {
+    struct vma *vma_brk;
     int ret;
 
-    Elf64_Ehdr *ehdr      = (Elf64_Ehdr *)app->elf_address;
-    Elf64_Phdr *phdr_base = (Elf64_Phdr *)(app->elf_address + ehdr->e_phoff);
-    uint64 max_va_end     = 0;
-    for (int i = 0; i < ehdr->e_phnum; i++) {
-        Elf64_Phdr *phdr = &phdr_base[i];
-        // we only load from PT_LOAD phdrs
-        if (phdr->p_type != PT_LOAD)
-            continue;
-        assert_str(PGALIGNED(phdr->p_vaddr), "Simplified loader only support page-aligned p_vaddr: %p", phdr->p_vaddr);
+    uint64 max_va_end = 0;
+    for (int i = 0; i < app->nsegs; i++) {
+        struct app_seg *seg = &app->segs[i];
 
         // resolve the permission of PTE for this phdr
         int pte_perm = PTE_U;
-        if (phdr->p_flags & PF_R)
+        if (seg->flags & PF_R)
             pte_perm |= PTE_R;
-        if (phdr->p_flags & PF_W)
+        if (seg->flags & PF_W)
             pte_perm |= PTE_W;
-        if (phdr->p_flags & PF_X)
+        if (seg->flags & PF_X)
             pte_perm |= PTE_X;
 
-        struct vma *vma = mm_create_vma(new_mm);
-        vma->vm_start   = PGROUNDDOWN(phdr->p_vaddr);  // The ELF requests this phdr loaded to p_vaddr;
-        vma->vm_end     = PGROUNDUP(vma->vm_start + phdr->p_memsz);
+        struct vma *vma = mm_create_vma(mm);
+        vma->vm_start   = PGROUNDDOWN(seg->vaddr);  // The ELF requests this phdr loaded to p_vaddr;
+        vma->vm_end     = PGROUNDUP(vma->vm_start + seg->memsz);
         vma->pte_flags  = pte_perm;
 
-        // map the VMA with mm_mappages. if succeed, walkaddr should never fails.
-        if ((ret = mm_mappages(vma)) < 0) {
-            errorf("mm_mappages phdr: vaddr %p", phdr->p_vaddr);
-            goto bad;
+        // Nothing is copied here: pages are populated on first access by mm_fault,
+        // and the pages fully covered by the file are mapped straight from the app image
+        // (pack.py page-aligns every app). A partial last page is copied and zero-filled past filesz,
+        // read-only or not: the image goes on with the next section, or the next app.
+        if ((ret = mm_mapimage(vma, app->elf_address + seg->offset, seg->filesz)) < 0) {
+            errorf("mm_mapimage phdr: vaddr %p", seg->vaddr);
+            return ret;
         }
 
-        int64 file_off      = 0;
-        uint64 file_remains = phdr->p_filesz;
-
-        for (uint64 va = vma->vm_start; va < vma->vm_end; va += PGSIZE) {
-            void *__kva pa = (void *)PA_TO_KVA(walkaddr(new_mm, va));
-            void *src      = (void *)(app->elf_address + phdr->p_offset + file_off);
-
-            uint64 copy_size = MIN(file_remains, PGSIZE);
-            memmove(pa, src, copy_size);
-
-            if (copy_size < PGSIZE) {
-                // clear remaining bytes
-                memset(pa + copy_size, 0, PGSIZE - copy_size);
-            }
-            file_off += copy_size;
-            file_remains -= copy_size;
-        }
-
-        if (phdr->p_memsz > phdr->p_filesz) {
-            // ELF requests larger memory than filesz
-            // 	these are .bss segment, clear it to zero.
-
-            uint64 bss_start = phdr->p_vaddr + phdr->p_filesz;
-            uint64 bss_end   = phdr->p_vaddr + phdr->p_memsz;
-
-            for (uint64 va = bss_start; va < bss_end; va = PGROUNDDOWN(va) + PGSIZE) {
-                // set [va, page boundary of ba) to zero
-                uint64 page_off   = va - PGROUNDDOWN(va);
-                uint64 clear_size = PGROUNDUP(va) - va;
-                void *__kva pa    = (void *)PA_TO_KVA(walkaddr(new_mm, PGROUNDDOWN(va)));
-                memset(pa + page_off, 0, clear_size);
-            }
-        }
-
-        assert(file_remains == 0);
-        max_va_end = MAX(max_va_end, PGROUNDUP(phdr->p_vaddr + phdr->p_memsz));
+        max_va_end = MAX(max_va_end, PGROUNDUP(seg->vaddr + seg->memsz));
     }
 
     // setup brk: zero
-    vma_brk            = mm_create_vma(new_mm);
+    vma_brk            = mm_create_vma(mm);
     vma_brk->vm_start  = max_va_end;
     vma_brk->vm_end    = max_va_end;
     vma_brk->pte_flags = PTE_R | PTE_W | PTE_U;
     if ((ret = mm_mappages(vma_brk)) < 0) {
         errorf("mm_mappages vma_brk");
-        goto bad;
+        return ret;
     }
-    brk = max_va_end;
+    *brk = max_va_end;
 
     // setup stack
-    struct vma *vma_ustack = mm_create_vma(new_mm);
+    struct vma *vma_ustack = mm_create_vma(mm);
     vma_ustack->vm_start   = USTACK_START - USTACK_SIZE;
     vma_ustack->vm_end     = USTACK_START;
     vma_ustack->pte_flags  = PTE_R | PTE_W | PTE_U;
     if ((ret = mm_mappages(vma_ustack)) < 0) {
         errorf("mm_mappages ustack");
-        goto bad;
+        return ret;
     }
 
     for (uint64 va = vma_ustack->vm_start; va < vma_ustack->vm_end; va += PGSIZE) {
-        void *__kva pa = (void *)PA_TO_KVA(walkaddr(new_mm, va));
-        memset(pa, 0, PGSIZE);
-    }
-
-    // from here, we are done with all page allocation 
-    // (including pagetable allocation during mapping the trampoline and trapframe).
-
-    // push strings
-    uint64 __user uargv[MAXARG];
-    uint64 sp = USTACK_START;
-    int len, argc = 0;
-    for (int i = 0; args[i] != NULL; i++) {
-        len       = strlen(args[i]) + 1;
-        sp        = sp - len;
-        sp        = sp & ~7;  // align to 8 bytes
-        void *kva = (void *)PA_TO_KVA(useraddr(new_mm, sp));
-        memmove(kva, args[i], len);
-        uargv[i] = sp;  // save the start address of string to uargv
-        argc++;
-    }
-    assert(IS_ALIGNED(sp, 8));
-
-    // push argv array
-    sp = sp - sizeof(uint64);
-    // allocate a NULL
-    for (int i = argc - 1; i >= 0; i--) {
-        sp             = sp - sizeof(uint64);
-        void *kva      = (void *)PA_TO_KVA(useraddr(new_mm, sp));
-        *(uint64 *)kva = uargv[i];
-    }
-    uint64 uargv_ptr = sp;
-    sp               = sp & ~15;  // aligned to 16 bytes
-    assert(IS_ALIGNED(sp, 16));
-
-    release(&new_mm->lock);
-
-    // free the old mm. for the first process, p->mm = NULL.
-    if (p->mm) {
-        acquire(&p->mm->lock);
-        mm_free(p->mm);    
-    }
-    
+        void *__kva pa = (void *)PA_TO_KVA(walkaddr(mm, va));
+        pagezero(pa);
+    }
+    return 0;
+}
+
+// App templates:
+// The first exec of an app builds a template mm, which never runs: its VMAs, page tables,
+// the zeroed stack and the populated image-backed pages. Later execs clone it copy-on-write,
+// so exec costs about as much as a fork of a small process.
+// The cache is bounded, the least recently used template is replaced,
+// and all of them are dropped when memory runs out.
+
+#define NTEMPLATE 8
+
+static struct app_template {
+    struct user_app *app;
+    struct mm *mm;
+    uint64 brk;
+    uint64 last_used;
+} templates[NTEMPLATE];
+static uint64 template_clock;
+static uint64 template_builds, template_clones;  // for KTEST_TEMPLATESTAT
+
+extern int64 freepages_count;
+
+static void template_free(struct app_template *t) {
+    assert(mutex_held(&template_lock));
+
+    // templates are only locked under template_lock, this never waits.
+    down_write(&t->mm->lock);
+    mm_free(t->mm);
+    t->app = NULL;
+    t->mm  = NULL;
+}
+
+// Shrinker of the template cache, return the number of pages freed.
+static int template_shrink() {
+    // called from any kallocpage, maybe with spinlocks held, or while building or cloning a template:
+    // never wait for the lock.
+    if (!mutex_trylock(&template_lock))
+        return 0;
+
+    int64 before = freepages_count;
+    for (int i = 0; i < NTEMPLATE; i++) {
+        if (templates[i].app)
+            template_free(&templates[i]);
+    }
+    mutex_unlock(&template_lock);
+    return MAX(freepages_count - before, 0);
+}
+
+// Find the template of app, or build it. Return NULL if there is no memory for it.
+static struct app_template *template_get(struct user_app *app) {
+    assert(mutex_held(&template_lock));
+
+    struct app_template *victim = NULL;
+    for (struct app_template *t = templates; t < &templates[NTEMPLATE]; t++) {
+        if (t->app == app)
+            return t;
+        if (victim == NULL || (victim->app && (t->app == NULL || t->last_used < victim->last_used)))
+            victim = t;
+    }
+
+    struct mm *mm = mm_create(NULL);
+    if (mm == NULL)
+        return NULL;
+    uint64 brk;
+    if (setup_mm(app, mm, &brk) < 0)
+        goto bad;
+    // populate the image-backed pages once, for all the clones.
+    for (struct vma *vma = mm->vma; vma; vma = vma->next) {
+        uint64 end = MIN(vma->vm_end, vma->vm_start + PGROUNDUP(vma->backing_size));
+        for (uint64 va = vma->vm_start; vma->backing && va < end; va += PGSIZE) {
+            if (mm_fault(mm, va, false) < 0)
+                goto bad;
+            cond_resched();
+        }
+    }
+    up_write(&mm->lock);
+
+    if (victim->app)
+        template_free(victim);
+    victim->app = app;
+    victim->mm  = mm;
+    victim->brk = brk;
+    template_builds++;
+    return victim;
+
+bad:
+    mm_free(mm);
+    return NULL;
+}
+
+// Clone the template of app into mm. Return 0 on success, -ENOMEM.
+static int template_clone(struct user_app *app, struct mm *mm, uint64 *brk) {
+    int ret = -ENOMEM;
+
+    mutex_lock(&template_lock);
+    struct app_template *t = template_get(app);
+    if (t != NULL) {
+        t->last_used = ++template_clock;
+        down_write(&t->mm->lock);
+        ret = mm_clone(t->mm, mm);
+        up_write(&t->mm->lock);
+        *brk = t->brk;
+        if (ret == 0)
+            template_clones++;
+    }
+    mutex_unlock(&template_lock);
+    return ret;
+}
+
+void template_stat(struct template_stat *st) {
+    mutex_lock(&template_lock);
+    st->cached = 0;
+    for (int i = 0; i < NTEMPLATE; i++)
+        st->cached += templates[i].app != NULL;
+    st->builds = template_builds;
+    st->clones = template_clones;
+    mutex_unlock(&template_lock);
+}
+
+// Argument pages.
+
+void exec_args_init(struct exec_args *ea) {
+    memset(ea, 0, sizeof(*ea));
+    ea->sp = USTACK_START;
+}
+
+void exec_args_free(struct exec_args *ea) {
+    for (int i = 0; i < ea->npages; i++) {
+        if (ea->pages[i])
+            kfreepage(ea->pages[i]);
+    }
+    ea->npages = 0;
+}
+
+// The kernel address of va, in the argument pages.
+static char *__kva ea_kva(struct exec_args *ea, uint64 va) {
+    uint64 i = (USTACK_START - 1 - va) / PGSIZE;
+    return (char *)PA_TO_KVA(ea->pages[i]) + (va - (USTACK_START - (i + 1) * PGSIZE));
+}
+
+// Move ea->sp down by len bytes, allocating the pages it reaches.
+static int ea_reserve(struct exec_args *ea, uint64 len) {
+    if (len > ea->sp - (USTACK_START - EXEC_ARG_PAGES * PGSIZE))
+        return -E2BIG;
+    ea->sp -= len;
+    while (ea->sp < USTACK_START - ea->npages * PGSIZE) {
+        // the rest of the lowest page is the user's stack, do not leak old data to it.
+        void *pa = kallocpage_zeroed();
+        if (pa == NULL)
+            return -ENOMEM;
+        ea->pages[ea->npages++] = pa;
+    }
+    return 0;
+}
+
+static void ea_count(struct exec_args *ea, int env) {
+    if (env)
+        ea->envc++;
+    else
+        ea->argc++;
+}
+
+// Push a kernel string. All argv strings must be pushed before envp strings.
+int exec_args_push(struct exec_args *ea, const char *s, int env) {
+    int ret;
+    uint64 len = strlen(s) + 1;
+    if ((ret = ea_reserve(ea, len)) < 0)
+        return ret;
+    for (uint64 va = ea->sp, off = 0; off < len;) {
+        uint64 n = MIN(PGROUNDUP(va + 1) - va, len - off);
+        memmove(ea_kva(ea, va), s + off, n);
+        va += n;
+        off += n;
+    }
+    ea_count(ea, env);
+    return 0;
+}
+
+// Push the strings of a NULL-terminated user vector, e.g. argv, of the current process.
+// uvec may be 0, for an empty vector.
+int exec_args_copy(struct exec_args *ea, uint64 __user uvec, int env) {
+    struct mm *mm = curr_proc()->mm;
+    uint64 __user ptrs[16];
+    int ret;
+
+    while (uvec) {
+        // read the pointers in batches, without crossing a page the vector may not reach.
+        int n = MIN(sizeof(ptrs) / sizeof(ptrs[0]), (PGROUNDUP(uvec + 1) - uvec) / sizeof(uint64));
+        n     = MAX(n, 1);
+        if ((ret = copy_from_user(mm, (char *)ptrs, uvec, n * sizeof(uint64))) < 0)
+            return ret;
+        for (int i = 0; i < n; i++) {
+            if (ptrs[i] == 0)
+                return 0;
+            int64 len = strnlen_user(mm, ptrs[i], ea->sp - (USTACK_START - EXEC_ARG_PAGES * PGSIZE));
+            if (len < 0)
+                return len;
+            if ((ret = ea_reserve(ea, len)) < 0)
+                return ret;
+            for (uint64 va = ea->sp, src = ptrs[i], left = len; left > 0;) {
+                uint64 chunk = MIN(PGROUNDUP(va + 1) - va, left);
+                if ((ret = copy_from_user(mm, ea_kva(ea, va), src, chunk)) < 0)
+                    return ret;
+                va += chunk;
+                src += chunk;
+                left -= chunk;
+            }
+            // the string may have changed since we measured it.
+            *ea_kva(ea, ea->sp + len - 1) = '\0';
+            ea_count(ea, env);
+        }
+        uvec += n * sizeof(uint64);
+    }
+    return 0;
+}
+
+static void ea_putptr(struct exec_args *ea, uint64 va, uint64 ptr) {
+    *(uint64 *)ea_kva(ea, va) = ptr;
+}
+
+// The user address of the string after the one at va.
+static uint64 ea_next_string(struct exec_args *ea, uint64 va) {
+    while (*ea_kva(ea, va) != '\0')
+        va++;
+    return va + 1;
+}
+
+// Lay out the argv and envp arrays below the strings, as __start_main(argc, argv, envp) expects them,
+// and move ea->sp to the 16-byte aligned initial sp.
+static int ea_finish(struct exec_args *ea, uint64 *argv, uint64 *envp) {
+    uint64 strings = ea->sp;
+    uint64 base    = (strings & ~7) - (ea->argc + 1 + ea->envc + 1) * sizeof(uint64);
+    int ret;
+
+    if ((ret = ea_reserve(ea, strings - (base & ~15))) < 0)
+        return ret;
+    *argv = base;
+    *envp = base + (ea->argc + 1) * sizeof(uint64);
+
+    // upwards from the lowest string: envp[envc - 1] ... envp[0], then argv[argc - 1] ... argv[0].
+    uint64 va = strings;
+    for (int i = ea->envc - 1; i >= 0; i--, va = ea_next_string(ea, va))
+        ea_putptr(ea, *envp + i * sizeof(uint64), va);
+    for (int i = ea->argc - 1; i >= 0; i--, va = ea_next_string(ea, va))
+        ea_putptr(ea, *argv + i * sizeof(uint64), va);
+    ea_putptr(ea, *envp + ea->envc * sizeof(uint64), 0);
+    ea_putptr(ea, *argv + ea->argc * sizeof(uint64), 0);
+    return 0;
+}
+
+/**
+ * Try to load the user program into the process.
+ * Called without p->lock: building the new mm takes sleeping locks.
+ *
+ * The argument pages of ea become the top of the new user stack.
+ * If succeed, the process's mm is freed and set to a new struct mm, and ea is emptied.
+ * Otherwise, the process's mm is unchanged, and the caller still frees ea.
+ */
+int load_user_elf(struct user_app *app, struct proc *p, struct exec_args *ea) {
+    if (p == NULL || p->state == UNUSED)
+        panic("...");
+
+    uint64 uargv, uenvp;
+    int ret;
+    if ((ret = ea_finish(ea, &uargv, &uenvp)) < 0)
+        return ret;
+
+    // create a new mm for the process
+    struct mm *new_mm = mm_create(p->trapframe);
+    if (new_mm == NULL) {
+        errorf("mm_create");
+        return -ENOMEM;
+    }
+
+    struct vma* vma_brk;
+    uint64 brk;
+    ret = -ENOMEM;
+
+    if (template_clone(app, new_mm, &brk) < 0) {
+        // out of memory: drop the templates, and build the address space the slow way.
+        template_shrink();
+        if ((ret = setup_mm(app, new_mm, &brk)) < 0)
+            goto bad;
+    }
+    vma_brk = mm_find_vma(new_mm, brk);
+    assert(vma_brk != NULL && vma_brk->vm_end == brk);
+    new_mm->vma_brk = vma_brk;
+    new_mm->brk     = brk;
+    new_mm->app     = app->name;
+
+    // from here, we are done with all page allocation.
+    // swap the argument pages in, for the (zeroed, maybe shared) top pages of the stack.
+    for (int i = 0; i < ea->npages; i++) {
+        pte_t *pte = walk(new_mm, USTACK_START - (i + 1) * PGSIZE, false);
+        assert(pte != NULL && (*pte & PTE_V));
+        uint64 old = PTE2PA(*pte);
+        *pte       = PA2PTE(ea->pages[i]) | PTE_R | PTE_W | PTE_U | PTE_V | PTE_A | PTE_D;
+        kfreepage((void *)old);
+        ea->pages[i] = NULL;
+    }
+    ea->npages = 0;
+    sfence_vma();
+    up_write(&new_mm->lock);
+
     // we can modify p's fields because we will return to the new exec-ed process.
-    p->mm      = new_mm;
-    p->vma_brk = vma_brk;
-    p->brk     = brk;
+    acquire(&p->lock);
+    struct mm *old_mm = p->mm;
+    p->mm = new_mm;
     // setup trapframe
-    p->trapframe->sp  = sp;
-    p->trapframe->epc = ehdr->e_entry;
-    p->trapframe->a0  = argc;
-    p->trapframe->a1  = uargv_ptr;
+    p->trapframe->sp  = ea->sp;
+    p->trapframe->epc = app->entry;
+    p->trapframe->a0  = ea->argc;
+    p->trapframe->a1  = uargv;
+    p->trapframe->a2  = uenvp;
+    release(&p->lock);
 
+    // drop the old mm. for the first process, p->mm = NULL.
+    // a vfork child only drops its reference to the parent's mm.
+    if (old_mm)
+        mm_put(old_mm);
     return 0;
 
     // otherwise, page allocations fails. we will return to the old process.
@@ -212,11 +481,14 @@ int load_init_app() {
         panic("allocproc");
     }
     infof("load init proc %s", INIT_PROC);
+    release(&p->lock);
 
-    char *argv[] = {NULL};
-    if (load_user_elf(app, p, argv) < 0) {
+    struct exec_args ea;
+    exec_args_init(&ea);
+    if (load_user_elf(app, p, &ea) < 0) {
         panic("fail to load init elf.");
     }
+    acquire(&p->lock);
     p->state          = RUNNABLE;
     add_task(p);
     init_proc = p;
@@ -7,18 +7,64 @@
 void loader_init();
 int load_init_app();
 struct user_app *get_elf(char *name);
-int load_user_elf(struct user_app *, struct proc *, char *args[]);
 
 #define USTACK_START 0xffff0000
 #define USTACK_SIZE (PGSIZE * 8)
+// max size of argv + envp, strings and pointers, in pages. Must be less than USTACK_SIZE.
+#define EXEC_ARG_PAGES 4
+
+// The arguments of a new program.
+// The strings are copied once, straight into the pages that become the top of its user stack:
+// pages[i] is mapped at USTACK_START - (i + 1) * PGSIZE.
+// argv strings are pushed first, then envp strings, both downwards from USTACK_START.
+struct exec_args {
+    void *__pa pages[EXEC_ARG_PAGES];
+    int npages;
+    uint64 sp;  // user address of the lowest byte in use
+    int argc;
+    int envc;
+};
+
+void exec_args_init(struct exec_args *ea);
+int exec_args_copy(struct exec_args *ea, uint64 __user uvec, int env);
+int exec_args_push(struct exec_args *ea, const char *s, int env);
+void exec_args_free(struct exec_args *ea);
+
+int load_user_elf(struct user_app *, struct proc *, struct exec_args *ea);
+
+// The app table is generated by scripts/pack.py into link_app.S,
+// keep the layouts in sync with it.
+#define APP_MAX_SEGS 4
+
+// A PT_LOAD segment of an app.
+struct app_seg
+{
+    uint64 vaddr;
+    uint64 memsz;
+    uint64 filesz;
+    uint64 offset;
+    uint64 flags;   // PF_R, PF_W, PF_X
+};
 
 struct user_app
 {
     char *name;
     uint64 elf_address;
     uint64 elf_length;
+    uint64 name_len;
+    uint64 hash;    // app_name_hash(name), with user_apps_hash_seed
+    uint64 entry;
+    uint64 nsegs;
+    struct app_seg segs[APP_MAX_SEGS];
 };
 
+// sorted by name, terminated by an entry with name == NULL.
 extern struct user_app user_apps[];
 
+// A perfect hash table: user_apps_hash[hash & user_apps_hash_mask] is
+// the index of the app in user_apps plus one, or 0 if no app hashes there.
+extern uint64 user_apps_hash_seed;
+extern uint64 user_apps_hash_mask;
+extern uint16 user_apps_hash[];
+
 #endif // LOADER_H
\ No newline at end of file
@@ -1,13 +1,16 @@
 #include "lock.h"
 
 #include "defs.h"
+#include "lockstat.h"
 
 void spinlock_init(spinlock_t *lk, char *name)
 {
 	memset(lk, 0, sizeof(*lk));
 	lk->name = name;
-	lk->locked = 0;
 	lk->cpu = 0;
+#ifdef LOCKSTAT
+	lk->class = lockstat_class(name);
+#endif
 }
 
 // Acquire the lock.
@@ -19,22 +22,57 @@ void acquire(spinlock_t *lk)
 	if (holding(lk))
 		panic("already acquired by %p, now %p", lk->where, ra);
 
-	// On RISC-V, sync_lock_test_and_set turns into an atomic swap:
-	//   a5 = 1
-	//   s1 = &lk->locked
-	//   amoswap.w.aq a5, a5, (s1)
-	while (__sync_lock_test_and_set(&lk->locked, 1) != 0)
-		;
+#ifdef LOCKSTAT
+	uint64 start = lk->class ? r_time() : 0;
+#endif
+	// Take a ticket, on RISC-V: amoadd.w
+	uint32 ticket = __atomic_fetch_add(&lk->next, 1, __ATOMIC_RELAXED);
+#ifdef LOCKSTAT
+	int contended = __atomic_load_n(&lk->owner, __ATOMIC_RELAXED) != ticket;
+#endif
 
-	// Tell the C compiler and the processor to not move loads or stores
-	// past this point, to ensure that the critical section's memory
-	// references happen strictly after the lock is acquired.
-	// On RISC-V, this emits a fence instruction.
-	__sync_synchronize();
+	// Wait for our turn with plain loads, the cache line stays shared
+	// until the holder writes owner. The acquire load keeps the critical
+	// section's memory references strictly after the lock is acquired.
+	while (__atomic_load_n(&lk->owner, __ATOMIC_ACQUIRE) != ticket)
+		cpu_relax();
 
 	// Record info about lock acquisition for holding() and debugging.
 	lk->cpu = mycpu();
 	lk->where = (void *)ra;
+#ifdef LOCKSTAT
+	if (lk->class) {
+		lk->acquired_at = r_time();
+		lockstat_acquired(lk->class, start, contended);
+	}
+#endif
+}
+
+// Acquire the lock if it is free, without waiting.
+// Return 1 if it was acquired.
+int try_acquire(spinlock_t *lk)
+{
+	uint64 ra = r_ra();
+	push_off();
+	if (holding(lk))
+		panic("already acquired by %p, now %p", lk->where, ra);
+
+	// the lock is free when owner == next: take the ticket only in that case.
+	uint32 ticket = __atomic_load_n(&lk->owner, __ATOMIC_RELAXED);
+	if (!__atomic_compare_exchange_n(&lk->next, &ticket, ticket + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		pop_off();
+		return 0;
+	}
+
+	lk->cpu = mycpu();
+	lk->where = (void *)ra;
+#ifdef LOCKSTAT
+	if (lk->class) {
+		lk->acquired_at = r_time();
+		lockstat_acquired(lk->class, lk->acquired_at, 0);
+	}
+#endif
+	return 1;
 }
 
 // Release the lock.
@@ -43,25 +81,17 @@ void release(spinlock_t *lk)
 	if (!holding(lk))
 		panic("release");
 
+#ifdef LOCKSTAT
+	if (lk->class)
+		lockstat_released(lk->class, lk->acquired_at);
+#endif
 	lk->cpu = 0;
 	lk->where = 0;
 
-	// Tell the C compiler and the CPU to not move loads or stores
-	// past this point, to ensure that all the stores in the critical
-	// section are visible to other CPUs before the lock is released,
-	// and that loads in the critical section occur strictly before
-	// the lock is released.
-	// On RISC-V, this emits a fence instruction.
-	__sync_synchronize();
-
-	// Release the lock, equivalent to lk->locked = 0.
-	// This code doesn't use a C assignment, since the C standard
-	// implies that an assignment might be implemented with
-	// multiple store instructions.
-	// On RISC-V, sync_lock_release turns into an atomic swap:
-	//   s1 = &lk->locked
-	//   amoswap.w zero, zero, (s1)
-	__sync_lock_release(&lk->locked);
+	// Serve the next ticket. The release store makes all the stores in the
+	// critical section visible before the lock is handed over (fence rw,w).
+	// Only the holder writes owner, so a load and a store are enough.
+	__atomic_store_n(&lk->owner, lk->owner + 1, __ATOMIC_RELEASE);
 
 	pop_off();
 }
@@ -70,14 +100,101 @@ void release(spinlock_t *lk)
 // Interrupts must be off.
 int holding(spinlock_t *lk)
 {
-	int r;
-	r = (lk->locked && lk->cpu == mycpu());
-	return r;
+	// only the holder sets cpu to itself, and clears it before releasing.
+	return lk->cpu == mycpu();
+}
+
+void mcslock_init(struct mcslock *lk, char *name)
+{
+	memset(lk, 0, sizeof(*lk));
+	lk->name = name;
+#ifdef LOCKSTAT
+	lk->class = lockstat_class(name);
+#endif
+}
+
+void mcs_acquire(struct mcslock *lk)
+{
+	uint64 ra = r_ra();
+	push_off();
+	if (mcs_holding(lk))
+		panic("already acquired by %p, now %p", lk->where, ra);
+
+	struct cpu *c = mycpu();
+	if (c->mcs_used == (1u << MCS_NODES) - 1)
+		panic("mcs_acquire: too many nested MCS locks");
+	int i = __builtin_ctz(~c->mcs_used);
+	c->mcs_used |= 1u << i;
+	struct mcs_node *node = &c->mcs_nodes[i];
+	node->next = NULL;
+	node->locked = 0;
+
+#ifdef LOCKSTAT
+	uint64 start = lk->class ? r_time() : 0;
+#endif
+	// Queue up: amoswap.d.aqrl
+	struct mcs_node *prev = __atomic_exchange_n(&lk->tail, node, __ATOMIC_ACQ_REL);
+	if (prev != NULL) {
+		__atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+		// spin on our own node until prev hands the lock over.
+		while (!__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE))
+			cpu_relax();
+	}
+
+	lk->owner = node;
+	lk->cpu = c;
+	lk->where = (void *)ra;
+#ifdef LOCKSTAT
+	if (lk->class) {
+		lk->acquired_at = r_time();
+		lockstat_acquired(lk->class, start, prev != NULL);
+	}
+#endif
+}
+
+void mcs_release(struct mcslock *lk)
+{
+	if (!mcs_holding(lk))
+		panic("mcs_release");
+
+#ifdef LOCKSTAT
+	if (lk->class)
+		lockstat_released(lk->class, lk->acquired_at);
+#endif
+	struct mcs_node *node = lk->owner;
+	lk->cpu = 0;
+	lk->where = 0;
+	lk->owner = NULL;
+
+	struct mcs_node *next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+	if (next == NULL) {
+		// no waiter: free the lock, unless one is queueing right now.
+		struct mcs_node *expected = node;
+		if (__atomic_compare_exchange_n(&lk->tail, &expected, NULL, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			goto out;
+		// it has swapped tail already, wait for it to link itself.
+		while ((next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)) == NULL)
+			cpu_relax();
+	}
+	__atomic_store_n(&next->locked, 1, __ATOMIC_RELEASE);
+
+out:
+	mycpu()->mcs_used &= ~(1u << (node - mycpu()->mcs_nodes));
+	pop_off();
+}
+
+// Check whether this cpu is holding the lock.
+// Interrupts must be off.
+int mcs_holding(struct mcslock *lk)
+{
+	return lk->cpu == mycpu();
 }
 
 // push_off/pop_off are like intr_off()/intr_on() except that they are matched:
 // it takes two pop_off()s to undo two push_off()s.  Also, if interrupts
 // are initially off, then push_off, pop_off leaves them off.
+// They also count as preemption off: the last pop_off() is where a process asked to
+// reschedule meanwhile, by an IPI or a wakeup, is preempted, see preempt_schedule().
 
 void push_off(void)
 {
@@ -107,43 +224,194 @@ void pop_off(void)
 		if (c->inkernel_trap)
 			panic("pop_off->intr_on happens in kernel trap");
 		intr_on();
+		if (need_resched())
+			preempt_schedule();
+	}
+}
+
+// Keep the current process on this cpu, with interrupts on. Nests like push_off().
+void preempt_disable(void)
+{
+	push_off();
+	mycpu()->preempt_count++;
+	pop_off();
+}
+
+void preempt_enable(void)
+{
+	push_off();
+	if (mycpu()->preempt_count < 1)
+		panic("preempt_enable - unpair");
+	mycpu()->preempt_count--;
+	pop_off();
+}
+
+// Sleep on chan, releasing lk, the only lock we hold.
+static void lock_sleep(void *chan, spinlock_t *lk, char *name)
+{
+	if (curr_proc() == NULL || mycpu()->noff != 1)
+		panic("%s: would sleep outside of process context, or with a spinlock held", name);
+	sleep(chan, lk);
+}
+
+void mutex_init(struct mutex *m, char *name)
+{
+	memset(m, 0, sizeof(*m));
+	spinlock_init(&m->wait_lock, "mutex-wait");
+	m->name = name;
+}
+
+void mutex_lock(struct mutex *m)
+{
+	struct proc *p = curr_proc();
+	if (p != NULL && mutex_held(m))
+		panic("mutex_lock: %s already held", m->name);
+
+	// spin while the owner is making progress on another cpu.
+	for (int spins = 0;; spins++) {
+		if (__atomic_load_n(&m->locked, __ATOMIC_RELAXED) == 0 &&
+		    __atomic_exchange_n(&m->locked, 1, __ATOMIC_ACQUIRE) == 0)
+			goto out;
+		struct proc *owner = __atomic_load_n(&m->owner, __ATOMIC_RELAXED);
+		if (spins >= MUTEX_SPIN || owner == NULL || owner->state != RUNNING)
+			break;
+		cpu_relax();
+	}
+
+	// then sleep. waiters is raised before we try again, and mutex_unlock clears locked before
+	// it reads waiters (both seq_cst), so either we get the lock or it wakes us up.
+	acquire(&m->wait_lock);
+	__atomic_add_fetch(&m->waiters, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_exchange_n(&m->locked, 1, __ATOMIC_SEQ_CST) != 0)
+		lock_sleep(m, &m->wait_lock, m->name);
+	__atomic_sub_fetch(&m->waiters, 1, __ATOMIC_RELAXED);
+	release(&m->wait_lock);
+out:
+	m->owner = p;
+}
+
+// Return 1 if the mutex is now held by us, 0 if someone else holds it. Never sleeps.
+int mutex_trylock(struct mutex *m)
+{
+	if (__atomic_exchange_n(&m->locked, 1, __ATOMIC_ACQUIRE) != 0)
+		return 0;
+	m->owner = curr_proc();
+	return 1;
+}
+
+void mutex_unlock(struct mutex *m)
+{
+	if (!mutex_held(m))
+		panic("mutex_unlock: %s", m->name);
+
+	m->owner = NULL;
+	__atomic_store_n(&m->locked, 0, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&m->waiters, __ATOMIC_SEQ_CST) != 0) {
+		acquire(&m->wait_lock);
+		wakeup(m);
+		release(&m->wait_lock);
+	}
+}
+
+int mutex_held(struct mutex *m)
+{
+	return m->locked && m->owner == curr_proc();
+}
+
+void rwsem_init(struct rwsem *s, char *name)
+{
+	memset(s, 0, sizeof(*s));
+	spinlock_init(&s->lock, "rwsem");
+	s->name = name;
+}
+
+void down_read(struct rwsem *s)
+{
+	acquire(&s->lock);
+	while (s->writer || s->writers_waiting) {
+		s->sleepers++;
+		lock_sleep(s, &s->lock, s->name);
+		s->sleepers--;
+	}
+	s->readers++;
+	release(&s->lock);
+}
+
+// Return 1 if the semaphore is now held for reading, 0 if it is busy. Never sleeps.
+int down_read_trylock(struct rwsem *s)
+{
+	int ok = 0;
+
+	acquire(&s->lock);
+	if (!s->writer && !s->writers_waiting) {
+		s->readers++;
+		ok = 1;
+	}
+	release(&s->lock);
+	return ok;
+}
+
+void up_read(struct rwsem *s)
+{
+	acquire(&s->lock);
+	if (s->readers <= 0)
+		panic("up_read: %s", s->name);
+	if (--s->readers == 0 && s->sleepers)
+		wakeup(s);
+	release(&s->lock);
+}
+
+void down_write(struct rwsem *s)
+{
+	acquire(&s->lock);
+	if (s->writer && s->owner == curr_proc())
+		panic("down_write: %s already held", s->name);
+	s->writers_waiting++;
+	while (s->writer || s->readers) {
+		s->sleepers++;
+		lock_sleep(s, &s->lock, s->name);
+		s->sleepers--;
 	}
+	s->writers_waiting--;
+	s->writer = 1;
+	s->owner = curr_proc();
+	release(&s->lock);
 }
 
-// void initsleeplock(struct sleeplock *lk, char *name)
-// {
-// 	spinlock_init(&lk->lk, "sleep lock");
-// 	lk->name = name;
-// 	lk->locked = 0;
-// 	lk->pid = 0;
-// }
-
-// void acquiresleep(struct sleeplock *lk)
-// {
-// 	acquire(&lk->lk);
-// 	while (lk->locked) {
-// 		sleep(lk, &lk->lk);
-// 	}
-// 	lk->locked = 1;
-// 	lk->pid = myproc()->pid;
-// 	release(&lk->lk);
-// }
-
-// void releasesleep(struct sleeplock *lk)
-// {
-// 	acquire(&lk->lk);
-// 	lk->locked = 0;
-// 	lk->pid = 0;
-// 	wakeup(lk);
-// 	release(&lk->lk);
-// }
-
-// int holdingsleep(struct sleeplock *lk)
-// {
-// 	int r;
-
-// 	acquire(&lk->lk);
-// 	r = lk->locked && (lk->pid == myproc()->pid);
-// 	release(&lk->lk);
-// 	return r;
-// }
+// Return 1 if the semaphore is now held for writing by us, 0 if it is busy. Never sleeps.
+int down_write_trylock(struct rwsem *s)
+{
+	int ok = 0;
+
+	acquire(&s->lock);
+	if (!s->writer && !s->readers) {
+		s->writer = 1;
+		s->owner = curr_proc();
+		ok = 1;
+	}
+	release(&s->lock);
+	return ok;
+}
+
+void up_write(struct rwsem *s)
+{
+	acquire(&s->lock);
+	if (!rwsem_held_write(s))
+		panic("up_write: %s", s->name);
+	s->writer = 0;
+	s->owner = NULL;
+	if (s->sleepers)
+		wakeup(s);
+	release(&s->lock);
+}
+
+// Whether it is held for reading (by anyone, readers are not tracked), or for writing by us.
+int rwsem_held(struct rwsem *s)
+{
+	return s->readers > 0 || rwsem_held_write(s);
+}
+
+int rwsem_held_write(struct rwsem *s)
+{
+	return s->writer && s->owner == curr_proc();
+}
@@ -3,34 +3,112 @@
 
 #include "types.h"
 
-// Mutual exclusion lock.
+// Mutual exclusion lock, a ticket lock.
+// A hart takes a ticket with one atomic add, then waits for its turn by reading `owner` only,
+// so waiters are served in FIFO order and do not write to the lock while spinning.
 struct spinlock {
-    uint64 locked;  // Is the lock held?, use AMO instructions to access this field.
+    uint32 next;   // the next ticket to hand out
+    uint32 owner;  // the ticket being served, the lock is held while owner != next
 
     // For debugging:
     char *name;       // Name of lock.
     struct cpu *cpu;  // The cpu holding the lock.
     void *where;      // who calls acquire?
+
+#ifdef LOCKSTAT
+    struct lock_class *class;
+    uint64 acquired_at;
+#endif
 };
 
-// Long-term locks for processes
-struct sleeplock {
-    uint locked;         // Is the lock held?
-    struct spinlock lk;  // spinlock protecting this sleep lock
+// Sleeping locks, for long critical sections: interrupts stay on while they are held.
+// They are taken in process context, without any spinlock held, since a waiter may sleep.
+// Uncontended, they never sleep, so boot code may use them before the first process runs.
+
+// Adaptive mutex: a waiter spins while the holder is running on another cpu,
+// at most MUTEX_SPIN times, then sleeps.
+#define MUTEX_SPIN 1000
+
+struct mutex {
+    uint32 locked;
+    uint32 waiters;             // how many are in the sleeping path of mutex_lock
+    struct proc *owner;         // NULL before the first process
+    struct spinlock wait_lock;  // serializes sleeping waiters with mutex_unlock
+
+    char *name;
+};
+
+// Reader-writer semaphore: any number of readers, or one writer.
+// A waiting writer holds off new readers, so writers do not starve.
+struct rwsem {
+    struct spinlock lock;  // protects the fields below
+    int readers;           // readers holding it
+    int writer;            // held by a writer
+    int writers_waiting;
+    int sleepers;
+    struct proc *owner;    // the writer
+
+    char *name;
+};
+
+// MCS queued lock, for the hottest locks.
+// Each waiter spins on its own node (one per nesting level per cpu, in struct cpu),
+// and the releasing hart hands the lock to the next node directly,
+// so contention costs one cache line transfer per hand-over, however many harts wait.
+// It cannot be used with sleep().
+#define MCS_NODES 4  // how many MCS locks a cpu may hold at once
+
+struct mcs_node {
+    struct mcs_node *next;
+    uint32 locked;  // set by the previous holder when it hands the lock over
+};
+
+struct mcslock {
+    struct mcs_node *tail;   // the last waiter, NULL if the lock is free
+    struct mcs_node *owner;  // node of the holder
 
     // For debugging:
-    char *name;  // Name of lock.
-    int pid;     // Process holding lock
+    char *name;
+    struct cpu *cpu;
+    void *where;
+
+#ifdef LOCKSTAT
+    struct lock_class *class;
+    uint64 acquired_at;
+#endif
 };
 
 typedef struct spinlock spinlock_t;
-typedef struct sleeplock sleeplock_t;
+typedef struct mcslock mcslock_t;
+typedef struct mutex mutex_t;
+typedef struct rwsem rwsem_t;
 
 void spinlock_init(struct spinlock *lk, char *name);
 void acquire(struct spinlock *lk);
+int try_acquire(struct spinlock *lk);
 void release(struct spinlock *lk);
 int holding(struct spinlock *lk);
+void mcslock_init(struct mcslock *lk, char *name);
+void mcs_acquire(struct mcslock *lk);
+void mcs_release(struct mcslock *lk);
+int mcs_holding(struct mcslock *lk);
+void mutex_init(struct mutex *m, char *name);
+void mutex_lock(struct mutex *m);
+int mutex_trylock(struct mutex *m);
+void mutex_unlock(struct mutex *m);
+int mutex_held(struct mutex *m);
+void rwsem_init(struct rwsem *s, char *name);
+void down_read(struct rwsem *s);
+int down_read_trylock(struct rwsem *s);
+void up_read(struct rwsem *s);
+void down_write(struct rwsem *s);
+int down_write_trylock(struct rwsem *s);
+void up_write(struct rwsem *s);
+int rwsem_held(struct rwsem *s);
+int rwsem_held_write(struct rwsem *s);
 void push_off(void);
 void pop_off(void);
+void preempt_disable(void);
+void preempt_enable(void);
 
 #endif  //  __LOCK_H__
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include "lockstat.h"
+
+#include "defs.h"
+#include "ktest/ktest.h"
+
+static struct lock_class classes[NLOCKCLASS];
+static int nclass;
+static spinlock_t class_lock;  // all-zero: usable before any init, and without a class itself
+
+// Find or create the class of the locks named name. Return NULL when the table is full.
+struct lock_class *lockstat_class(char *name) {
+    struct lock_class *class = NULL;
+
+    if (name == NULL)
+        return NULL;
+    acquire(&class_lock);
+    for (int i = 0; i < nclass; i++) {
+        if (strncmp(classes[i].name, name, KSTRING_MAX) == 0) {
+            class = &classes[i];
+            break;
+        }
+    }
+    if (class == NULL && nclass < NLOCKCLASS) {
+        class       = &classes[nclass++];
+        class->name = name;
+    }
+    release(&class_lock);
+    return class;
+}
+
+// Called with the lock held, and interrupts off: this cpu's stat is ours.
+void lockstat_acquired(struct lock_class *class, uint64 start, int contended) {
+    struct lock_cpustat *st = &class->stat[mycpu()->cpuid];
+    st->acquisitions++;
+    if (contended) {
+        uint64 spin = r_time() - start;
+        st->contended++;
+        st->spin_total += spin;
+        st->spin_max = MAX(st->spin_max, spin);
+    }
+}
+
+void lockstat_released(struct lock_class *class, uint64 acquired_at) {
+    struct lock_cpustat *st = &class->stat[mycpu()->cpuid];
+    uint64 hold             = r_time() - acquired_at;
+    st->hold_total += hold;
+    st->hold_max = MAX(st->hold_max, hold);
+}
+
+// Sum up the per-cpu statistics of the i-th class. Return -1 if there is no such class.
+// They are read without locking, so they may be slightly off.
+int lockstat_get(int i, struct lockstat_entry *e) {
+    if (i < 0 || i >= nclass)
+        return -1;
+    memset(e, 0, sizeof(*e));
+    safestrcpy(e->name, classes[i].name, sizeof(e->name));
+    for (int c = 0; c < NCPU; c++) {
+        struct lock_cpustat *st = &classes[i].stat[c];
+        e->acquisitions += st->acquisitions;
+        e->contended += st->contended;
+        e->spin_total += st->spin_total;
+        e->spin_max = MAX(e->spin_max, st->spin_max);
+        e->hold_total += st->hold_total;
+        e->hold_max = MAX(e->hold_max, st->hold_max);
+    }
+    return 0;
+}
+
+void lockstat_reset() {
+    for (int i = 0; i < nclass; i++)
+        memset(classes[i].stat, 0, sizeof(classes[i].stat));
+}
+
+// Ctrl-L on the console.
+void print_lockstat() {
+#ifdef LOCKSTAT
+    struct lockstat_entry e;
+    printf("lockstat, in time ticks:\n");
+    for (int i = 0; lockstat_get(i, &e) == 0; i++) {
+        printf("  %s: acquired %l, contended %l, spin %l (max %l), hold %l (max %l)\n",
+               e.name, e.acquisitions, e.contended, e.spin_total, e.spin_max, e.hold_total, e.hold_max);
+    }
+#else
+    printf("lockstat: build the kernel with LOCKSTAT=y\n");
+#endif
+}
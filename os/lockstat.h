@@ -0,0 +1,34 @@
+#ifndef LOCKSTAT_H
+#define LOCKSTAT_H
+
+#include "defs.h"
+
+// Lock statistics, when the kernel is built with LOCKSTAT=y.
+// Locks initialized with the same name form a class (e.g. all the "proc" locks),
+// and the statistics are kept per class, per cpu, in `time` CSR ticks.
+
+#define NLOCKCLASS 32
+
+struct lock_cpustat {
+    uint64 acquisitions;
+    uint64 contended;   // acquisitions that had to wait
+    uint64 spin_total;  // time spent waiting
+    uint64 spin_max;
+    uint64 hold_total;  // time between acquire and release
+    uint64 hold_max;
+};
+
+struct lock_class {
+    char *name;
+    struct lock_cpustat stat[NCPU];
+};
+
+struct lock_class *lockstat_class(char *name);
+void lockstat_acquired(struct lock_class *class, uint64 start, int contended);
+void lockstat_released(struct lock_class *class, uint64 acquired_at);
+struct lockstat_entry;
+int lockstat_get(int i, struct lockstat_entry *e);
+void lockstat_reset();
+void print_lockstat();
+
+#endif  // LOCKSTAT_H
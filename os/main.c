@@ -1,12 +1,15 @@
 #include "console.h"
 #include "debug.h"
 #include "defs.h"
+#include "fdt.h"
 #include "kalloc.h"
 #include "loader.h"
 #include "plic.h"
 #include "proc.h"
 #include "sbi.h"
+#include "syscall.h"
 #include "timer.h"
+#include "workqueue.h"
 
 uint64 __pa kernel_image_end_4k;
 uint64 __pa kernel_image_end_2M;
@@ -81,10 +84,13 @@ allocator_t kstrbuf;
  * -------------                                    -------------
  */
 
-void bootcpu_entry(int mhartid) {
+void bootcpu_entry(int mhartid, uint64 dtb) {
     printf("\n\n=====\nHello World!\n=====\n\nBoot stack: %p\nclean bss: %p - %p\n", boot_stack, s_bss, e_bss);
     memset(s_bss, 0, e_bss - s_bss);
 
+    // The DTB may not be mapped after relocation, read what we need from it now.
+    fdt_scan_isa(dtb);
+
     uint64 vendor = sbi_get_mvendorid();
     uint64 impl = sbi_get_mimpid();
     if (vendor == 0x489 && impl == 0x4210427) {
@@ -198,6 +204,7 @@ static void bootcpu_init() {
             cpuid++;
         }
         printf("System has %d cpus online\n\n", cpuid);
+        nr_cpus = cpuid;
     }
 #endif
 
@@ -209,13 +216,19 @@ static void bootcpu_init() {
     trap_init();
     console_init();
     printf("UART inited.\n");
+    string_init();
+    infof("isa extensions: %p, cbo.zero block size: %d", isa_extensions, fdt_cboz_block_size);
     plicinit();
     kpgmgrinit();
     uvm_init();
     proc_init();
+    futex_init();
+    sysstat_init();
+    profile_init();
     allocator_init(&kstrbuf, "kstrbuf", KSTRING_MAX, 4096);
     loader_init();
     load_init_app();
+    workqueue_init();
 
     timer_init();
     plicinithart();
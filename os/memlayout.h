@@ -69,6 +69,8 @@
 #define USER_TOP   (MAXVA)
 #define TRAMPOLINE (USER_TOP - PGSIZE)
 #define TRAPFRAME  (TRAMPOLINE - PGSIZE)
+// A process running on a borrowed mm (vfork) maps its trapframe below, at a slot of its own.
+#define TRAPFRAME_SLOT(index) (TRAPFRAME - (1 + (uint64)(index)) * PGSIZE)
 #define MAX_USERVA (TRAPFRAME - 1)
 
 
@@ -42,6 +42,17 @@ static void printint(int xx, int base, int sign) {
     while (--i >= 0) consputc(buf[i]);
 }
 
+static void printulong(uint64 x) {
+    char buf[24];
+    int i = 0;
+
+    do {
+        buf[i++] = digits[x % 10];
+    } while ((x /= 10) != 0);
+
+    while (--i >= 0) consputc(buf[i]);
+}
+
 static void printptr(uint64 x) {
     int i;
     consputc('0');
@@ -49,7 +60,7 @@ static void printptr(uint64 x) {
     for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4) consputc(digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
-// Print to the console. only understands %d, %x, %p, %s.
+// Print to the console. only understands %d, %l (uint64), %x, %p, %s.
 static void vprintf(char *fmt, va_list ap) {
     int i, c;
     char *s;
@@ -76,6 +87,9 @@ static void vprintf(char *fmt, va_list ap) {
             case 'd':
                 printint(va_arg(ap, int), 10, 1);
                 break;
+            case 'l':
+                printulong(va_arg(ap, uint64));
+                break;
             case 'x':
                 printint(va_arg(ap, int), 16, 1);
                 break;
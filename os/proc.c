@@ -1,9 +1,12 @@
 #include "proc.h"
 
 #include "defs.h"
+#include "futex.h"
 #include "kalloc.h"
 #include "loader.h"
 #include "queue.h"
+#include "spawn.h"
+#include "syscall.h"
 #include "trap.h"
 
 struct proc *pool[NPROC];
@@ -13,6 +16,11 @@ static allocator_t proc_allocator;
 static spinlock_t pid_lock;
 static spinlock_t wait_lock;
 
+// pid -> proc, for find_proc. Updated under pid_lock, traversed without locks.
+#define PIDHASH_SIZE 128
+static struct proc *pid_hash[PIDHASH_SIZE];
+#define PIDHASH(pid) ((pid) & (PIDHASH_SIZE - 1))
+
 extern void sched_init();
 
 // initialize the proc table at boot time.
@@ -24,6 +32,7 @@ void proc_init() {
 
     spinlock_init(&pid_lock, "pid");
     spinlock_init(&wait_lock, "wait");
+    rcu_init();
 
     allocator_init(&proc_allocator, "proc", sizeof(struct proc), NPROC);
     struct proc *p;
@@ -57,23 +66,74 @@ void proc_init() {
     sched_init();
 }
 
-static int allocpid() {
+// Give p a new pid, and make it visible to find_proc.
+static void allocpid(struct proc *p) {
     static int PID = 1;
-    int retpid     = -1;
 
     acquire(&pid_lock);
-    retpid = PID++;
+    p->pid      = PID++;
+    p->pid_next = pid_hash[PIDHASH(p->pid)];
+    rcu_assign_pointer(pid_hash[PIDHASH(p->pid)], p);
+    release(&pid_lock);
+}
+
+// Unlink p from the pid hash. p->pid_next is left alone, for the readers standing on p.
+static void freepid(struct proc *p) {
+    acquire(&pid_lock);
+    struct proc **pp = &pid_hash[PIDHASH(p->pid)];
+    while (*pp != p)
+        pp = &(*pp)->pid_next;
+    rcu_assign_pointer(*pp, p->pid_next);
     release(&pid_lock);
+}
 
-    return retpid;
+// Find the live proc with the given pid, without any lock.
+// Must be called in an RCU read-side section, the proc stays valid until its end.
+// Take p->lock and check the state again to act on it.
+struct proc *find_proc(int pid) {
+    for (struct proc *p = rcu_dereference(pid_hash[PIDHASH(pid)]); p != NULL; p = rcu_dereference(p->pid_next)) {
+        if (p->pid == pid && __atomic_load_n(&p->state, __ATOMIC_RELAXED) != UNUSED)
+            return p;
+    }
+    return NULL;
 }
+
 static void first_sched_ret(void) {
+    finish_switch();
     release(&curr_proc()->lock);
     assert(curr_proc()->state == RUNNING);
     intr_off();
     usertrapret();
 }
 
+static void kthread_start(void) {
+    finish_switch();
+    struct proc *p = curr_proc();
+    release(&p->lock);
+    intr_on();
+    p->kthread_fn(p->kthread_arg);
+    panic("kthread %s returned", p->kthread);
+}
+
+// Start a kernel thread running fn(arg), which never returns. It is scheduled like a process,
+// but has no mm: it only runs kernel code. With cpu >= 0, it only runs on that cpu.
+struct proc *kthread_create(char *name, void (*fn)(void *), void *arg, int cpu) {
+    struct proc *p = allocproc();
+
+    if (p == NULL)
+        return NULL;
+    p->kthread     = name;
+    p->kthread_fn  = fn;
+    p->kthread_arg = arg;
+    p->context.ra  = (uint64)kthread_start;
+    if (cpu >= 0)
+        sched_bind(p, cpu);
+    p->state = RUNNABLE;
+    add_task(p);
+    release(&p->lock);
+    return p;
+}
+
 // Look in the process table for an UNUSED proc.
 // If found, initialize state required to run in the kernel.
 // If there are no free procs, or a memory allocation fails, return 0.
@@ -82,7 +142,7 @@ struct proc *allocproc() {
     for (int i = 0; i < NPROC; i++) {
         p = pool[i];
         acquire(&p->lock);
-        if (p->state == UNUSED) {
+        if (p->state == UNUSED && !p->rcu_pending) {
             goto found;
         }
         release(&p->lock);
@@ -92,72 +152,105 @@ struct proc *allocproc() {
 found:
     // initialize a proc
     tracef("init proc %p", p);
-    p->parent     = NULL;
-    p->exit_code  = 0;
+    rcu_assign_pointer(p->parent, NULL);
+    p->vfork_parent = NULL;
+    p->trapframe_va = TRAPFRAME;
+    p->exit_code    = 0;
     p->sleep_chan = NULL;
-    p->pid        = allocpid();
     p->state      = USED;
+    p->kthread    = NULL;
+    p->sysstat    = NULL;
+    allocpid(p);
+
+    // a process of its own, clone() makes it a thread.
+    p->group_leader  = p;
+    p->tgid          = p->pid;
+    p->tg_live       = 1;
+    p->group_exiting = 0;
+    p->clear_tid     = 0;
 
     // fork or exec(load_user_elf) will initialize these:
-    p->mm      = NULL;
-    p->vma_brk = NULL;
+    p->mm = NULL;
 
     // prepare trapframe and the first return context.
     memset(&p->context, 0, sizeof(p->context));
-    memset((void *)p->kstack, 0, KERNEL_STACK_SIZE);
-    memset((void *)p->trapframe, 0, PGSIZE);
+    for (uint64 pg = p->kstack; pg < p->kstack + KERNEL_STACK_SIZE; pg += PGSIZE)
+        pagezero((void *)pg);
+    pagezero(p->trapframe);
     p->context.ra = (uint64)first_sched_ret;
     p->context.sp = p->kstack + KERNEL_STACK_SIZE;
 
     // Project signal: signal_init
     siginit(p);
+    fpu_reset(p);
+    sched_task_init(p);
 
     assert(holding(&p->lock));
 
     return p;
 }
 
+// The grace period after freeproc is over: nobody can see p any more.
+static void proc_reclaim(struct rcu_head *head) {
+    struct proc *p = (struct proc *)((char *)head - __builtin_offsetof(struct proc, rcu));
+
+    acquire(&p->lock);
+    p->pid         = -1;
+    p->rcu_pending = 0;
+    release(&p->lock);
+}
+
 static void freeproc(struct proc *p) {
     assert(holding(&p->lock));
 
-    p->state      = UNUSED;
-    p->pid        = -1;
+    // keep the pid until lockless readers are gone, allocproc skips p until then.
+    freepid(p);
+    sched_task_exit(p);
+    sysstat_free(p);
+    p->state       = UNUSED;
+    p->rcu_pending = 1;
+    call_rcu(&p->rcu, proc_reclaim);
+
     p->exit_code  = 0xdeadbeef;
     p->sleep_chan = NULL;
     p->killed     = 0;
-    p->parent     = NULL;
+    rcu_assign_pointer(p->parent, NULL);
 
     if (p->mm) {
-        assert(!holding(&p->mm->lock));
-        acquire(&p->mm->lock);
-        mm_free(p->mm);
+        assert(!rwsem_held_write(&p->mm->lock));
+        mm_put(p->mm);
     }
 
-    p->mm      = NULL;
-    p->vma_brk = NULL;
+    p->mm = NULL;
 }
 
 void sleep(void *chan, spinlock_t *lk) {
+    sleep_until(chan, lk, 0);
+}
+
+// Like sleep, but the timer also wakes us up once ticks reaches deadline, unless it is 0.
+void sleep_until(void *chan, spinlock_t *lk, uint64 deadline) {
     struct proc *p = curr_proc();
 
     // Must acquire p->lock in order to
     // change p->state and then call sched.
-    // Once we hold p->lock, we can be
-    // guaranteed that we won't miss any wakeup
-    // (wakeup locks p->lock),
-    // so it's okay to release lk.
+    // wakeup skips procs that do not look SLEEPING on chan without locking them,
+    // so we must look so before lk is released: then any wakeup
+    // that follows a change made under lk finds us.
 
     acquire(&p->lock);  // DOC: sleeplock1
-    release(lk);
 
     // Go to sleep.
-    p->sleep_chan = chan;
-    p->state      = SLEEPING;
+    p->sleep_deadline = deadline;
+    __atomic_store_n(&p->sleep_chan, chan, __ATOMIC_RELAXED);
+    __atomic_store_n(&p->state, SLEEPING, __ATOMIC_RELAXED);
+    release(lk);
 
     sched();
 
     // p get waking up, Tidy up.
-    p->sleep_chan = 0;
+    p->sleep_chan     = 0;
+    p->sleep_deadline = 0;
 
     // Reacquire original lock.
     release(&p->lock);
@@ -169,10 +262,28 @@ void sleep(void *chan, spinlock_t *lk) {
 void wakeup(void *chan) {
     for (int i = 0; i < NPROC; i++) {
         struct proc *p = pool[i];
+        // pool[] never changes. See sleep() for why the unlocked check is enough.
+        if (__atomic_load_n(&p->state, __ATOMIC_RELAXED) != SLEEPING ||
+            __atomic_load_n(&p->sleep_chan, __ATOMIC_RELAXED) != chan)
+            continue;
         acquire(&p->lock);
         if (p->state == SLEEPING && p->sleep_chan == chan) {
-            p->state = RUNNABLE;
-            add_task(p);
+            wake_task(p);
+        }
+        release(&p->lock);
+    }
+}
+
+// Wake up the processes whose sleep_until deadline is over. Called on every tick.
+void wakeup_expired(uint64 now) {
+    for (int i = 0; i < NPROC; i++) {
+        struct proc *p  = pool[i];
+        uint64 deadline = __atomic_load_n(&p->sleep_deadline, __ATOMIC_RELAXED);
+        if (deadline == 0 || deadline > now)
+            continue;
+        acquire(&p->lock);
+        if (p->state == SLEEPING && p->sleep_deadline != 0 && p->sleep_deadline <= now) {
+            wake_task(p);
         }
         release(&p->lock);
     }
@@ -185,39 +296,48 @@ int fork() {
     if (np == NULL) {
         return -ENOMEM;
     }
-    np->mm = mm_create(np->trapframe);
-    if (np->mm == NULL) {
-        freeproc(np);
-        release(&np->lock);
-        return -ENOMEM;
-    }
-
-    assert(holding(&np->lock));
+    // nobody looks at np until it is RUNNABLE, so copy the memory without np->lock:
+    // it takes the sleeping mm locks, and may take a while.
+    release(&np->lock);
 
     struct proc *p = curr_proc();
-    acquire(&p->lock);
-    acquire(&p->mm->lock);
+    struct mm *mm  = mm_create(np->trapframe);
+    if (mm == NULL) {
+        ret = -ENOMEM;
+        goto err_free;
+    }
 
     // Copy user memory from parent to child.
-    if ((ret = mm_copy(p->mm, np->mm)) < 0)
+    down_write(&p->mm->lock);
+    if ((ret = mm_copy(p->mm, mm)) == 0) {
+        // Set the child's vma_brk
+        mm->vma_brk = mm_find_vma(mm, p->mm->vma_brk->vm_start);
+        mm->brk     = p->mm->brk;
+        mm->app     = p->mm->app;
+    }
+    up_write(&p->mm->lock);
+    if (ret < 0) {
+        mm_free(mm);
         goto err_free;
-    // Set np's vma_brk
-    np->vma_brk = mm_find_vma(np->mm, p->vma_brk->vm_start);
-    np->brk     = p->brk;
+    }
+    up_write(&mm->lock);
 
-    release(&p->mm->lock);
-    release(&np->mm->lock);
+    acquire(&np->lock);
+    acquire(&p->lock);
+    np->mm = mm;
 
     // copy saved user registers.
     *(np->trapframe) = *(p->trapframe);
 
     // Project signal: fork
     siginit_fork(p, np);
+    fpu_copy(p, np);
+    sched_fork(p, np);
 
     // Cause fork to return 0 in the child.
     np->trapframe->a0 = 0;
-    np->parent        = p;
-    np->state         = RUNNABLE;
+    rcu_assign_pointer(np->parent, p->group_leader);
+    np->state = RUNNABLE;
     add_task(np);
     release(&np->lock);
     release(&p->lock);
@@ -225,23 +345,247 @@ int fork() {
     return np->pid;
 
 err_free:
-    release(&np->mm->lock);
-    release(&p->mm->lock);
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return ret;
+}
+
+// vfork: the child runs on the parent's mm, until it execs or exits.
+// Meanwhile only the calling thread sleeps in vfork: the other threads of its group keep running
+// on the same mm, so the mm is only changed under mm->lock, as for any shared mm.
+// The child's trapframe is mapped at a slot of its own, TRAPFRAME still maps the parent's one.
+int vfork() {
+    int ret;
+    struct proc *np = allocproc();
+    if (np == NULL)
+        return -ENOMEM;
+
+    // as in fork, np->lock is not held while we take the mm lock.
+    release(&np->lock);
+
+    // only we change p->mm.
+    struct proc *p = curr_proc();
+    struct mm *mm  = p->mm;
+    down_write(&mm->lock);
+    np->trapframe_va = TRAPFRAME_SLOT(np->index);
+    ret              = mm_mappageat(mm, np->trapframe_va, KVA_TO_PA(np->trapframe), PTE_A | PTE_D | PTE_R | PTE_W);
+    if (ret == 0)
+        __atomic_add_fetch(&mm->refcnt, 1, __ATOMIC_RELAXED);
+    up_write(&mm->lock);
+    acquire(&np->lock);
+    if (ret < 0) {
+        freeproc(np);
+        release(&np->lock);
+        return ret;
+    }
+
+    acquire(&p->lock);
+    np->mm           = mm;
+    *(np->trapframe) = *(p->trapframe);
+    siginit_fork(p, np);
+    fpu_copy(p, np);
+    sched_fork(p, np);
+
+    np->trapframe->a0 = 0;
+    rcu_assign_pointer(np->parent, p->group_leader);
+    np->vfork_parent = p;
+    np->state        = RUNNABLE;
+    add_task(np);
+    release(&p->lock);
+
+    // wait until the child gives the mm back.
+    int pid = np->pid;
+    while (np->vfork_parent == p)
+        sleep(np, &np->lock);
+    release(&np->lock);
+    return pid;
+}
+
+// Create a thread of the current process, running entry(arg) on stack, with tp = tls.
+// It shares our mm, and maps its trapframe at a slot of its own, as a vfork child does.
+// If ctid is not 0, the tid of the thread is stored there now,
+// and 0 once the thread exits, which also wakes up the futex waiters on ctid.
+// Return the tid.
+int clone(uint64 __user entry, uint64 arg, uint64 __user stack, uint64 tls, uint64 __user ctid) {
+    int ret;
+    struct proc *p      = curr_proc();
+    struct proc *leader = p->group_leader;
+    struct mm *mm       = p->mm;
+
+    // a vfork child only execs or exits.
+    if (p->vfork_parent)
+        return -EINVAL;
+
+    struct proc *np = allocproc();
+    if (np == NULL)
+        return -ENOMEM;
+    // as in fork, np->lock is not held while we take the mm lock.
+    release(&np->lock);
+
+    if (ctid && (ret = copy_to_user(mm, ctid, (char *)&np->pid, sizeof(int))) < 0)
+        goto err_free;
+
+    down_write(&mm->lock);
+    np->trapframe_va = TRAPFRAME_SLOT(np->index);
+    ret              = mm_mappageat(mm, np->trapframe_va, KVA_TO_PA(np->trapframe), PTE_A | PTE_D | PTE_R | PTE_W);
+    if (ret == 0)
+        __atomic_add_fetch(&mm->refcnt, 1, __ATOMIC_RELAXED);
+    up_write(&mm->lock);
+    if (ret < 0)
+        goto err_free;
+
+    // join the group under wait_lock, so that exit and kill cannot miss the new thread.
+    acquire(&wait_lock);
+    if (leader->group_exiting || iskilled(p)) {
+        release(&wait_lock);
+        down_write(&mm->lock);
+        mm_unmappageat(mm, np->trapframe_va);
+        up_write(&mm->lock);
+        mm_put(mm);
+        ret = -EINTR;
+        goto err_free;
+    }
+    leader->tg_live++;
+
+    acquire(&np->lock);
+    acquire(&p->lock);
+    np->group_leader = leader;
+    np->tgid         = leader->tgid;
+    np->mm           = mm;
+    np->clear_tid    = ctid;
+    *(np->trapframe) = *(p->trapframe);
+    siginit_fork(p, np);
+    fpu_copy(p, np);
+    sched_fork(p, np);
+
+    np->trapframe->epc = entry;
+    np->trapframe->a0  = arg;
+    np->trapframe->sp  = stack;
+    np->trapframe->tp  = tls;
+    np->trapframe->ra  = 0;
+    np->state          = RUNNABLE;
+    add_task(np);
     release(&p->lock);
+    release(&wait_lock);
+
+    int tid = np->pid;
+    release(&np->lock);
+    return tid;
+
+err_free:
+    acquire(&np->lock);
     freeproc(np);
     release(&np->lock);
     return ret;
 }
 
-int exec(char *name, char *args[]) {
+// Give the mm borrowed by a vfork child back, and let the parent run.
+// Must be called by p, without any lock, after it stopped using the mm.
+static void vfork_release(struct proc *p, struct mm *mm) {
+    // only p clears its vfork_parent.
+    if (p->vfork_parent == NULL)
+        return;
+    down_write(&mm->lock);
+    mm_unmappageat(mm, p->trapframe_va);
+    up_write(&mm->lock);
+
+    acquire(&p->lock);
+    p->vfork_parent = NULL;
+    release(&p->lock);
+
+    wakeup(p);
+}
+
+// Create a child running the app, without duplicating the caller's memory.
+// The child gets fresh signal handlers (but keeps ignored signals), and the caller's signal mask,
+// unless attr says otherwise.
+int spawn(char *name, struct exec_args *ea, struct spawnattr *attr) {
     struct user_app *app = get_elf(name);
     if (app == NULL)
         return -ENOENT;
 
     int ret;
-    struct proc *p = curr_proc();
+    struct proc *np = allocproc();
+    if (np == NULL)
+        return -ENOMEM;
+
+    // load_user_elf may sleep, so it is called without np->lock, as in fork.
+    release(&np->lock);
+    ret = load_user_elf(app, np, ea);
+    acquire(&np->lock);
+    if (ret < 0) {
+        freeproc(np);
+        release(&np->lock);
+        return ret;
+    }
 
+    struct proc *p = curr_proc();
     acquire(&p->lock);
+    siginit_fork(p, np);
+    siginit_exec(np);
+    sched_fork(p, np);
+    if (attr && (attr->flags & SPAWN_SETSIGMASK))
+        np->signal.sigmask = attr->sigmask;
+    for (int i = SIGMIN; attr && (attr->flags & SPAWN_SETSIGDEF) && i <= SIGMAX; i++) {
+        if (attr->sigdefault & sigmask(i))
+            np->signal.sa[i].sa_sigaction = SIG_DFL;
+    }
+    rcu_assign_pointer(np->parent, p->group_leader);
+    np->state = RUNNABLE;
+    add_task(np);
+    release(&p->lock);
+
+    int pid = np->pid;
+    release(&np->lock);
+    return pid;
+}
+
+// Kill the other threads of the group of leader. Called with wait_lock held.
+static void kill_others_locked(struct proc *leader, struct proc *self) {
+    for (int i = 0; i < NPROC; i++) {
+        struct proc *p = pool[i];
+        // threads join their group under wait_lock.
+        if (p == self || __atomic_load_n(&p->group_leader, __ATOMIC_RELAXED) != leader)
+            continue;
+        acquire(&p->lock);
+        if (p->group_leader == leader && p->state != UNUSED && p->state != ZOMBIE) {
+            p->killed = -1;
+            if (p->state == SLEEPING) {
+                wake_task(p);
+            }
+        }
+        release(&p->lock);
+    }
+}
+
+int exec(char *name, struct exec_args *ea) {
+    struct user_app *app = get_elf(name);
+    if (app == NULL)
+        return -ENOENT;
+
+    int ret;
+    struct proc *p = curr_proc();
+
+    // the other threads go away with the old mm. Only the leader may exec, so that the pid stays.
+    if (p->group_leader != p)
+        return -EINVAL;
+    acquire(&wait_lock);
+    if (p->tg_live > 1) {
+        if (p->group_exiting) {
+            release(&wait_lock);
+            return -EINTR;
+        }
+        p->group_exiting = 1;
+        kill_others_locked(p, p);
+        while (p->tg_live > 1)
+            sleep(&p->tg_live, &wait_lock);
+        p->group_exiting = 0;
+    }
+    release(&wait_lock);
+
+    // a vfork child hands the parent's mm back once it has its own.
+    struct mm *borrowed = p->vfork_parent ? p->mm : NULL;
 
     // execve does NOT preserve memory mappings:
     //  free VMAs including program_brk, and ustack
@@ -249,24 +593,30 @@ int exec(char *name, char *args[]) {
     //  , if page allocations all succeed.
     // Otherwise, we will return to the old process.
     // However, keep the phys page of trapframe, because it belongs to struct proc.
-    if ((ret = load_user_elf(app, p, args)) < 0) {
-        release(&p->lock);
+    if ((ret = load_user_elf(app, p, ea)) < 0)
         return ret;
-    }
 
+    acquire(&p->lock);
     // Project signal: exec
     siginit_exec(p);
+    fpu_reset(p);
+    p->trapframe_va = TRAPFRAME;
 
     release(&p->lock);
 
+    if (borrowed)
+        vfork_release(p, borrowed);
+
     // syscall() will overwrite trapframe->a0 to the return value.
     return p->trapframe->a0;
 }
 
+// Any thread of a process waits for the children of the process.
 int wait(int pid, int __user *code) {
     struct proc *child;
     int havekids;
-    struct proc *p = curr_proc();
+    struct proc *p      = curr_proc();
+    struct proc *leader = p->group_leader;
 
     acquire(&wait_lock);
 
@@ -275,25 +625,26 @@ int wait(int pid, int __user *code) {
         havekids = 0;
         for (int i = 0; i < NPROC; i++) {
             child = pool[i];
-            if (child == p)
+            // children are only (re)parented under wait_lock, which we hold.
+            if (child == p || __atomic_load_n(&child->parent, __ATOMIC_RELAXED) != leader)
                 continue;
 
             acquire(&child->lock);
-            if (child->parent == p) {
+            if (child->parent == leader) {
                 havekids = 1;
-                if (child->state == ZOMBIE && (pid <= 0 || child->pid == pid)) {
-                    int cpid = child->pid;
+                // a process is gone once all its threads are.
+                if (child->state == ZOMBIE && child->tg_live == 0 && (pid <= 0 || child->pid == pid)) {
                     // Found one.
-                    if (code) {
-                        acquire(&p->mm->lock);
-                        int exit_code = child->exit_code;
-                        copy_to_user(p->mm, (uint64)code, (char*)&exit_code, sizeof(int));
-                        release(&p->mm->lock);
-                    }
+                    int cpid      = child->pid;
+                    int exit_code = child->exit_code;
                     freeproc(child);
                     release(&child->lock);
 
                     release(&wait_lock);
+
+                    // copy the exit code after dropping the locks, copy_to_user takes mm->lock itself.
+                    if (code)
+                        copy_to_user(p->mm, (uint64)code, (char *)&exit_code, sizeof(int));
                     return cpid;
                 }
             }
@@ -308,46 +659,97 @@ int wait(int pid, int __user *code) {
 
         debugf("pid %d sleeps for wait", p->pid);
         // Wait for a child to exit.
-        sleep(p, &wait_lock);  // DOC: wait-sleep
+        sleep(leader, &wait_lock);  // DOC: wait-sleep
     }
 }
 
-// Exit the current process.
+// Exit the current process: the other threads exit too, and code is the exit code of the process,
+// unless another thread is already exiting it.
 void exit(int code) {
-    struct proc *p = curr_proc();
+    struct proc *p      = curr_proc();
+    struct proc *leader = p->group_leader;
+
+    acquire(&wait_lock);
+    if (!leader->group_exiting) {
+        leader->group_exiting = 1;
+        leader->exit_code     = code;
+        kill_others_locked(leader, p);
+    }
+    release(&wait_lock);
+
+    thread_exit(code);
+}
+
+// Exit the current thread. The process is over when its last thread exits,
+// with the exit code of exit(), or that of the leader's thread_exit if no thread called exit().
+void thread_exit(int code) {
+    struct proc *p      = curr_proc();
+    struct proc *leader = p->group_leader;
 
     if (p == init_proc) {
         panic("init process exited");
     }
 
+    // tell the joiners, while we still have the mm.
+    if (p->clear_tid) {
+        int zero = 0;
+        if (copy_to_user(p->mm, p->clear_tid, (char *)&zero, sizeof(zero)) == 0)
+            sys_futex(p->clear_tid, FUTEX_WAKE, 0x7fffffff, 0, 0);
+    }
+
+    sysstat_exit(p);
+
+    // drop our memory now, with interrupts on, rather than in freeproc, under the locks of wait.
+    // the vfork parent is blocked until we are done with its mm, not until we are reaped.
+    struct mm *mm = p->mm;
+    if (p->vfork_parent) {
+        vfork_release(p, mm);
+    } else if (p->trapframe_va != TRAPFRAME) {
+        // a thread: the mm lives on without our trapframe.
+        down_write(&mm->lock);
+        mm_unmappageat(mm, p->trapframe_va);
+        up_write(&mm->lock);
+    }
+    acquire(&p->lock);
+    p->mm = NULL;
+    release(&p->lock);
+    mm_put(mm);
+
     acquire(&wait_lock);
 
-    int wakeinit = 0;
+    if (p == leader && !leader->group_exiting)
+        p->exit_code = code;
 
-    // reparent:
-    for (int i = 0; i < NPROC; i++) {
-        struct proc *child = pool[i];
-        if (child == p)
-            continue;
-        acquire(&child->lock);
-        if (child->parent == p) {
-            child->parent = init_proc;
-            wakeinit      = 1;
-            // if child has dead, wake up init to do clean up.
+    if (--leader->tg_live == 0) {
+        int wakeinit = 0;
+
+        // reparent:
+        for (int i = 0; i < NPROC; i++) {
+            struct proc *child = pool[i];
+            if (child == leader || __atomic_load_n(&child->parent, __ATOMIC_RELAXED) != leader)
+                continue;
+            acquire(&child->lock);
+            if (child->parent == leader) {
+                rcu_assign_pointer(child->parent, init_proc);
+                wakeinit = 1;
+                // if child has dead, wake up init to do clean up.
+            }
+            release(&child->lock);
         }
-        release(&child->lock);
+        if (wakeinit)
+            wakeup(init_proc);
+
+        // wakeup wait-ing parent.
+        //  There is no race because locking against "wait_lock"
+        wakeup(leader->parent);
+    } else if (leader->tg_live == 1) {
+        // exec waits for the other threads to be gone.
+        wakeup(&leader->tg_live);
     }
-    if (wakeinit)
-        wakeup(init_proc);
-
-    // wakeup wait-ing parent.
-    //  There is no race because locking against "wait_lock"
-    wakeup(p->parent);
 
     acquire(&p->lock);
 
-    p->exit_code = code;
-    p->state     = ZOMBIE;
+    p->state = ZOMBIE;
 
     release(&wait_lock);
 
@@ -355,28 +757,41 @@ void exit(int code) {
     panic_never_reach();
 }
 
-// Kill the process with the given pid.
-// The victim won't exit until it tries to return
+// Free a thread that exited, called by the scheduler with p->lock held, once it left p's stack.
+// Only leaders are waited for, by the parent of the process.
+void thread_reap(struct proc *p) {
+    assert(p->state == ZOMBIE && p->group_leader != p);
+    freeproc(p);
+}
+
+// Kill the process with the given pid, or any of its threads' tid.
+// The victims won't exit until they try to return
 // to user space (see usertrap() in trap.c).
 int kill(int pid) {
-    struct proc *p;
+    int ret = -EINVAL;
 
-    for (int i = 0; i < NPROC; i++) {
-        p = pool[i];
+    // wait_lock keeps clone from adding a thread behind our back.
+    acquire(&wait_lock);
+    rcu_read_lock();
+    struct proc *p = find_proc(pid);
+    if (p != NULL) {
         acquire(&p->lock);
-        if (p->pid == pid) {
+        struct proc *leader = p->group_leader;
+        if (p->pid == pid && p->state != UNUSED && p->kthread == NULL) {
             p->killed = -1;
             if (p->state == SLEEPING) {
                 // Wake process from sleep().
-                p->state = RUNNABLE;
-                add_task(p);
+                wake_task(p);
             }
-            release(&p->lock);
-            return 0;
+            ret = 0;
         }
         release(&p->lock);
+        if (ret == 0)
+            kill_others_locked(leader, p);
     }
-    return -EINVAL;
+    rcu_read_unlock();
+    release(&wait_lock);
+    return ret;
 }
 
 void setkilled(struct proc *p, int reason) {
@@ -1,7 +1,9 @@
 #ifndef PROC_H
 #define PROC_H
 
+#include "fpu.h"
 #include "queue.h"
+#include "rcu.h"
 #include "riscv.h"
 #include "signal/ksignal.h"
 #include "vm.h"
@@ -38,13 +40,26 @@ struct cpu {
     struct context sched_context;  // scheduler context, swtch() here to run scheduler
     int inkernel_trap;             // whether we are in a kernel trap context
     int noff;                      // how many push-off
+    int preempt_count;             // how many preempt_disable
     int interrupt_on;              // Is the interrupt Enabled before the first push-off?
     uint64 sched_kstack_top;       // top of per-cpu sheduler kernel stack
     int cpuid;                     // for debug purpose
+    struct mcs_node mcs_nodes[MCS_NODES];  // queue nodes of the MCS locks we hold or wait for
+    uint mcs_used;                         // bitmap of the nodes in use
+    struct proc *fp_owner;                 // whose floating-point registers this hart holds, see fpu.c
+    struct proc *switch_prev;              // process switched from directly, still locked, see sched()
+    int direct_switches;                   // direct switches since the last pass in scheduler()
+    struct proc *handoff;                  // fetched by fetch_direct but locked elsewhere, run next by scheduler()
+    int need_resched;                      // a more urgent task waits for this cpu, see enqueue()
+    int sched_online;                      // reached scheduler()
 };
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+#define NPRIO    4  // levels of the scheduler queue, see sched.c
+#define NICE_MIN (-20)
+#define NICE_MAX 19
+
 extern struct proc *pool[];
 
 // Per-process state
@@ -55,17 +70,66 @@ struct proc {
     int pid;               // Process ID
     int exit_code;
     void *sleep_chan;
+    uint64 sleep_deadline;  // tick at which a sleep_until ends anyway, 0 if none
     int killed;
 
-    struct proc *parent;  // Parent process
+    // scheduling, see sched.c
+    int policy;            // SCHED_NORMAL, or a real-time one, see sched.h
+    int nice;              // NICE_MIN .. NICE_MAX
+    int prio;              // level, 0 runs first
+    int slice;             // ticks left in the quantum
+    uint64 queued_at;      // tick at which it was last queued
+    uint64 exec_start;     // when runtime was last charged, in cycles
+    uint64 cpus_allowed;   // cpuids it may run on
+    int last_cpu;          // where it ran last, the current cpu while RUNNING
+    int rq_cpu;            // whose run queue it is on, while RUNNABLE
+    int rt_priority;       // SCHED_FIFO, SCHED_RR
+    struct proc *rt_next;  // in the real-time queue
+    struct sched_group *group;      // bandwidth group
+    struct sched_group *parked_in;  // throttled group it waits for, off the run queues
+    struct proc *group_next;        // in the throttled list of parked_in
+    // SCHED_DEADLINE, in cycles
+    uint64 dl_runtime;
+    uint64 dl_rel_deadline;
+    uint64 dl_period;
+    uint64 dl_bw;        // runtime / period, admitted
+    uint64 dl_deadline;  // absolute, of the current period
+    int64 dl_left;       // runtime left until dl_deadline, throttled when <= 0
+
+    struct proc *parent;  // Parent process, the leader of its thread group. NULL for threads but the leader.
+    struct proc *vfork_parent;  // set while a vfork child borrows the parent's mm
+
+    // threads of a process share its mm, and form a group led by its first thread.
+    // tg_live and group_exiting are only used in the leader, under wait_lock.
+    struct proc *group_leader;  // ourselves for a single-threaded process
+    int tgid;                   // pid of group_leader, what getpid returns
+    int tg_live;                // threads of the group that have not exited yet
+    int group_exiting;          // the other threads exit on their way back to user space
+    uint64 __user clear_tid;    // zeroed, and woken up as a futex, when the thread exits
+
+    // pid, state, parent, sleep_chan and the pid hash may also be read without locks,
+    // in an RCU read-side section: a freed proc is not reused before a grace period.
+    // parent is set with rcu_assign_pointer, and read there with rcu_dereference.
+    struct proc *pid_next;  // next in the pid hash chain
+    int rcu_pending;        // freed, but lockless readers may still see it
+    struct rcu_head rcu;
+
+    // kernel threads have no mm, and never return to user space.
+    char *kthread;  // name of a kernel thread, NULL for user processes
+    void (*kthread_fn)(void *);
+    void *kthread_arg;
+
+    struct sysstat_proc *sysstat;  // per-process syscall statistics, if enabled, see sysstat.c
 
     int index;
     struct mm *mm;
-    struct vma *vma_brk;                // special vma for heap, included in mm->vma list.
-    uint64 brk;                         // end address of heap
     struct trapframe *__kva trapframe;  // data page for trampoline.S
+    uint64 __user trapframe_va;         // where trapframe is mapped in mm, TRAPFRAME unless mm is borrowed
     uint64 __kva kstack;                // Virtual address of kernel stack
     struct context context;             // swtch() here to run process
+    struct fpstate fp;                  // floating-point registers, when not live on fp_cpu
+    int fp_used;                        // FS is Off until the process uses the FPU
+    int fp_cpu;                         // the hart holding our registers, -1 if none
 
     // Project signal:
     struct ksignal signal;
@@ -82,6 +146,7 @@ static inline int cpuid() {
 // cpu.c
 struct cpu *mycpu();
 struct cpu *getcpu(int i);
+extern int nr_cpus;
 
 static inline struct proc *curr_proc() {
     push_off();
@@ -95,21 +160,58 @@ static inline struct proc *curr_proc() {
 void proc_init();
 struct proc *allocproc();
 int fork();
-int exec(char *name, char *arg[]);
+int vfork();
+int clone(uint64 __user entry, uint64 arg, uint64 __user stack, uint64 tls, uint64 __user ctid);
+struct exec_args;
+int exec(char *name, struct exec_args *ea);
+struct spawnattr;
+int spawn(char *name, struct exec_args *ea, struct spawnattr *attr);
 int wait(int, int *);
 void exit(int);
+void thread_exit(int);
+void thread_reap(struct proc *);
 int kill(int pid);
+struct proc *find_proc(int pid);
 int iskilled(struct proc *);
 void setkilled(struct proc *, int reason);
+struct proc *kthread_create(char *name, void (*fn)(void *), void *arg, int cpu);
 
 void sleep(void *chan, spinlock_t *lk);
+void sleep_until(void *chan, spinlock_t *lk, uint64 deadline);
 void wakeup(void *chan);
+void wakeup_expired(uint64 now);
 
 // sched.c
 void scheduler() __attribute__((noreturn));
 void sched();
+void finish_switch();
 void yield();
 void add_task(struct proc *);
+void wake_task(struct proc *);
+void sched_task_init(struct proc *);
+void sched_bind(struct proc *, int cpu);
+void sched_fork(struct proc *parent, struct proc *child);
+void sched_task_exit(struct proc *);
+int sched_tick(struct proc *);
+int need_resched();
+void preempt_schedule();
+void preempt_kernel(int tick);
+void cond_resched();
+void sched_timer_tick();
+struct schedstat_cpu;
+int sched_stat(int cpu, struct schedstat_cpu *st);
+int setpriority(int pid, int nice);
+int getpriority(int pid, int *nice);
+struct sched_attr;
+int sched_setattr(int pid, struct sched_attr *attr);
+int sched_getattr(int pid, struct sched_attr *attr);
+int sched_setaffinity(int pid, uint64 mask);
+int sched_getaffinity(int pid, uint64 *mask);
+struct sched_group_stat;
+int sched_group_create(int parent, uint64 quota_us, uint64 period_us);
+int sched_group_destroy(int id);
+int sched_group_attach(int id, int pid);
+int sched_group_stat(int id, struct sched_group_stat *st);
 
 // swtch.S
 void swtch(struct context *, struct context *);
@@ -0,0 +1,220 @@
+#include "profile.h"
+
+#include "defs.h"
+#include "syscall.h"
+#include "timer.h"
+#include "trap.h"
+
+// The timer of each hart fires at the earlier of its next scheduler tick and its next sample,
+// see set_next_timer. Samples go to a ring per cpu, drained by PROFILE_READ.
+//
+// With -fno-omit-frame-pointer, a frame keeps the return address at fp - 8 and the caller's fp at fp - 16.
+// A leaf function only keeps the caller's fp, at fp - 8, and its return address is still in ra:
+// that is what a stack address at fp - 8 of the innermost frame means.
+
+#define USTACK_SPAN (1ull << 20)  // how far above the interrupted sp a user frame may be
+
+struct prof_ring {
+    spinlock_t lock;
+    uint64 head;  // samples [tail, head) are unread
+    uint64 tail;
+    struct prof_sample s[PROF_RING];
+};
+
+static struct prof_ring rings[NCPU];
+static uint64 prof_period;  // in `time` ticks, 0 when stopped
+static int prof_flags;
+static uint64 next_sample[NCPU];
+
+void profile_init() {
+    for (int i = 0; i < NCPU; i++)
+        spinlock_init(&rings[i].lock, "profile");
+}
+
+// `time` of the next sample on this hart, or -1 if the profiler is stopped. Called with interrupts off.
+uint64 profile_next_sample() {
+    if (__atomic_load_n(&prof_period, __ATOMIC_ACQUIRE) == 0)
+        return (uint64)-1;
+    return next_sample[cpuid()];
+}
+
+typedef int (*read_word_t)(void *ctx, uint64 va, uint64 *val);
+
+static int read_kernel_word(void *ctx, uint64 va, uint64 *val) {
+    *val = *(uint64 *)va;
+    return 0;
+}
+
+// Read a user word of mm through the direct mapping, without faulting it in. Called with mm->lock held.
+static int read_user_word(void *ctx, uint64 va, uint64 *val) {
+    struct mm *mm = ctx;
+
+    if (!IS_USER_VA(va))
+        return -1;
+    pte_t *pte = walk(mm, va, false);
+    if (pte == NULL || (*pte & (PTE_V | PTE_U | PTE_R)) != (PTE_V | PTE_U | PTE_R))
+        return -1;
+    *val = *(uint64 *)(PA_TO_KVA(PTE2PA(*pte)) + (va & (PGSIZE - 1)));
+    return 0;
+}
+
+// Unwind the stack [low, high) from the frame at fp, interrupted at pc with return address register ra.
+// Fill pcs with at most max return addresses, the innermost first, and return how many.
+static int unwind(uint64 pc, uint64 fp, uint64 ra, uint64 low, uint64 high, read_word_t read, void *ctx, uint64 *pcs,
+                  int max) {
+    int n = 0;
+
+    if (max == 0)
+        return 0;
+    pcs[n++] = pc;
+    for (int first = 1; n < max; first = 0) {
+        uint64 next, ret;
+        if (fp < low + 16 || fp > high || !IS_ALIGNED(fp, 8))
+            break;
+        if (read(ctx, fp - 16, &next) < 0 || read(ctx, fp - 8, &ret) < 0)
+            break;
+        if (first && low <= ret && ret <= high) {
+            next = ret;
+            ret  = ra;
+        }
+        if (ret == 0)
+            break;
+        pcs[n++] = ret;
+        if (next <= fp)
+            break;
+        fp = next;
+    }
+    return n;
+}
+
+// The kernel stack the trap frame is on: that of the current process, or the scheduler stack of this cpu.
+static int kstack_bounds(struct ktrapframe *ktf, uint64 *low, uint64 *high) {
+    struct cpu *c  = mycpu();
+    struct proc *p = c->proc;
+    uint64 sp      = (uint64)ktf;
+
+    if (p != NULL && p->kstack <= sp && sp < p->kstack + KERNEL_STACK_SIZE)
+        *high = p->kstack + KERNEL_STACK_SIZE;
+    else if (c->sched_kstack_top - KERNEL_STACK_SIZE <= sp && sp < c->sched_kstack_top)
+        *high = c->sched_kstack_top;
+    else
+        return -1;
+    *low = sp + sizeof(*ktf);
+    return 0;
+}
+
+// Unwind the user stack of p, as it entered the kernel.
+// The mm must not change under us: skip it if the interrupted code is changing it.
+static int unwind_user(struct proc *p, uint64 *pcs, int max) {
+    struct mm *mm        = p->mm;
+    struct trapframe *tf = p->trapframe;
+    int n                = 0;
+
+    if (mm == NULL || p->kthread != NULL || !down_read_trylock(&mm->lock))
+        return 0;
+    n = unwind(tf->epc, tf->s0, tf->ra, tf->sp, tf->sp + USTACK_SPAN, read_user_word, mm, pcs, max);
+    up_read(&mm->lock);
+    return n;
+}
+
+// Called on every timer interrupt, with ktf if it came from the kernel, or NULL from user space.
+// Take a sample if one is due on this hart.
+void profile_tick(struct ktrapframe *ktf) {
+    uint64 period = __atomic_load_n(&prof_period, __ATOMIC_ACQUIRE);
+    uint64 now    = r_time();
+    int cpu       = cpuid();
+
+    if (period == 0 || now < next_sample[cpu])
+        return;
+    next_sample[cpu] = now + period;
+
+    struct proc *p = mycpu()->proc;
+    struct prof_sample s;
+    memset(&s, 0, sizeof(s));
+    s.time = now;
+    if (p != NULL) {
+        s.pid = p->tgid;
+        if (p->kthread != NULL)
+            safestrcpy(s.app, p->kthread, sizeof(s.app));
+        else if (p->mm != NULL && p->mm->app != NULL)
+            safestrcpy(s.app, p->mm->app, sizeof(s.app));
+    }
+
+    uint64 low, high;
+    if (ktf != NULL && kstack_bounds(ktf, &low, &high) == 0)
+        s.nkernel = unwind(r_sepc(), ktf->s0, ktf->ra, low, high, read_kernel_word, NULL, s.pc, PROF_DEPTH);
+    if (p != NULL && (ktf == NULL || (prof_flags & PROFILE_F_USER)))
+        s.nuser = unwind_user(p, s.pc + s.nkernel, PROF_DEPTH - s.nkernel);
+
+    struct prof_ring *r = &rings[cpu];
+    acquire(&r->lock);
+    s.seq                     = r->head;
+    r->s[r->head % PROF_RING] = s;
+    r->head++;
+    if (r->head - r->tail > PROF_RING)
+        r->tail = r->head - PROF_RING;
+    release(&r->lock);
+}
+
+static int profile_start(uint64 period_us, int flags) {
+    if (flags & ~PROFILE_F_USER)
+        return -EINVAL;
+    if (period_us != 0 && period_us < PROF_MIN_PERIOD)
+        return -EINVAL;
+
+    uint64 period = period_us == 0 ? CPU_FREQ / TICKS_PER_SEC : period_us * CPU_FREQ / 1000000;
+    __atomic_store_n(&prof_period, 0, __ATOMIC_RELEASE);
+    for (int i = 0; i < NCPU; i++) {
+        acquire(&rings[i].lock);
+        rings[i].head  = 0;
+        rings[i].tail  = 0;
+        next_sample[i] = 0;
+        release(&rings[i].lock);
+    }
+    prof_flags = flags;
+    __atomic_store_n(&prof_period, period, __ATOMIC_RELEASE);
+    return 0;
+}
+
+#define READ_CHUNK 4
+
+// Drain the samples of a cpu to user buffer va.
+static int profile_read(int cpu, uint64 __user va, uint64 len) {
+    struct prof_sample buf[READ_CHUNK];
+    uint64 max = len / sizeof(struct prof_sample);
+    int ret    = 0;
+
+    if (cpu < 0 || cpu >= NCPU)
+        return -EINVAL;
+
+    struct prof_ring *r = &rings[cpu];
+    acquire(&r->lock);
+    while ((uint64)ret < max && r->head != r->tail) {
+        int n = 0;
+        for (; n < READ_CHUNK && ret + n < max && r->head != r->tail; n++) {
+            buf[n] = r->s[r->tail % PROF_RING];
+            r->tail++;
+        }
+        release(&r->lock);
+        if (copy_to_user(curr_proc()->mm, va + ret * sizeof(buf[0]), (char *)buf, n * sizeof(buf[0])) < 0)
+            return -EINVAL;
+        ret += n;
+        acquire(&r->lock);
+    }
+    release(&r->lock);
+    return ret;
+}
+
+int64 sys_profile(int op, uint64 arg, uint64 __user va, uint64 len) {
+    switch (op) {
+        case PROFILE_START:
+            return profile_start(arg, len);
+        case PROFILE_STOP:
+            __atomic_store_n(&prof_period, 0, __ATOMIC_RELEASE);
+            return 0;
+        case PROFILE_READ:
+            return profile_read(arg, va, len);
+        default:
+            return -EINVAL;
+    }
+}
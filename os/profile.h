@@ -0,0 +1,33 @@
+// This file is shared by Kernel and User-space application.
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "types.h"
+
+// Sampling profiler. Each hart samples the code its timer interrupt lands in, every period,
+// and unwinds the stack through the frame pointers. Code running with interrupts off
+// (holding a spinlock) cannot be sampled: its time shows up where interrupts are turned back on.
+
+// profile(op, arg, buf, len) operations:
+#define PROFILE_START 0  // sample every arg microseconds, 0 for every scheduler tick. len holds PROFILE_F_* flags
+#define PROFILE_STOP  1
+#define PROFILE_READ  2  // read up to len bytes of prof_sample taken on cpu arg, oldest first. Return how many.
+
+#define PROFILE_F_USER 1  // also unwind the user stack of the interrupted process
+
+#define PROF_MIN_PERIOD 50  // microseconds
+#define PROF_DEPTH      16  // frames per sample
+#define PROF_RING       256 // samples kept per cpu, the oldest are dropped when the reader falls behind
+
+struct prof_sample {
+    uint64 seq;  // numbers the samples of a cpu since PROFILE_START, a gap means dropped samples
+    uint64 time;
+    int32 pid;       // 0 when no process ran: the scheduler, or a hart waiting for work
+    uint16 nkernel;  // pc[0 .. nkernel) are kernel frames, the innermost first
+    uint16 nuser;    // then pc[nkernel .. nkernel + nuser) are user frames
+    char app[16];    // the app the process runs, or the name of a kernel thread
+    uint64 pc[PROF_DEPTH];
+};
+
+#endif  // PROFILE_H
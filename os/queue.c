@@ -5,26 +5,26 @@
 #include "proc.h"
 
 void init_queue(struct queue *q) {
-    spinlock_init(&q->lock, "queue");
+    mcslock_init(&q->lock, "queue");
     q->front = q->tail = 0;
     q->empty           = 1;
 }
 
 void push_queue(struct queue *q, void *data) {
-    acquire(&q->lock);
+    mcs_acquire(&q->lock);
     if (!q->empty && q->front == q->tail) {
         panic("queue overflow");
     }
     q->empty         = 0;
     q->data[q->tail] = data;
     q->tail          = (q->tail + 1) % NPROC;
-    release(&q->lock);
+    mcs_release(&q->lock);
 }
 
 void *pop_queue(struct queue *q) {
-    acquire(&q->lock);
+    mcs_acquire(&q->lock);
     if (q->empty) {
-        release(&q->lock);
+        mcs_release(&q->lock);
         return NULL;
     }
 
@@ -32,6 +32,47 @@ void *pop_queue(struct queue *q) {
     q->front   = (q->front + 1) % NPROC;
     if (q->front == q->tail)
         q->empty = 1;
-    release(&q->lock);
+    mcs_release(&q->lock);
+    return data;
+}
+
+// The item pop_queue would return, left in the queue.
+void *peek_queue(struct queue *q) {
+    mcs_acquire(&q->lock);
+    void *data = q->empty ? NULL : q->data[q->front];
+    mcs_release(&q->lock);
+    return data;
+}
+
+// A hint only, without the lock: the queue may change right after.
+int queue_empty(struct queue *q) {
+    return __atomic_load_n(&q->empty, __ATOMIC_RELAXED);
+}
+
+// Remove and return the first item for which match(item, arg) holds, NULL if none.
+// The items behind it move up, so the others keep their order.
+void *pop_queue_match(struct queue *q, int (*match)(void *, void *), void *arg) {
+    void *data = NULL;
+    int i;
+
+    mcs_acquire(&q->lock);
+    if (!q->empty) {
+        i = q->front;
+        do {
+            if (match(q->data[i], arg)) {
+                data = q->data[i];
+                break;
+            }
+            i = (i + 1) % NPROC;
+        } while (i != q->tail);
+    }
+    if (data != NULL) {
+        for (; (i + 1) % NPROC != q->tail; i = (i + 1) % NPROC)
+            q->data[i] = q->data[(i + 1) % NPROC];
+        q->tail = i;
+        if (q->front == q->tail)
+            q->empty = 1;
+    }
+    mcs_release(&q->lock);
     return data;
 }
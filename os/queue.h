@@ -6,7 +6,7 @@
 #define QUEUE_SIZE (1024)
 
 struct queue {
-    spinlock_t lock;
+    mcslock_t lock;
     void *data[QUEUE_SIZE];
     int front;
     int tail;
@@ -16,5 +16,8 @@ struct queue {
 void init_queue(struct queue *);
 void push_queue(struct queue *, void *);
 void *pop_queue(struct queue *);
+void *peek_queue(struct queue *);
+void *pop_queue_match(struct queue *, int (*match)(void *, void *), void *arg);
+int queue_empty(struct queue *);
 
 #endif  // QUEUE_H
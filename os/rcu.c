@@ -0,0 +1,124 @@
+#include "rcu.h"
+
+#include "defs.h"
+
+// Grace periods are numbered. A cpu in a quiescent state records the current number,
+// and the first cpu to see that all online cpus recorded it starts the next one.
+// So once grace period gp + 1 is over, every cpu went through a quiescent state after gp ended,
+// and a callback queued during gp can run.
+// The quiescent states: a pass through scheduler(), a direct switch in sched(), and a timer tick
+// that interrupted user space. The last one keeps a task that never leaves user space,
+// such as a spinning SCHED_FIFO task, from holding up grace periods forever.
+
+struct rcu_cpu {
+    uint64 gp;   // last grace period this cpu was seen quiescent in
+    int online;  // this cpu reached scheduler() once
+    int idle;    // waiting for an interrupt in scheduler(), which is a quiescent state too
+};
+
+static struct rcu_cpu rcu_cpus[NCPU];
+static uint64 rcu_gp = 1;
+
+// callbacks waiting for their grace period to pass, oldest first.
+static spinlock_t rcu_lock;
+static struct rcu_head *rcu_cbs;
+static struct rcu_head **rcu_cbs_tail = &rcu_cbs;
+
+void rcu_init() {
+    spinlock_init(&rcu_lock, "rcu");
+}
+
+// Readers must not sleep until rcu_read_unlock.
+void rcu_read_lock() {
+    push_off();
+}
+
+void rcu_read_unlock() {
+    pop_off();
+}
+
+// Call func(head) once every reader that might see the object holding head is done.
+// Never sleeps, so it can be called with spinlocks held. func runs with no lock held and interrupts off,
+// from scheduler() or from a timer tick in usertrap().
+void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *)) {
+    head->func = func;
+    head->next = NULL;
+
+    acquire(&rcu_lock);
+    head->gp      = __atomic_load_n(&rcu_gp, __ATOMIC_SEQ_CST);
+    *rcu_cbs_tail = head;
+    rcu_cbs_tail  = &head->next;
+    release(&rcu_lock);
+}
+
+static int rcu_gp_done(uint64 gp) {
+    for (int i = 0; i < NCPU; i++) {
+        struct rcu_cpu *rc = &rcu_cpus[i];
+        if (!__atomic_load_n(&rc->online, __ATOMIC_SEQ_CST) || __atomic_load_n(&rc->idle, __ATOMIC_SEQ_CST))
+            continue;
+        if (__atomic_load_n(&rc->gp, __ATOMIC_SEQ_CST) != gp)
+            return 0;
+    }
+    return 1;
+}
+
+// Run the callbacks whose grace period is over. Callbacks are queued in grace period order.
+static void rcu_run_callbacks(uint64 gp) {
+    struct rcu_head *done, *last = NULL;
+
+    acquire(&rcu_lock);
+    done = rcu_cbs;
+    for (struct rcu_head *h = rcu_cbs; h != NULL && h->gp + 2 <= gp; h = h->next)
+        last = h;
+    if (last == NULL) {
+        release(&rcu_lock);
+        return;
+    }
+    rcu_cbs = last->next;
+    if (rcu_cbs == NULL)
+        rcu_cbs_tail = &rcu_cbs;
+    last->next = NULL;
+    release(&rcu_lock);
+
+    while (done != NULL) {
+        struct rcu_head *next = done->next;
+        done->func(done);
+        done = next;
+    }
+}
+
+// Record that this cpu holds no reference from a read-side section, and return the current grace period.
+static uint64 rcu_report(void) {
+    struct rcu_cpu *rc = &rcu_cpus[mycpu()->cpuid];
+    uint64 gp          = __atomic_load_n(&rcu_gp, __ATOMIC_SEQ_CST);
+
+    __atomic_store_n(&rc->online, 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&rc->gp, gp, __ATOMIC_SEQ_CST);
+    if (rcu_gp_done(gp) && __atomic_compare_exchange_n(&rcu_gp, &gp, gp + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        gp++;
+    return gp;
+}
+
+// Called by scheduler() between two processes, and by usertrap() on a timer tick from user space.
+// No lock may be held: the callbacks due run here.
+void rcu_quiescent() {
+    uint64 gp = rcu_report();
+
+    if (__atomic_load_n(&rcu_cbs, __ATOMIC_RELAXED) != NULL)
+        rcu_run_callbacks(gp);
+}
+
+// Called by sched() on a direct switch, with the lock of the process switched from held:
+// the callbacks wait for a later quiescent state.
+void rcu_quiescent_locked() {
+    rcu_report();
+}
+
+// An idle cpu runs no reader, so grace periods do not wait for it.
+void rcu_idle_enter() {
+    __atomic_store_n(&rcu_cpus[mycpu()->cpuid].idle, 1, __ATOMIC_SEQ_CST);
+}
+
+void rcu_idle_exit() {
+    __atomic_store_n(&rcu_cpus[mycpu()->cpuid].idle, 0, __ATOMIC_SEQ_CST);
+}
@@ -0,0 +1,36 @@
+#ifndef RCU_H
+#define RCU_H
+
+#include "types.h"
+
+// Read-copy-update: readers look objects up without any lock, and writers defer reusing
+// what they unlinked until every reader that could still see it is gone.
+//
+// A read-side critical section (rcu_read_lock .. rcu_read_unlock) runs with interrupts off
+// and must not sleep, so a cpu going through scheduler(), switching in sched() or interrupted
+// in user space is outside any of them: that is a quiescent state. A grace period ends once
+// every online cpu has gone through one, or is idle in scheduler().
+
+struct rcu_head {
+    struct rcu_head *next;
+    void (*func)(struct rcu_head *);
+    uint64 gp;  // grace period during which call_rcu was called
+};
+
+// Load a pointer published with rcu_assign_pointer.
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+// Publish a pointer to readers, after the object it points to is initialized.
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+void rcu_init();
+void rcu_read_lock();
+void rcu_read_unlock();
+void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *));
+
+// called by scheduler(), sched() and usertrap()
+void rcu_quiescent();
+void rcu_quiescent_locked();
+void rcu_idle_enter();
+void rcu_idle_exit();
+
+#endif  // RCU_H
@@ -12,6 +12,14 @@
 #define SSTATUS_SPIE (1L << 5)   // Supervisor Previous Interrupt Enable
 #define SSTATUS_SIE  (1L << 1)   // Supervisor Interrupt Enable
 
+// sstatus.FS, the state of the floating-point registers. Off makes F/D instructions trap,
+// the hart moves it from Initial or Clean to Dirty when they are written.
+#define SSTATUS_FS         (3L << 13)
+#define SSTATUS_FS_OFF     (0L << 13)
+#define SSTATUS_FS_INITIAL (1L << 13)
+#define SSTATUS_FS_CLEAN   (2L << 13)
+#define SSTATUS_FS_DIRTY   (3L << 13)
+
 static inline uint64 r_sstatus() {
     uint64 x;
     asm volatile("csrr %0, sstatus" : "=r"(x));
@@ -42,6 +50,8 @@ static inline void w_stimecmp(uint64 x) {
 #define SIE_SEIE (1L << 9)  // external
 #define SIE_STIE (1L << 5)  // timer
 #define SIE_SSIE (1L << 1)  // software
+// Supervisor Interrupt Pending, same bits
+#define SIP_SSIP (1L << 1)  // software
 static inline uint64 r_sie() {
     uint64 x;
     asm volatile("csrr %0, sie" : "=r"(x));
@@ -164,6 +174,12 @@ static inline void w_tp(uint64 x) {
     asm volatile("mv tp, %0" : : "r"(x));
 }
 
+// Hint that we are busy-waiting: Zihintpause `pause`, encoded as a FENCE with no effect
+// on harts without the extension.
+static inline void cpu_relax() {
+    asm volatile(".insn i 0x0f, 0, x0, x0, 0x010" ::: "memory");
+}
+
 static inline uint64 r_ra() {
     uint64 x;
     asm volatile("mv %0, ra" : "=r"(x));
@@ -16,6 +16,8 @@ const uint64 SBI_SHUTDOWN = 8;
 // SBI Extension: Specify EID and FID.
 const uint64 SBI_EID_BASE = 0x10;
 const uint64 SBI_EID_HSM = 0x48534D;
+const uint64 SBI_EID_IPI = 0x735049;
+const uint64 SBI_EID_RFENCE = 0x52464E43;
 
 static int inline sbi_call_legacy(uint64 which, uint64 arg0, uint64 arg1, uint64 arg2)
 {
@@ -27,14 +29,15 @@ static int inline sbi_call_legacy(uint64 which, uint64 arg0, uint64 arg1, uint64
 	return a0;
 }
 
-static struct sbiret inline sbi_call(int32 eid, int32 fid, uint64 arg0, uint64 arg1, uint64 arg2)
+static struct sbiret inline sbi_call(int32 eid, int32 fid, uint64 arg0, uint64 arg1, uint64 arg2, uint64 arg3)
 {
 	register uint64 a0 asm("a0") = arg0;
 	register uint64 a1 asm("a1") = arg1;
 	register uint64 a2 asm("a2") = arg2;
+	register uint64 a3 asm("a3") = arg3;
 	register uint64 a6 asm("a6") = fid;
 	register uint64 a7 asm("a7") = eid;
-	asm volatile("ecall" : "=r"(a0), "=r"(a1) : "r"(a0), "r"(a1), "r"(a2), "r"(a6), "r"(a7) : "memory");
+	asm volatile("ecall" : "=r"(a0), "=r"(a1) : "r"(a0), "r"(a1), "r"(a2), "r"(a3), "r"(a6), "r"(a7) : "memory");
 	struct sbiret ret;
 	ret.error = a0;
 	ret.value = a1;
@@ -47,17 +50,32 @@ void sbi_putchar(int c)
 
 int sbi_hsm_hart_start(unsigned long hartid, unsigned long start_addr, unsigned long a1)
 {
-	struct sbiret ret = sbi_call(SBI_EID_HSM, 0x0, hartid, start_addr, a1);
+	struct sbiret ret = sbi_call(SBI_EID_HSM, 0x0, hartid, start_addr, a1, 0);
+	return ret.error;
+}
+
+// Raise a supervisor software interrupt on the harts in hart_mask, relative to hart_mask_base.
+int sbi_send_ipi(unsigned long hart_mask, unsigned long hart_mask_base)
+{
+	struct sbiret ret = sbi_call(SBI_EID_IPI, 0x0, hart_mask, hart_mask_base, 0, 0);
+	return ret.error;
+}
+
+// Run sfence.vma for the whole address space on the harts in hart_mask, relative to hart_mask_base.
+// Returns once all of them did.
+int sbi_remote_sfence_vma(unsigned long hart_mask, unsigned long hart_mask_base)
+{
+	struct sbiret ret = sbi_call(SBI_EID_RFENCE, 0x1, hart_mask, hart_mask_base, 0, (uint64)-1);
 	return ret.error;
 }
 
 uint64 sbi_get_mvendorid(void) {
-	struct sbiret ret = sbi_call(SBI_EID_BASE, 0x04, 0, 0, 0);
+	struct sbiret ret = sbi_call(SBI_EID_BASE, 0x04, 0, 0, 0, 0);
 	return ret.value;
 }
 
 uint64 sbi_get_mimpid(void) {
-	struct sbiret ret = sbi_call(SBI_EID_BASE, 0x06, 0, 0, 0);
+	struct sbiret ret = sbi_call(SBI_EID_BASE, 0x06, 0, 0, 0, 0);
 	return ret.value;
 }
 
@@ -12,6 +12,8 @@ void sbi_putchar(int);
 void shutdown();
 void set_timer(uint64 stime);
 int sbi_hsm_hart_start(unsigned long hartid, unsigned long start_addr, unsigned long a1);
+int sbi_send_ipi(unsigned long hart_mask, unsigned long hart_mask_base);
+int sbi_remote_sfence_vma(unsigned long hart_mask, unsigned long hart_mask_base);
 uint64 sbi_get_mvendorid(void);
 uint64 sbi_get_mimpid(void);
 
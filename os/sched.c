@@ -1,32 +1,1078 @@
 #include "defs.h"
 #include "kalloc.h"
+#include "ktest/ktest.h"
 #include "loader.h"
 #include "proc.h"
 #include "queue.h"
+#include "sbi.h"
+#include "sched.h"
+#include "timer.h"
 #include "trap.h"
 
-static struct queue task_queue;
+// Multi-level feedback queue: a task runs from the highest non-empty level, round-robin within it.
+//  - a task that uses up its quantum moves one level down, and lower levels have longer quanta.
+//  - a task woken up from sleep moves one level up: interactive tasks stay on top.
+//  - a running task is preempted as soon as a higher level has a task for its cpu.
+//  - a task waiting for STARVE_TICKS in a lower level runs next, and goes back to its top level.
+// nice narrows the levels a task moves between, see prio_top and prio_bottom.
+#define STARVE_TICKS 50
+
+static const int quantum[NPRIO] = {1, 2, 4, 8};  // in ticks
+
+// Real-time tasks run before all the others:
+//  - SCHED_DEADLINE tasks first, earliest absolute deadline first. Each is a constant bandwidth server:
+//    it gets runtime every period, and once that is used up it is throttled until its deadline,
+//    then replenished. Admission control keeps their total bandwidth under DL_BW_MAX% of the cpus.
+//  - then SCHED_FIFO and SCHED_RR tasks, highest priority first. SCHED_RR ones take turns every RR_TICKS.
+// They wait in a list sorted by task_before(). Queuing one sends an IPI to a cpu running
+// a task it goes before, which reschedules right away instead of at its next tick.
+// Deadline times are in `time` CSR cycles, but throttled tasks are only replenished on a tick.
+#define RR_TICKS  10
+#define DL_BW_MAX 95
+#define BW_SHIFT  20  // bandwidth is runtime / period, in fixed point
+
+// Affinity: a task only runs on the cpus of p->cpus_allowed. It is queued on the last one it ran on
+// when it can, where its caches and TLB may still be warm.
+#define CPUS_ALL ((1ull << NCPU) - 1)
+
+#define LOAD_SCALE    1024             // load_avg of one task always runnable
+#define BALANCE_TICKS 4
+#define HOT_CYCLES    (CPU_FREQ / 1000)  // 1 ms
+
+// Each cpu has its own run queue.
+struct rq {
+    struct queue levels[NPRIO];  // SCHED_NORMAL tasks
+    spinlock_t rt_lock;
+    struct proc *rt_queue;       // real-time tasks, linked by p->rt_next, under rt_lock
+    int nr_queued;               // tasks in levels and rt_queue
+    uint64 load_avg;             // decayed average of the runnable tasks, written by its cpu
+    int balance_tick;
+    struct {
+        uint64 migrations;  // tasks pulled from other cpus
+        uint64 idle_pulls;  // of which by the idle balancer
+        uint64 balance_runs;
+    } stat;
+};
+
+static struct rq rqs[NCPU];
+
+// Bandwidth groups: a group gets quota cpu time every period, shared by its SCHED_NORMAL tasks on all the cpus
+// and by the groups below it. Once a group or one of its ancestors has used up its quota, its tasks are parked
+// on the throttled list of that group, off the run queues, until a tick starts the next period.
+// Runtime is charged as in update_runtime(), so a group may overrun by a tick: that is paid back next period.
+// Group 0 is the root, without quota. Children join the group of their parent at fork.
+#define NGROUP           16
+#define GROUP_PERIOD_MIN 1000  // in microseconds
+#define GROUP_PERIOD_MAX 1000000
+
+struct sched_group {
+    spinlock_t lock;
+    int used;                    // under groups_lock
+    struct sched_group *parent;  // NULL for the root
+    int nr_tasks;
+    int nr_children;             // under groups_lock
+    uint64 quota;                // per period, in cycles. 0 for no limit
+    uint64 period;
+    int64 runtime_left;          // of quota in this period, throttled when <= 0
+    uint64 period_end;
+    struct proc *throttled;      // parked tasks, linked by p->group_next, under lock
+    uint64 throttled_at;         // when the first of them was parked
+    struct {
+        uint64 usage;  // cycles charged
+        uint64 nr_periods;
+        uint64 nr_throttled;  // periods in which tasks were parked
+        uint64 throttled_cycles;
+    } stat;
+};
+
+static struct sched_group groups[NGROUP];
+static spinlock_t groups_lock;  // creating, destroying and joining groups
+
+static spinlock_t dl_bw_lock;
+static uint64 dl_bw_total;  // bandwidth of the SCHED_DEADLINE tasks, under dl_bw_lock
+static int sched_cpus;      // cpus that reached scheduler()
+
+// sched() switches straight to the next runnable process when there is one,
+// instead of going through scheduler() and back: one swtch per context switch instead of two.
+// A cpu goes through scheduler() again after this many direct switches in a row,
+// so that it still runs the RCU callbacks.
+#define DIRECT_SWITCH_MAX 8
 
 // defined in proc.c
 extern struct proc *pool[NPROC];
 
 void sched_init() {
-    init_queue(&task_queue);
+    for (int c = 0; c < NCPU; c++) {
+        for (int i = 0; i < NPRIO; i++)
+            init_queue(&rqs[c].levels[i]);
+        spinlock_init(&rqs[c].rt_lock, "rt");
+    }
+    spinlock_init(&dl_bw_lock, "dl_bw");
+    for (int i = 0; i < NGROUP; i++)
+        spinlock_init(&groups[i].lock, "sched_group");
+    spinlock_init(&groups_lock, "sched_groups");
+    groups[0].used = 1;
+}
+
+// nice 0 moves between all the levels. A positive nice keeps a task off the top ones,
+// a negative nice keeps it off the bottom ones: nice 19 always runs last, nice -20 always first.
+static int prio_top(int nice) {
+    return nice > 0 ? nice * (NPRIO - 1) / NICE_MAX : 0;
+}
+
+static int prio_bottom(int nice) {
+    return nice < 0 ? (NPRIO - 1) - nice * (NPRIO - 1) / NICE_MIN : NPRIO - 1;
+}
+
+static int sched_class(struct proc *p) {
+    return p->policy == SCHED_DEADLINE ? 0 : p->policy != SCHED_NORMAL ? 1 : 2;
+}
+
+// Whether a runs before b.
+static int task_before(struct proc *a, struct proc *b) {
+    int ca = sched_class(a), cb = sched_class(b);
+
+    if (ca != cb)
+        return ca < cb;
+    if (ca == 0)
+        return a->dl_deadline < b->dl_deadline;
+    if (ca == 1)
+        return a->rt_priority > b->rt_priority;
+    return a->prio < b->prio;
+}
+
+static uint64 us_to_cycles(uint64 us) {
+    return us * CPU_FREQ / 1000000;
+}
+
+static uint64 cycles_to_us(uint64 cycles) {
+    return cycles * 1000000 / CPU_FREQ;
+}
+
+// A fresh deadline, and a full runtime.
+static void dl_replenish(struct proc *p, uint64 now) {
+    p->dl_deadline = now + p->dl_rel_deadline;
+    p->dl_left     = p->dl_runtime;
+}
+
+// A task waking up keeps its deadline only if the runtime left does not exceed its bandwidth until then.
+static void dl_wakeup(struct proc *p, uint64 now) {
+    if (now >= p->dl_deadline || p->dl_left * p->dl_period > (p->dl_deadline - now) * p->dl_runtime)
+        dl_replenish(p, now);
+}
+
+static void group_join(struct proc *p, struct sched_group *g) {
+    __atomic_fetch_add(&g->nr_tasks, 1, __ATOMIC_RELAXED);
+    p->group = g;
+}
+
+static void group_leave(struct proc *p) {
+    __atomic_fetch_sub(&p->group->nr_tasks, 1, __ATOMIC_RELAXED);
+}
+
+// Charge delta cycles of p to its group and the groups above it.
+static void group_charge(struct proc *p, uint64 delta) {
+    for (struct sched_group *g = p->group; g != NULL; g = g->parent) {
+        __atomic_fetch_add(&g->stat.usage, delta, __ATOMIC_RELAXED);
+        if (g->quota != 0)
+            __atomic_fetch_sub(&g->runtime_left, delta, __ATOMIC_RELAXED);
+    }
 }
 
-static struct proc *fetch_task() {
-    struct proc *proc = pop_queue(&task_queue);
-    if (proc != NULL)
-        debugf("fetch task (pid=%d) from task queue", proc->pid);
-    return proc;
+// The nearest group of p, its own or an ancestor, that used up its quota. NULL if p may run.
+static struct sched_group *group_throttled(struct proc *p) {
+    if (p->policy != SCHED_NORMAL)
+        return NULL;
+    for (struct sched_group *g = p->group; g != NULL; g = g->parent) {
+        if (g->quota != 0 && __atomic_load_n(&g->runtime_left, __ATOMIC_RELAXED) <= 0)
+            return g;
+    }
+    return NULL;
+}
+
+// Charge the time p ran since the last call to its runtime.
+static void update_runtime(struct proc *p) {
+    uint64 now    = r_time();
+    int64 delta   = now - p->exec_start;
+    p->exec_start = now;
+    if (p->policy == SCHED_DEADLINE)
+        p->dl_left -= delta;
+    else if (p->policy == SCHED_NORMAL)
+        group_charge(p, delta);
+}
+
+// Scheduling state of a new task. Called with p->lock held.
+void sched_task_init(struct proc *p) {
+    p->policy       = SCHED_NORMAL;
+    p->cpus_allowed = CPUS_ALL;
+    p->last_cpu     = 0;
+    p->rt_priority  = 0;
+    p->dl_bw        = 0;
+    p->nice         = 0;
+    p->prio         = prio_top(0);
+    p->slice        = quantum[p->prio];
+    p->parked_in    = NULL;
+    group_join(p, &groups[0]);
+}
+
+// Keep p, a new task, on cpu. Called with p->lock held, before it is queued.
+void sched_bind(struct proc *p, int cpu) {
+    p->cpus_allowed = 1ull << cpu;
+    p->last_cpu     = cpu;
+}
+
+// Children inherit nice, and SCHED_FIFO or SCHED_RR. A SCHED_DEADLINE parent has a SCHED_NORMAL child,
+// which did not go through admission control.
+void sched_fork(struct proc *parent, struct proc *child) {
+    child->cpus_allowed = parent->cpus_allowed;
+    child->last_cpu     = parent->last_cpu;
+    child->nice         = parent->nice;
+    child->prio         = prio_top(child->nice);
+    if (parent->policy == SCHED_FIFO || parent->policy == SCHED_RR) {
+        child->policy      = parent->policy;
+        child->rt_priority = parent->rt_priority;
+    }
+    child->slice = child->policy == SCHED_RR ? RR_TICKS : quantum[child->prio];
+    group_leave(child);
+    group_join(child, parent->group);
+}
+
+// Give back the bandwidth of a freed SCHED_DEADLINE task. Called with p->lock held.
+void sched_task_exit(struct proc *p) {
+    if (p->dl_bw != 0) {
+        acquire(&dl_bw_lock);
+        dl_bw_total -= p->dl_bw;
+        release(&dl_bw_lock);
+        p->dl_bw = 0;
+    }
+    p->policy = SCHED_NORMAL;
+    group_leave(p);
+}
+
+static int cpu_allowed(struct proc *p, int cpu) {
+    return (p->cpus_allowed >> cpu) & 1;
+}
+
+static int cpu_online(int cpu) {
+    return __atomic_load_n(&getcpu(cpu)->sched_online, __ATOMIC_RELAXED);
+}
+
+// The first real-time task of rq that may run now on cpu. A throttled deadline task whose deadline passed
+// is replenished on the way. Called with rq->rt_lock held.
+static struct proc **rt_first(struct rq *rq, uint64 now, int cpu) {
+    struct proc **pp;
+
+    for (pp = &rq->rt_queue; *pp != NULL; pp = &(*pp)->rt_next) {
+        struct proc *p = *pp;
+        if (!cpu_allowed(p, cpu))
+            continue;
+        if (p->policy == SCHED_DEADLINE && p->dl_left <= 0) {
+            if (now < p->dl_deadline)
+                continue;
+            dl_replenish(p, now);
+        }
+        break;
+    }
+    return pp;
+}
+
+static struct proc *rt_fetch(struct rq *rq, int cpu) {
+    if (__atomic_load_n(&rq->rt_queue, __ATOMIC_RELAXED) == NULL)
+        return NULL;
+
+    acquire(&rq->rt_lock);
+    struct proc **pp = rt_first(rq, r_time(), cpu);
+    struct proc *p   = *pp;
+    if (p != NULL) {
+        *pp        = p->rt_next;
+        p->rt_next = NULL;
+        __atomic_fetch_sub(&rq->nr_queued, 1, __ATOMIC_RELAXED);
+    }
+    release(&rq->rt_lock);
+    return p;
+}
+
+// Whether a real-time task that runs before p is waiting on this cpu.
+static int rt_waiting_before(struct proc *p) {
+    int cpu       = mycpu()->cpuid;
+    struct rq *rq = &rqs[cpu];
+
+    if (__atomic_load_n(&rq->rt_queue, __ATOMIC_RELAXED) == NULL)
+        return 0;
+
+    acquire(&rq->rt_lock);
+    struct proc *q = *rt_first(rq, r_time(), cpu);
+    int ret        = q != NULL && task_before(q, p);
+    release(&rq->rt_lock);
+    return ret;
+}
+
+// Make c reschedule: at once if it runs in user space, else on its way back there.
+static void resched_cpu(struct cpu *c) {
+    __atomic_store_n(&c->need_resched, 1, __ATOMIC_RELAXED);
+    if (c != mycpu())
+        sbi_send_ipi(1, c->mhart_id);
+}
+
+// The cpu whose run queue gets p, looking at the other cpus without locks, as hints:
+//  - an idle cpu, the last one p ran on first, where its caches may still be warm.
+//  - for a real-time task, the cpu running the task that runs last, if p runs before it.
+//  - else the last cpu p ran on.
+// *preempt is set when that cpu should reschedule now.
+// Before the cpus reach scheduler(), everything goes to the last cpu, or the first allowed one.
+static int select_cpu(struct proc *p, int *preempt) {
+    struct proc *weakest = NULL;
+    int target = -1, last = p->last_cpu;
+
+    *preempt = 1;
+    for (int n = 0; n < NCPU; n++) {
+        int i         = (last + n) % NCPU;
+        struct cpu *c = getcpu(i);
+        if (!cpu_online(i) || !cpu_allowed(p, i))
+            continue;
+        struct proc *curr = __atomic_load_n(&c->proc, __ATOMIC_RELAXED);
+        if (curr == NULL && __atomic_load_n(&rqs[i].nr_queued, __ATOMIC_RELAXED) == 0)
+            return i;  // idle, maybe waiting for an interrupt.
+        if (p->policy != SCHED_NORMAL && curr != NULL && task_before(p, curr) &&
+            (weakest == NULL || task_before(weakest, curr))) {
+            target  = i;
+            weakest = curr;
+        }
+    }
+    if (target >= 0)
+        return target;
+
+    *preempt = 0;
+    if (cpu_allowed(p, last))
+        return last;
+    for (int i = 0; i < NCPU; i++) {
+        if (cpu_allowed(p, i) && cpu_online(i))
+            return i;
+    }
+    return __builtin_ctzll(p->cpus_allowed);
+}
+
+// Put p on the run queue of cpu.
+static void enqueue_on(struct proc *p, int cpu) {
+    struct rq *rq = &rqs[cpu];
+
+    p->queued_at = ticks;
+    p->rq_cpu    = cpu;
+    __atomic_fetch_add(&rq->nr_queued, 1, __ATOMIC_RELAXED);
+    if (p->policy == SCHED_NORMAL) {
+        push_queue(&rq->levels[p->prio], p);
+        return;
+    }
+
+    // after the tasks p does not run before: FIFO among equals.
+    acquire(&rq->rt_lock);
+    struct proc **pp = &rq->rt_queue;
+    while (*pp != NULL && !task_before(p, *pp))
+        pp = &(*pp)->rt_next;
+    p->rt_next = *pp;
+    *pp        = p;
+    release(&rq->rt_lock);
+}
+
+// Park p, RUNNABLE, on the throttled list of its group if it may not run. Return 1 if it was parked.
+static int throttle(struct proc *p) {
+    struct sched_group *g = group_throttled(p);
+
+    if (g == NULL)
+        return 0;
+    acquire(&g->lock);
+    int parked = __atomic_load_n(&g->runtime_left, __ATOMIC_RELAXED) <= 0;  // not refilled meanwhile
+    if (parked) {
+        if (g->throttled == NULL) {
+            g->throttled_at = r_time();
+            g->stat.nr_throttled++;
+        }
+        p->group_next = g->throttled;
+        p->parked_in  = g;
+        g->throttled  = p;
+    }
+    release(&g->lock);
+    if (parked)
+        debugf("throttle task (pid=%d) in group %d", p->pid, (int)(g - groups));
+    return parked;
+}
+
+// Take p off the throttled list it is parked on. Return 0 if it is not there.
+static int unpark(struct proc *p) {
+    struct sched_group *g = __atomic_load_n(&p->parked_in, __ATOMIC_RELAXED);
+    int found             = 0;
+
+    if (g == NULL)
+        return 0;
+    acquire(&g->lock);
+    for (struct proc **pp = &g->throttled; *pp != NULL; pp = &(*pp)->group_next) {
+        if (*pp == p) {
+            *pp          = p->group_next;
+            p->parked_in = NULL;
+            found        = 1;
+            break;
+        }
+    }
+    release(&g->lock);
+    return found;
+}
+
+static void enqueue(struct proc *p) {
+    int preempt;
+
+    if (throttle(p))
+        return;
+    int cpu = select_cpu(p, &preempt);
+
+    enqueue_on(p, cpu);
+    if (!preempt) {
+        // a task woken up on a higher level than the one running there.
+        struct proc *curr = __atomic_load_n(&getcpu(cpu)->proc, __ATOMIC_RELAXED);
+        preempt           = curr != NULL && curr != p && task_before(p, curr);
+    }
+    if (preempt)
+        resched_cpu(getcpu(cpu));
+}
+
+static int match_proc(void *item, void *arg) {
+    return item == arg;
+}
+
+// Take p, RUNNABLE, off its run queue or throttled list. Return 0 if it is not there any more:
+// a cpu took it to run it, or the balancer or a new period is moving it. Called with p->lock held.
+static int dequeue(struct proc *p) {
+    struct rq *rq = &rqs[p->rq_cpu];
+    int found     = 0;
+
+    if (unpark(p))
+        return 1;
+    if (p->policy == SCHED_NORMAL) {
+        found = pop_queue_match(&rq->levels[p->prio], match_proc, p) != NULL;
+    } else {
+        acquire(&rq->rt_lock);
+        for (struct proc **pp = &rq->rt_queue; *pp != NULL; pp = &(*pp)->rt_next) {
+            if (*pp == p) {
+                *pp   = p->rt_next;
+                found = 1;
+                break;
+            }
+        }
+        release(&rq->rt_lock);
+    }
+    if (found)
+        __atomic_fetch_sub(&rq->nr_queued, 1, __ATOMIC_RELAXED);
+    return found;
+}
+
+// Whether this cpu was asked to reschedule. Checked before returning to user space,
+// at the end of interrupts and when the last spinlock is released.
+int need_resched() {
+    return __atomic_load_n(&mycpu()->need_resched, __ATOMIC_RELAXED);
+}
+
+// Kernel preemption: a process running in the kernel holding no spinlock, with preemption not disabled,
+// may be switched out anywhere, as if it called yield(). It is, when this cpu is asked to reschedule:
+//  - at the end of an interrupt, see preempt_kernel(). A timer tick also counts against its quantum there.
+//  - when pop_off() turns interrupts back on, typically releasing the last spinlock.
+//  - in cond_resched(), for long loops that may run with interrupts off, like page faults.
+// Sleeping locks may be held: their waiters sleep, or spin only while the holder is running.
+
+static int preemptible(struct cpu *c) {
+    return c->proc != NULL && c->noff == 0 && c->preempt_count == 0 && !c->inkernel_trap;
+}
+
+// Yield if this cpu was asked to reschedule and the current process may be preempted.
+void preempt_schedule() {
+    int on = intr_get();
+
+    intr_off();
+    int resched = need_resched() && preemptible(mycpu());
+    if (on)
+        intr_on();
+    if (resched)
+        yield();
+}
+
+// Called at the end of kernel_trap() with interrupts off, when the code it interrupted had them on,
+// and so held no spinlock. tick is set for a timer interrupt.
+void preempt_kernel(int tick) {
+    struct cpu *c = mycpu();
+
+    if (!preemptible(c))
+        return;
+    if ((tick && sched_tick(c->proc)) || need_resched())
+        yield();
+}
+
+// A voluntary preemption point, for long loops in process context.
+// Does nothing with a spinlock held, so it is safe to call anywhere.
+void cond_resched() {
+    if (need_resched())
+        preempt_schedule();
+}
+
+struct fetch_arg {
+    int cpu;
+    int cold;  // only tasks that did not run for HOT_CYCLES, for the periodic balancer
+    uint64 now;
+};
+
+static int fetch_match(void *item, void *arg) {
+    struct proc *p      = item;
+    struct fetch_arg *a = arg;
+
+    return cpu_allowed(p, a->cpu) && (!a->cold || a->now - p->exec_start >= HOT_CYCLES);
+}
+
+static struct proc *fetch_level(struct rq *rq, int level, struct fetch_arg *arg) {
+    struct proc *p;
+
+    if (queue_empty(&rq->levels[level]))
+        return NULL;
+    if ((p = pop_queue_match(&rq->levels[level], fetch_match, arg)) != NULL)
+        __atomic_fetch_sub(&rq->nr_queued, 1, __ATOMIC_RELAXED);
+    return p;
+}
+
+// The next task of the run queue of cpu, throttled or not.
+static struct proc *fetch_queued(int cpu) {
+    struct rq *rq        = &rqs[cpu];
+    struct fetch_arg arg = {cpu, 0, 0};
+    struct proc *p;
+
+    if ((p = rt_fetch(rq, cpu)) != NULL) {
+        debugf("fetch real-time task (pid=%d)", p->pid);
+        return p;
+    }
+
+    // the oldest task of a level is at its head. The head may be taken meanwhile,
+    // then we run the next one of that level, which is fine.
+    for (int i = NPRIO - 1; i > 0; i--) {
+        p = peek_queue(&rq->levels[i]);
+        if (p != NULL && ticks - p->queued_at >= STARVE_TICKS && cpu_allowed(p, cpu) &&
+            (p = fetch_level(rq, i, &arg)) != NULL) {
+            debugf("fetch starving task (pid=%d) from level %d", p->pid, i);
+            return p;
+        }
+    }
+    for (int i = 0; i < NPRIO; i++) {
+        if ((p = fetch_level(rq, i, &arg)) != NULL) {
+            debugf("fetch task (pid=%d) from level %d", p->pid, i);
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// The next task of the run queue of cpu that may run. Those of throttled groups are parked on the way.
+static struct proc *fetch_task(int cpu) {
+    struct proc *p;
+
+    while ((p = fetch_queued(cpu)) != NULL && throttle(p))
+        ;
+    return p;
+}
+
+// Load balancing.
+// Each cpu keeps load_avg, the number of tasks it runs and queues, decayed by 7/8 every tick.
+// Every BALANCE_TICKS, a cpu whose load is lower than the busiest one by more than one task
+// pulls a task from it. It leaves the tasks that ran less than HOT_CYCLES ago: their caches are warm.
+// An idle cpu pulls any task allowed on it from the cpu with the most queued ones, hot or not.
+
+// A task of rq, allowed on cpu, best first. Called by the balancer.
+static struct proc *steal_from(struct rq *rq, int cpu, int cold) {
+    struct fetch_arg arg = {cpu, cold, r_time()};
+    struct proc *p;
+
+    if (!cold && (p = rt_fetch(rq, cpu)) != NULL)
+        return p;
+    for (int i = 0; i < NPRIO; i++) {
+        if ((p = fetch_level(rq, i, &arg)) != NULL)
+            return p;
+    }
+    return NULL;
+}
+
+// Move one task from busiest to cpu, and count it.
+static int pull_task(int busiest, int cpu, int cold) {
+    struct proc *p = steal_from(&rqs[busiest], cpu, cold);
+
+    if (p == NULL)
+        return 0;
+    debugf("migrate task (pid=%d) from cpu %d to %d", p->pid, busiest, cpu);
+    enqueue_on(p, cpu);
+    __atomic_fetch_add(&rqs[cpu].stat.migrations, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+// Called by an idle cpu with nothing queued. Return 1 if it has a task now.
+static int idle_balance(int cpu) {
+    int busiest = -1, most = 0;
+
+    for (int i = 0; i < NCPU; i++) {
+        int n = __atomic_load_n(&rqs[i].nr_queued, __ATOMIC_RELAXED);
+        if (i != cpu && n > most) {
+            busiest = i;
+            most    = n;
+        }
+    }
+    if (busiest < 0 || !pull_task(busiest, cpu, 0))
+        return 0;
+    __atomic_fetch_add(&rqs[cpu].stat.idle_pulls, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+static void periodic_balance(int cpu) {
+    struct rq *rq = &rqs[cpu];
+    int busiest   = -1;
+    uint64 most   = rq->load_avg + LOAD_SCALE;
+
+    rq->stat.balance_runs++;
+    for (int i = 0; i < NCPU; i++) {
+        uint64 load = __atomic_load_n(&rqs[i].load_avg, __ATOMIC_RELAXED);
+        if (i != cpu && cpu_online(i) && load > most && __atomic_load_n(&rqs[i].nr_queued, __ATOMIC_RELAXED) > 0) {
+            busiest = i;
+            most    = load;
+        }
+    }
+    if (busiest >= 0)
+        pull_task(busiest, cpu, 1);
+}
+
+// Start a new period for the groups whose period is over, and queue their parked tasks again.
+// They may be parked again at once, on an ancestor still throttled.
+static void group_refill(uint64 now) {
+    for (int i = 1; i < NGROUP; i++) {
+        struct sched_group *g = &groups[i];
+        struct proc *list     = NULL;
+
+        if (g->quota == 0 || now < __atomic_load_n(&g->period_end, __ATOMIC_RELAXED))
+            continue;
+        acquire(&g->lock);
+        if (g->quota != 0 && now >= g->period_end) {
+            uint64 n   = (now - g->period_end) / g->period + 1;
+            int64 left = MIN(g->runtime_left, 0) + (int64)g->quota;  // pay back the overrun
+            g->period_end += n * g->period;
+            g->stat.nr_periods += n;
+            __atomic_store_n(&g->runtime_left, left, __ATOMIC_RELAXED);
+            if (left > 0 && g->throttled != NULL) {
+                g->stat.throttled_cycles += now - g->throttled_at;
+                list         = g->throttled;
+                g->throttled = NULL;
+                for (struct proc *p = list; p != NULL; p = p->group_next)
+                    p->parked_in = NULL;
+            }
+        }
+        release(&g->lock);
+
+        while (list != NULL) {
+            struct proc *p = list;
+            list           = p->group_next;
+            acquire(&p->lock);
+            assert(p->state == RUNNABLE);
+            enqueue(p);
+            release(&p->lock);
+        }
+    }
+}
+
+// Called on every timer tick of this cpu, with interrupts off.
+void sched_timer_tick() {
+    struct cpu *c = mycpu();
+    struct rq *rq = &rqs[c->cpuid];
+
+    if (!c->sched_online)
+        return;
+    group_refill(r_time());
+    uint64 nr = __atomic_load_n(&rq->nr_queued, __ATOMIC_RELAXED) + (c->proc != NULL);
+    __atomic_store_n(&rq->load_avg, rq->load_avg - (rq->load_avg >> 3) + (nr * LOAD_SCALE >> 3), __ATOMIC_RELAXED);
+    if (++rq->balance_tick >= BALANCE_TICKS) {
+        rq->balance_tick = 0;
+        periodic_balance(c->cpuid);
+    }
+}
+
+// Copy the statistics of cpu i for KTEST_SCHEDSTAT. Return -EINVAL past the last cpu.
+int sched_stat(int i, struct schedstat_cpu *st) {
+    if (i < 0 || i >= NCPU)
+        return -EINVAL;
+    struct rq *rq    = &rqs[i];
+    st->online       = cpu_online(i);
+    st->nr_queued    = __atomic_load_n(&rq->nr_queued, __ATOMIC_RELAXED);
+    st->load_avg     = __atomic_load_n(&rq->load_avg, __ATOMIC_RELAXED);
+    st->migrations   = __atomic_load_n(&rq->stat.migrations, __ATOMIC_RELAXED);
+    st->idle_pulls   = __atomic_load_n(&rq->stat.idle_pulls, __ATOMIC_RELAXED);
+    st->balance_runs = __atomic_load_n(&rq->stat.balance_runs, __ATOMIC_RELAXED);
+    return 0;
+}
+
+// Called with p->lock held, when p is picked to run.
+static void start_task(struct proc *p) {
+    p->exec_start = r_time();
+    p->last_cpu   = mycpu()->cpuid;
+    if (p->policy == SCHED_NORMAL && ticks - p->queued_at >= STARVE_TICKS && p->prio > prio_top(p->nice)) {
+        p->prio  = prio_top(p->nice);
+        p->slice = quantum[p->prio];
+    }
 }
 
 void add_task(struct proc *p) {
     assert(p->state == RUNNABLE);
     assert(holding(&p->lock));
 
-    push_queue(&task_queue, p);
-    debugf("add task (pid=%d) to task queue", p->pid);
+    enqueue(p);
+    debugf("add task (pid=%d) to cpu %d, level %d, policy %d", p->pid, p->rq_cpu, p->prio, p->policy);
+}
+
+// Queue p again, after its scheduling parameters changed. Called with p->lock held.
+static void requeue(struct proc *p) {
+    if (p->state == RUNNABLE && dequeue(p))
+        enqueue(p);
+}
+
+// Make p, sleeping, runnable again, one level up since it did not use up its quantum.
+// Called with p->lock held.
+void wake_task(struct proc *p) {
+    assert(p->state == SLEEPING);
+
+    if (p->policy == SCHED_DEADLINE) {
+        dl_wakeup(p, r_time());
+    } else if (p->policy == SCHED_NORMAL) {
+        if (p->prio > prio_top(p->nice))
+            p->prio--;
+        p->slice = quantum[p->prio];
+    }
+    p->state = RUNNABLE;
+    add_task(p);
+}
+
+// Called on each timer tick that interrupts p in user space, or in the kernel where p may be preempted.
+// Return 1 if p should yield: it used up its quantum or runtime, or a task that runs before it is waiting.
+// The scheduling fields of a running task are only written by its own cpu, or with p->lock held.
+int sched_tick(struct proc *p) {
+    update_runtime(p);
+    if (!cpu_allowed(p, mycpu()->cpuid))
+        return 1;  // its affinity changed while it was being picked
+    switch (p->policy) {
+        case SCHED_DEADLINE:
+            return p->dl_left <= 0 || rt_waiting_before(p);
+        case SCHED_RR:
+            if (--p->slice <= 0) {
+                p->slice = RR_TICKS;
+                return 1;
+            }
+            return rt_waiting_before(p);
+        case SCHED_FIFO:
+            return rt_waiting_before(p);
+    }
+
+    if (rt_waiting_before(p) || group_throttled(p) != NULL)
+        return 1;
+    if (--p->slice <= 0) {
+        if (p->prio < prio_bottom(p->nice))
+            p->prio++;
+        p->slice = quantum[p->prio];
+        return 1;
+    }
+    struct rq *rq = &rqs[mycpu()->cpuid];
+    for (int i = 0; i < p->prio; i++) {
+        if (!queue_empty(&rq->levels[i]))
+            return 1;
+    }
+    return 0;
+}
+
+// Set the nice value of task pid, 0 for ourselves.
+int setpriority(int pid, int nice) {
+    int ret = -EINVAL;
+
+    nice = MAX(NICE_MIN, MIN(nice, NICE_MAX));
+    rcu_read_lock();
+    struct proc *p = pid == 0 ? curr_proc() : find_proc(pid);
+    if (p != NULL) {
+        acquire(&p->lock);
+        if (p->state != UNUSED && (pid == 0 || p->pid == pid)) {
+            int queued = p->state == RUNNABLE && dequeue(p);
+            p->nice    = nice;
+            p->prio    = MAX(prio_top(nice), MIN(p->prio, prio_bottom(nice)));
+            if (queued)
+                enqueue(p);
+            ret = 0;
+        }
+        release(&p->lock);
+    }
+    rcu_read_unlock();
+    return ret;
+}
+
+// Set the policy and its parameters of task pid, 0 for ourselves.
+// Return -EBUSY if admission control rejects a SCHED_DEADLINE task.
+int sched_setattr(int pid, struct sched_attr *attr) {
+    uint64 runtime = 0, deadline = 0, period = 0, bw = 0;
+    int ret        = -EINVAL;
+
+    switch (attr->policy) {
+        case SCHED_NORMAL:
+            break;
+        case SCHED_FIFO:
+        case SCHED_RR:
+            if (attr->priority < SCHED_PRIO_MIN || attr->priority > SCHED_PRIO_MAX)
+                return -EINVAL;
+            break;
+        case SCHED_DEADLINE:
+            runtime  = us_to_cycles(attr->runtime);
+            deadline = us_to_cycles(attr->deadline);
+            period   = us_to_cycles(attr->period ? attr->period : attr->deadline);
+            if (runtime == 0 || runtime > deadline || deadline > period)
+                return -EINVAL;
+            bw = (runtime << BW_SHIFT) / period;
+            break;
+        default:
+            return -EINVAL;
+    }
+
+    rcu_read_lock();
+    struct proc *p = pid == 0 ? curr_proc() : find_proc(pid);
+    if (p != NULL) {
+        acquire(&p->lock);
+        if (p->state != UNUSED && (pid == 0 || p->pid == pid)) {
+            acquire(&dl_bw_lock);
+            uint64 limit = ((uint64)sched_cpus * DL_BW_MAX << BW_SHIFT) / 100;
+            if (dl_bw_total - p->dl_bw + bw > limit) {
+                ret = -EBUSY;
+            } else {
+                dl_bw_total = dl_bw_total - p->dl_bw + bw;
+                p->dl_bw    = bw;
+                ret         = 0;
+            }
+            release(&dl_bw_lock);
+        }
+        if (ret == 0) {
+            // the queue of a task depends on its policy.
+            int queued = p->state == RUNNABLE && dequeue(p);
+            p->policy  = attr->policy;
+            if (attr->policy == SCHED_NORMAL) {
+                p->nice  = MAX(NICE_MIN, MIN(attr->nice, NICE_MAX));
+                p->prio  = prio_top(p->nice);
+                p->slice = quantum[p->prio];
+            } else if (attr->policy == SCHED_DEADLINE) {
+                p->dl_runtime      = runtime;
+                p->dl_rel_deadline = deadline;
+                p->dl_period       = period;
+                dl_replenish(p, r_time());
+            } else {
+                p->rt_priority = attr->priority;
+                p->slice       = RR_TICKS;
+            }
+            if (queued)
+                enqueue(p);
+        }
+        release(&p->lock);
+    }
+    rcu_read_unlock();
+    return ret;
+}
+
+int sched_getattr(int pid, struct sched_attr *attr) {
+    int ret = -EINVAL;
+
+    rcu_read_lock();
+    struct proc *p = pid == 0 ? curr_proc() : find_proc(pid);
+    if (p != NULL) {
+        acquire(&p->lock);
+        if (p->state != UNUSED && (pid == 0 || p->pid == pid)) {
+            attr->policy   = p->policy;
+            attr->nice     = p->nice;
+            attr->priority = p->rt_priority;
+            attr->runtime  = 0;
+            attr->deadline = 0;
+            attr->period   = 0;
+            if (p->policy == SCHED_DEADLINE) {
+                attr->runtime  = cycles_to_us(p->dl_runtime);
+                attr->deadline = cycles_to_us(p->dl_rel_deadline);
+                attr->period   = cycles_to_us(p->dl_period);
+            }
+            ret = 0;
+        }
+        release(&p->lock);
+    }
+    rcu_read_unlock();
+    return ret;
+}
+
+// Restrict task pid, 0 for ourselves, to the cpus in mask. At least one of them must be online.
+// A task running on a cpu left out moves at its next return to user space.
+// Kernel threads keep the cpus they were created for: the workers serve the queue of theirs.
+int sched_setaffinity(int pid, uint64 mask) {
+    uint64 online = 0;
+    int ret       = -EINVAL;
+
+    for (int i = 0; i < NCPU; i++) {
+        if (cpu_online(i))
+            online |= 1ull << i;
+    }
+    if ((mask & online) == 0)
+        return -EINVAL;
+
+    rcu_read_lock();
+    struct proc *p = pid == 0 ? curr_proc() : find_proc(pid);
+    if (p != NULL) {
+        acquire(&p->lock);
+        if (p->state != UNUSED && (pid == 0 || p->pid == pid) && p->kthread == NULL) {
+            p->cpus_allowed = mask & CPUS_ALL;
+            if (p->state == RUNNING && !cpu_allowed(p, p->last_cpu))
+                resched_cpu(getcpu(p->last_cpu));
+            else if (p->state == RUNNABLE && !cpu_allowed(p, p->rq_cpu))
+                requeue(p);
+            ret = 0;
+        }
+        release(&p->lock);
+    }
+    rcu_read_unlock();
+    return ret;
+}
+
+int sched_getaffinity(int pid, uint64 *mask) {
+    int ret = -EINVAL;
+
+    rcu_read_lock();
+    struct proc *p = pid == 0 ? curr_proc() : find_proc(pid);
+    if (p != NULL) {
+        acquire(&p->lock);
+        if (p->state != UNUSED && (pid == 0 || p->pid == pid)) {
+            *mask = p->cpus_allowed;
+            ret   = 0;
+        }
+        release(&p->lock);
+    }
+    rcu_read_unlock();
+    return ret;
+}
+
+// Create a group under group parent, that gets quota_us of cpu time every period_us, or no limit if quota_us is 0.
+// The quota may exceed the period, for tasks running on several cpus. Return the id of the group.
+int sched_group_create(int parent, uint64 quota_us, uint64 period_us) {
+    int ret = -EINVAL;
+
+    if (parent < 0 || parent >= NGROUP || period_us < GROUP_PERIOD_MIN || period_us > GROUP_PERIOD_MAX)
+        return -EINVAL;
+    if (quota_us != 0 && (quota_us < GROUP_PERIOD_MIN || quota_us > NCPU * period_us))
+        return -EINVAL;
+
+    acquire(&groups_lock);
+    if (groups[parent].used) {
+        ret = -ENOMEM;
+        for (int i = 1; i < NGROUP; i++) {
+            struct sched_group *g = &groups[i];
+            if (g->used)
+                continue;
+            memset(&g->stat, 0, sizeof(g->stat));
+            g->parent       = &groups[parent];
+            g->nr_children  = 0;
+            g->throttled    = NULL;
+            g->period       = us_to_cycles(period_us);
+            g->runtime_left = us_to_cycles(quota_us);
+            g->period_end   = r_time() + g->period;
+            __atomic_store_n(&g->quota, us_to_cycles(quota_us), __ATOMIC_RELEASE);
+            g->used = 1;
+            groups[parent].nr_children++;
+            ret = i;
+            break;
+        }
+    }
+    release(&groups_lock);
+    return ret;
+}
+
+// Remove group id. Return -EBUSY while it has tasks or groups.
+int sched_group_destroy(int id) {
+    int ret = -EINVAL;
+
+    if (id <= 0 || id >= NGROUP)
+        return -EINVAL;
+    acquire(&groups_lock);
+    struct sched_group *g = &groups[id];
+    if (g->used) {
+        if (__atomic_load_n(&g->nr_tasks, __ATOMIC_RELAXED) != 0 || g->nr_children != 0) {
+            ret = -EBUSY;
+        } else {
+            __atomic_store_n(&g->quota, 0, __ATOMIC_RELAXED);
+            g->used = 0;
+            g->parent->nr_children--;
+            ret = 0;
+        }
+    }
+    release(&groups_lock);
+    return ret;
+}
+
+// Move task pid, 0 for ourselves, to group id. A running task is throttled at its next tick,
+// a queued one is parked right away if group id is throttled. Kernel threads are never throttled.
+int sched_group_attach(int id, int pid) {
+    int ret = -EINVAL;
+
+    if (id < 0 || id >= NGROUP)
+        return -EINVAL;
+    acquire(&groups_lock);
+    if (groups[id].used) {
+        rcu_read_lock();
+        struct proc *p = pid == 0 ? curr_proc() : find_proc(pid);
+        if (p != NULL) {
+            acquire(&p->lock);
+            if (p->state != UNUSED && (pid == 0 || p->pid == pid) && p->kthread == NULL) {
+                int queued = p->state == RUNNABLE && dequeue(p);
+                group_leave(p);
+                group_join(p, &groups[id]);
+                if (queued)
+                    enqueue(p);
+                ret = 0;
+            }
+            release(&p->lock);
+        }
+        rcu_read_unlock();
+    }
+    release(&groups_lock);
+    return ret;
+}
+
+int sched_group_stat(int id, struct sched_group_stat *st) {
+    int ret = -EINVAL;
+
+    if (id < 0 || id >= NGROUP)
+        return -EINVAL;
+    acquire(&groups_lock);
+    struct sched_group *g = &groups[id];
+    if (g->used) {
+        st->quota          = cycles_to_us(g->quota);
+        st->period         = cycles_to_us(g->period);
+        st->usage          = cycles_to_us(__atomic_load_n(&g->stat.usage, __ATOMIC_RELAXED));
+        st->nr_periods     = g->stat.nr_periods;
+        st->nr_throttled   = g->stat.nr_throttled;
+        st->throttled_time = cycles_to_us(g->stat.throttled_cycles);
+        st->nr_tasks       = __atomic_load_n(&g->nr_tasks, __ATOMIC_RELAXED);
+        st->nr_children    = g->nr_children;
+        ret                = 0;
+    }
+    release(&groups_lock);
+    return ret;
+}
+
+// Return the nice value of task pid, 0 for ourselves, in *nice.
+int getpriority(int pid, int *nice) {
+    int ret = -EINVAL;
+
+    rcu_read_lock();
+    struct proc *p = pid == 0 ? curr_proc() : find_proc(pid);
+    if (p != NULL) {
+        acquire(&p->lock);
+        if (p->state != UNUSED && (pid == 0 || p->pid == pid)) {
+            *nice = p->nice;
+            ret   = 0;
+        }
+        release(&p->lock);
+    }
+    rcu_read_unlock();
+    return ret;
 }
 
 static int all_dead() {
@@ -59,44 +1105,101 @@ void scheduler() {
     // If this scheduler finds any possible process to run, it will switch to it.
     // 	And the scheduler context is saved on "mycpu()->sched_context"
 
+    // software interrupts are the reschedule IPIs, see resched_cpu().
+    w_sie(r_sie() | SIE_SSIE);
+    __atomic_fetch_add(&sched_cpus, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&c->sched_online, 1, __ATOMIC_RELAXED);
+
     for (;;) {
         // intr may be on here.
 
-        p = fetch_task();
+        // between two processes: a quiescent state for RCU.
+        rcu_quiescent();
+
+        // a task that fetch_direct could not lock comes first: it is off the run queues.
+        if ((p = c->handoff) != NULL)
+            c->handoff = NULL;
+        else
+            p = fetch_task(c->cpuid);
+        if (p == NULL && idle_balance(c->cpuid))
+            p = fetch_task(c->cpuid);
         if (p == NULL) {
-            // if we cannot find a process in the task_queue
+            // if we cannot find a process in the run queues
             //  maybe some processes are SLEEPING and some are RUNNABLE
             if (all_dead()) {
                 panic("[cpu %d] scheduler dead.", c->cpuid);
             } else {
                 // nothing to run; stop running on this core until an interrupt.
+                rcu_idle_enter();
                 intr_on();
                 asm volatile("wfi");
                 intr_off();
+                rcu_idle_exit();
                 continue;
             }
         }
 
         acquire(&p->lock);
         assert(p->state == RUNNABLE);
+        start_task(p);
         debugf("switch to proc %d(%d)", p->index, p->pid);
-        p->state = RUNNING;
-        c->proc  = p;
+        p->state        = RUNNING;
+        c->proc         = p;
+        c->need_resched = 0;
         swtch(&c->sched_context, &p->context);
 
         // When we get back here, someone must have called swtch(..., &c->sched_context);
-        assert(c->proc == p);
+        // after direct switches, it may not be p.
+        p = c->proc;
         assert(!intr_get());        // scheduler should never have intr_on()
         assert(holding(&p->lock));  // whoever switch to us must acquire p->lock
-        c->proc = NULL;
+        c->proc            = NULL;
+        c->direct_switches = 0;
 
         if (p->state == RUNNABLE) {
             add_task(p);
+        } else if (p->state == ZOMBIE && p->group_leader != p) {
+            // nobody waits for a thread, free it now that we are off its stack.
+            thread_reap(p);
         }
         release(&p->lock);
     }
 }
 
+// Pick the process to switch to directly from sched(), and lock it.
+// We hold p->lock already: only try the lock of next, the cpu holding it may be waiting for ours.
+// When it is busy, next is not ours to queue again without its lock: scheduler() runs it instead,
+// and waits for the lock there.
+static struct proc *fetch_direct(struct proc *p) {
+    struct cpu *c = mycpu();
+
+    if (p->state == ZOMBIE || c->direct_switches >= DIRECT_SWITCH_MAX)
+        return NULL;  // a zombie thread is reaped by scheduler(), off its stack
+
+    struct proc *next = fetch_task(c->cpuid);
+    if (next == NULL)
+        return NULL;
+    if (!try_acquire(&next->lock)) {
+        c->handoff = next;
+        return NULL;
+    }
+    assert(next->state == RUNNABLE);
+    start_task(next);
+    return next;
+}
+
+// Called right after the swtch that started running p: when it came from another process
+// instead of scheduler(), that process is still locked, release it.
+void finish_switch() {
+    struct cpu *c     = mycpu();
+    struct proc *prev = c->switch_prev;
+
+    if (prev != NULL) {
+        c->switch_prev = NULL;
+        release(&prev->lock);
+    }
+}
+
 // Switch to scheduler.  Must hold only p->lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
@@ -112,6 +1215,8 @@ void sched() {
         panic("not holding p->lock");
     if (mycpu()->noff != 1)
         panic("holding another locks");
+    if (mycpu()->preempt_count)
+        panic("sched with preemption disabled");
     if (p->state == RUNNING)
         panic("sched running process");
     if (mycpu()->inkernel_trap)
@@ -119,8 +1224,30 @@ void sched() {
     assert(!intr_get());
 
     interrupt_on = mycpu()->interrupt_on;
-    debugf("switch to scheduler %d(%d)", p->index, p->pid);
-    swtch(&p->context, &mycpu()->sched_context);
+    fpu_switch_out(p);
+    update_runtime(p);
+    mycpu()->need_resched = 0;
+
+    struct proc *next = fetch_direct(p);
+    if (next != NULL) {
+        // next starts with both locks held, and releases ours in finish_switch(), once we are off our stack.
+        // We may be queued before that, whoever picks us waits for our lock.
+        struct cpu *c = mycpu();
+        debugf("switch from %d(%d) to %d(%d)", p->index, p->pid, next->index, next->pid);
+        // no pass through scheduler(): report the quiescent state here.
+        rcu_quiescent_locked();
+        if (p->state == RUNNABLE)
+            add_task(p);
+        next->state    = RUNNING;
+        c->proc        = next;
+        c->switch_prev = p;
+        c->direct_switches++;
+        swtch(&p->context, &next->context);
+    } else {
+        debugf("switch to scheduler %d(%d)", p->index, p->pid);
+        swtch(&p->context, &mycpu()->sched_context);
+    }
+    finish_switch();
     mycpu()->interrupt_on = interrupt_on;
 
     // if scheduler returns here: p->lock must be holding.
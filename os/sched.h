@@ -0,0 +1,42 @@
+// This file is shared by Kernel and User-space application.
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include "types.h"
+
+// Scheduling policies, in sched_attr.policy. The real-time ones run before any SCHED_NORMAL task.
+#define SCHED_NORMAL   0  // the multi-level feedback queue, tuned by nice
+#define SCHED_FIFO     1  // static priority, runs until it blocks or a higher priority task is runnable
+#define SCHED_RR       2  // as SCHED_FIFO, and tasks of the same priority take turns
+#define SCHED_DEADLINE 3  // runtime every period, before deadline, earliest deadline first. Runs before the others.
+
+#define SCHED_PRIO_MIN 1  // SCHED_FIFO and SCHED_RR priorities, higher runs first
+#define SCHED_PRIO_MAX 99
+
+struct sched_attr {
+    uint32 policy;
+    int32 nice;       // SCHED_NORMAL
+    uint32 priority;  // SCHED_FIFO, SCHED_RR
+    // SCHED_DEADLINE, in microseconds: 0 < runtime <= deadline <= period. A period of 0 means deadline.
+    uint64 runtime;
+    uint64 deadline;
+    uint64 period;
+};
+
+// Bandwidth groups, see sched_group_create. Group 0 is the root, where the first process starts.
+#define SCHED_GROUP_ROOT 0
+
+// Times in microseconds.
+struct sched_group_stat {
+    uint64 quota;  // per period, 0 for no limit
+    uint64 period;
+    uint64 usage;           // cpu time used by the tasks of the group and of the groups below it
+    uint64 nr_periods;
+    uint64 nr_throttled;    // periods in which tasks waited for the next one
+    uint64 throttled_time;  // spent with tasks waiting
+    uint32 nr_tasks;
+    uint32 nr_children;
+};
+
+#endif  // SCHED_H
@@ -86,12 +86,10 @@ int do_signal(void) {
                 uint64 new_sp = tf->sp - sizeof(struct trapframe) - sizeof(sigset_t);
                 // 将 trapframe 和 oldmask 分两次拷贝到用户栈
                 sigset_t oldmask = p->signal.sigmask;
-                acquire(&p->mm->lock);
                 // 复制trapframe到用户栈
                 copy_to_user(p->mm, new_sp, (char *)tf, sizeof(struct trapframe));
                 // 复制oldmask到用户栈
                 copy_to_user(p->mm, new_sp + sizeof(struct trapframe), (char *)&oldmask, sizeof(sigset_t));
-                release(&p->mm->lock);
                 // 处理信号
                 p->signal.sigmask |= sa->sa_mask;
                 sigaddset(&p->signal.sigmask, signo);
@@ -113,7 +111,6 @@ int do_signal(void) {
 
 int sys_sigaction(int signo, const sigaction_t __user *act, sigaction_t __user *oldact) {
     struct proc *p = curr_proc();
-    acquire(&p->mm->lock);
     if (oldact) {
         copy_to_user(p->mm, (uint64)oldact, (char *)&p->signal.sa[signo], sizeof(sigaction_t));
     }
@@ -122,7 +119,6 @@ int sys_sigaction(int signo, const sigaction_t __user *act, sigaction_t __user *
         copy_from_user(p->mm, (char *)&sa, (uint64)act, sizeof(sigaction_t));
         p->signal.sa[signo] = sa;
     }
-    release(&p->mm->lock);
     return 0;
 }
 
@@ -130,19 +126,16 @@ int sys_sigreturn() {
     struct proc *p       = curr_proc();
     struct trapframe *tf = p->trapframe;
     sigset_t oldmask;
-    acquire(&p->mm->lock);
     // 从用户栈复制trapframe
     copy_from_user(p->mm, (char *)tf, tf->sp, sizeof(struct trapframe));
     // 从用户栈复制oldmask
     copy_from_user(p->mm, (char *)&oldmask, tf->sp + sizeof(struct trapframe), sizeof(sigset_t));
-    release(&p->mm->lock);
     p->signal.sigmask = oldmask;
     return 0;
 }
 
 int sys_sigprocmask(int how, const sigset_t __user *set, sigset_t __user *oldset) {
     struct proc *p = curr_proc();
-    acquire(&p->mm->lock);
     if (oldset) {
         copy_to_user(p->mm, (uint64)oldset, (char *)&p->signal.sigmask, sizeof(sigset_t));
     }
@@ -164,26 +157,20 @@ int sys_sigprocmask(int how, const sigset_t __user *set, sigset_t __user *oldset
             default:
         }
     }
-    release(&p->mm->lock);
     return 0;
 }
 
 int sys_sigpending(sigset_t __user *set) {
     struct proc *p = curr_proc();
-    acquire(&p->mm->lock);
     copy_to_user(p->mm, (uint64)set, (char *)&p->signal.sigpending, sizeof(sigset_t));
-    release(&p->mm->lock);
     return 0;
 }
 
 int sys_sigkill(int pid, int signo, int code) {
-    struct proc *p;
-    for (int i = 0; i < NPROC; i++) {
-        p = pool[i];
-        if (p->pid == pid && p->state != UNUSED) {
-            sigaddset(&p->signal.sigpending, signo);
-            return 0;
-        }
-    }
-    return -1;
+    rcu_read_lock();
+    struct proc *p = find_proc(pid);
+    if (p != NULL)
+        sigaddset(&p->signal.sigpending, signo);
+    rcu_read_unlock();
+    return p != NULL ? 0 : -1;
 }
\ No newline at end of file
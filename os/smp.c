@@ -5,6 +5,10 @@
 
 static struct cpu cpus[NCPU];
 
+// Harts that booted, set by the boot hart before the others leave secondarycpu_init.
+// Their cpuids are 0 .. nr_cpus - 1.
+int nr_cpus = 1;
+
 struct cpu* mycpu() {
     assert(!intr_get());
     int id = cpuid();
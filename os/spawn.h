@@ -0,0 +1,18 @@
+// This file is shared by Kernel and User-space application.
+
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include "signal/signal.h"
+
+// spawn() attributes, in spawnattr.flags
+#define SPAWN_SETSIGMASK 0x1  // the child starts with sigmask, instead of the parent's mask
+#define SPAWN_SETSIGDEF  0x2  // signals in sigdefault are reset to SIG_DFL in the child
+
+struct spawnattr {
+    uint64 flags;
+    sigset_t sigmask;
+    sigset_t sigdefault;
+};
+
+#endif  // SPAWN_H
@@ -1,13 +1,42 @@
 #include "string.h"
-#include "types.h"
+#include "fdt.h"
+#include "riscv.h"
+
+// The hot functions below work a machine word (8 bytes) at a time once the pointers are aligned.
+// RISC-V may trap on misaligned word accesses (OpenSBI then emulates them, very slowly),
+// so the word loops only run when both pointers can be aligned at the same time,
+// otherwise they fall back to bytes.
+
+#define WSIZE       sizeof(uint64)
+#define WMASK       (WSIZE - 1)
+#define ONES        0x0101010101010101ull
+#define HIGHS       0x8080808080808080ull
+#define HASZERO(w)  (((w) - ONES) & ~(w) & HIGHS)
 
 void *memset(void *dst, int c, uint n)
 {
-	char *cdst = (char *)dst;
-	int i;
-	for (i = 0; i < n; i++) {
-		cdst[i] = c;
+	uchar *d = (uchar *)dst;
+
+	if (n >= 2 * WSIZE) {
+		uint64 w = (uchar)c * ONES;
+
+		while ((uint64)d & WMASK) {
+			*d++ = c;
+			n--;
+		}
+		uint64 *wd = (uint64 *)d;
+		for (; n >= 4 * WSIZE; n -= 4 * WSIZE, wd += 4) {
+			wd[0] = w;
+			wd[1] = w;
+			wd[2] = w;
+			wd[3] = w;
+		}
+		for (; n >= WSIZE; n -= WSIZE)
+			*wd++ = w;
+		d = (uchar *)wd;
 	}
+	while (n-- > 0)
+		*d++ = c;
 	return dst;
 }
 
@@ -17,6 +46,18 @@ int memcmp(const void *v1, const void *v2, uint n)
 
 	s1 = v1;
 	s2 = v2;
+	if (n >= 2 * WSIZE && (((uint64)s1 ^ (uint64)s2) & WMASK) == 0) {
+		while ((uint64)s1 & WMASK) {
+			if (*s1 != *s2)
+				return *s1 - *s2;
+			s1++, s2++, n--;
+		}
+		// skip equal words, the bytes loop below locates the first difference.
+		while (n >= WSIZE && *(const uint64 *)s1 == *(const uint64 *)s2) {
+			s1 += WSIZE, s2 += WSIZE;
+			n -= WSIZE;
+		}
+	}
 	while (n-- > 0) {
 		if (*s1 != *s2)
 			return *s1 - *s2;
@@ -26,21 +67,69 @@ int memcmp(const void *v1, const void *v2, uint n)
 	return 0;
 }
 
+static void copy_forward(uchar *d, const uchar *s, uint n)
+{
+	if (n >= 2 * WSIZE && (((uint64)d ^ (uint64)s) & WMASK) == 0) {
+		while ((uint64)d & WMASK) {
+			*d++ = *s++;
+			n--;
+		}
+		uint64 *wd = (uint64 *)d;
+		const uint64 *ws = (const uint64 *)s;
+		for (; n >= 4 * WSIZE; n -= 4 * WSIZE, wd += 4, ws += 4) {
+			uint64 a = ws[0], b = ws[1], c = ws[2], e = ws[3];
+			wd[0] = a;
+			wd[1] = b;
+			wd[2] = c;
+			wd[3] = e;
+		}
+		for (; n >= WSIZE; n -= WSIZE)
+			*wd++ = *ws++;
+		d = (uchar *)wd;
+		s = (const uchar *)ws;
+	}
+	while (n-- > 0)
+		*d++ = *s++;
+}
+
+// d and s point one past the end of the buffers.
+static void copy_backward(uchar *d, const uchar *s, uint n)
+{
+	if (n >= 2 * WSIZE && (((uint64)d ^ (uint64)s) & WMASK) == 0) {
+		while ((uint64)d & WMASK) {
+			*--d = *--s;
+			n--;
+		}
+		uint64 *wd = (uint64 *)d;
+		const uint64 *ws = (const uint64 *)s;
+		for (; n >= 4 * WSIZE; n -= 4 * WSIZE) {
+			wd -= 4, ws -= 4;
+			uint64 a = ws[3], b = ws[2], c = ws[1], e = ws[0];
+			wd[3] = a;
+			wd[2] = b;
+			wd[1] = c;
+			wd[0] = e;
+		}
+		for (; n >= WSIZE; n -= WSIZE)
+			*--wd = *--ws;
+		d = (uchar *)wd;
+		s = (const uchar *)ws;
+	}
+	while (n-- > 0)
+		*--d = *--s;
+}
+
 void *memmove(void *dst, const void *src, uint n)
 {
-	const char *s;
-	char *d;
+	const uchar *s;
+	uchar *d;
 
 	s = src;
 	d = dst;
-	if (s < d && s + n > d) {
-		s += n;
-		d += n;
-		while (n-- > 0)
-			*--d = *--s;
-	} else
-		while (n-- > 0)
-			*d++ = *s++;
+	if (s < d && s + n > d)
+		copy_backward(d + n, s + n, n);
+	else
+		copy_forward(d, s, n);
 
 	return dst;
 }
@@ -88,13 +177,77 @@ char *safestrcpy(char *s, const char *t, int n)
 
 int strlen(const char *s)
 {
-	int n;
+	const char *p = s;
 
-	for (n = 0; s[n]; n++)
+	while ((uint64)p & WMASK) {
+		if (*p == '\0')
+			return p - s;
+		p++;
+	}
+	// an aligned word never crosses a page boundary, so reading past the NUL is safe.
+	const uint64 *w = (const uint64 *)p;
+	while (!HASZERO(*w))
+		w++;
+	for (p = (const char *)w; *p; p++)
 		;
-	return n;
+	return p - s;
+}
+
+// Page zeroing, selected at boot by string_init().
+
+static void pagezero_words(void *page)
+{
+	uint64 *w = (uint64 *)page;
+	for (int i = 0; i < PGSIZE / WSIZE; i += 8) {
+		w[i + 0] = 0;
+		w[i + 1] = 0;
+		w[i + 2] = 0;
+		w[i + 3] = 0;
+		w[i + 4] = 0;
+		w[i + 5] = 0;
+		w[i + 6] = 0;
+		w[i + 7] = 0;
+	}
+}
+
+static uint64 cboz_block_size;
+
+// Zicboz: cbo.zero clears a whole cache block without reading it first.
+static void pagezero_cboz(void *page)
+{
+	for (uint64 p = (uint64)page; p < (uint64)page + PGSIZE; p += cboz_block_size) {
+		// cbo.zero (p), encoded with .insn since the toolchain targets rv64g.
+		asm volatile(".insn i 0x0f, 2, x0, %0, 4" ::"r"(p) : "memory");
+	}
+}
+
+static void (*pagezero_impl)(void *) = pagezero_words;
+
+// Zero a whole, page-aligned page.
+void pagezero(void *page)
+{
+	pagezero_impl(page);
+}
+
+// Pick the fastest variants for the ISA extensions found in the device tree.
+void string_init()
+{
+	uint64 bs = fdt_cboz_block_size;
+	if ((isa_extensions & ISA_EXT_ZICBOZ) && bs >= 16 && IS_ALIGNED(bs, 16) && bs <= PGSIZE && IS_ALIGNED(PGSIZE, bs)) {
+		cboz_block_size = bs;
+		pagezero_impl   = pagezero_cboz;
+	}
+}
+
+// Used by the string benchmark.
+void pagezero_variant(int which, void *page)
+{
+	if (which == PAGEZERO_CBOZ && pagezero_impl == pagezero_cboz)
+		pagezero_cboz(page);
+	else
+		pagezero_words(page);
 }
 
 void dummy(int _, ...)
 {
-}
\ No newline at end of file
+}
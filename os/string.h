@@ -11,4 +11,12 @@ int strlen(const char *);
 int strncmp(const char *, const char *, uint);
 char *strncpy(char *, const char *, int);
 
+// Zero a whole page, using the fastest method the harts support.
+void pagezero(void *);
+void string_init();
+
+#define PAGEZERO_WORDS 0
+#define PAGEZERO_CBOZ  1
+void pagezero_variant(int, void *);
+
 #endif // STRING_H
\ No newline at end of file
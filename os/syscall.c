@@ -4,6 +4,8 @@
 #include "defs.h"
 #include "ktest/ktest.h"
 #include "loader.h"
+#include "sched.h"
+#include "spawn.h"
 #include "timer.h"
 #include "trap.h"
 
@@ -13,55 +15,69 @@ int64 sys_fork() {
 
 int64 sys_alarm(void);
 
-int64 sys_exec(uint64 __user path, uint64 __user argv) {
+int64 sys_vfork() {
+    return vfork();
+}
+
+// Copy the path, and build the argument pages of exec/spawn from the user's argv and envp.
+// On success, the caller frees them with kfree(&kstrbuf, *kpath_out) and exec_args_free.
+static int copy_exec_args(uint64 __user path, uint64 __user argv, uint64 __user envp, char **kpath_out, struct exec_args *ea) {
     int ret;
     char *kpath = kalloc(&kstrbuf);
-    char *arg[MAXARG];
     memset(kpath, 0, KSTRING_MAX);
-    memset(arg, 0, sizeof(arg));
+    exec_args_init(ea);
 
     struct proc *p = curr_proc();
 
-    acquire(&p->lock);
-    acquire(&p->mm->lock);
-    release(&p->lock);
-
-    if ((ret = copystr_from_user(p->mm, kpath, path, KSTRING_MAX)) < 0) {
+    if ((ret = copystr_from_user(p->mm, kpath, path, KSTRING_MAX)) < 0)
         goto free;
-    }
-    for (int i = 0; i < MAXARG; i++) {
-        uint64 useraddr;
-        if ((ret = copy_from_user(p->mm, (char *)&useraddr, argv + i * sizeof(uint64), sizeof(uint64))) < 0) {
-            goto free;
-        }
-        if (useraddr == 0) {
-            arg[i] = 0;
-            break;
-        }
-        arg[i] = kalloc(&kstrbuf);
-        assert(arg[i] != NULL);
-        if ((ret = copystr_from_user(p->mm, arg[i], useraddr, KSTRING_MAX)) < 0) {
-            goto free;
-        }
-    }
-    release(&p->mm->lock);
+    if ((ret = exec_args_copy(ea, argv, false)) < 0)
+        goto free;
+    if ((ret = exec_args_copy(ea, envp, true)) < 0)
+        goto free;
+    *kpath_out = kpath;
+    return 0;
 
-    debugf("sys_exec %s\n", kpath);
+free:
+    kfree(&kstrbuf, kpath);
+    exec_args_free(ea);
+    return ret;
+}
 
-    ret = exec(kpath, arg);
+int64 sys_execve(uint64 __user path, uint64 __user argv, uint64 __user envp) {
+    int ret;
+    char *kpath;
+    struct exec_args ea;
+
+    if ((ret = copy_exec_args(path, argv, envp, &kpath, &ea)) < 0)
+        return ret;
+
+    debugf("sys_execve %s\n", kpath);
+
+    ret = exec(kpath, &ea);
 
     kfree(&kstrbuf, kpath);
-    for (int i = 0; arg[i]; i++) {
-        kfree(&kstrbuf, arg[i]);
-    }
+    exec_args_free(&ea);
     return ret;
+}
+
+int64 sys_spawn(uint64 __user path, uint64 __user argv, uint64 __user attr) {
+    int ret;
+    char *kpath;
+    struct exec_args ea;
+    struct spawnattr kattr;
+
+    if (attr && (ret = copy_from_user(curr_proc()->mm, (char *)&kattr, attr, sizeof(kattr))) < 0)
+        return ret;
+    if ((ret = copy_exec_args(path, argv, 0, &kpath, &ea)) < 0)
+        return ret;
+
+    debugf("sys_spawn %s\n", kpath);
+
+    ret = spawn(kpath, &ea, attr ? &kattr : NULL);
 
-free:
-    release(&p->mm->lock);
     kfree(&kstrbuf, kpath);
-    for (int i = 0; arg[i]; i++) {
-        kfree(&kstrbuf, arg[i]);
-    }
+    exec_args_free(&ea);
     return ret;
 }
 
@@ -70,6 +86,15 @@ int64 sys_exit(int code) {
     panic_never_reach();
 }
 
+int64 sys_exit_thread(int code) {
+    thread_exit(code);
+    panic_never_reach();
+}
+
+int64 sys_clone(uint64 __user entry, uint64 arg, uint64 __user stack, uint64 tls, uint64 __user ctid) {
+    return clone(entry, arg, stack, tls, ctid);
+}
+
 int64 sys_wait(int pid, uint64 __user va) {
     struct proc *p = curr_proc();
     int *code      = NULL;
@@ -77,24 +102,24 @@ int64 sys_wait(int pid, uint64 __user va) {
     return wait(pid, (int *)va);
 }
 
+// the pid of the process, shared by its threads.
 int64 sys_getpid() {
-    struct proc *cur = curr_proc();
-    int pid;
-
-    acquire(&cur->lock);
-    pid = cur->pid;
-    release(&cur->lock);
+    return curr_proc()->tgid;
+}
 
-    return pid;
+int64 sys_gettid() {
+    return curr_proc()->pid;
 }
 
 int64 sys_getppid() {
     struct proc *cur = curr_proc();
     int ppid;
 
-    acquire(&cur->lock);
-    ppid = cur->parent == NULL ? 0 : cur->parent->pid;
-    release(&cur->lock);
+    // a reaped parent keeps its pid until the grace period is over.
+    rcu_read_lock();
+    struct proc *parent = rcu_dereference(cur->group_leader->parent);
+    ppid                = parent == NULL ? 0 : parent->pid;
+    rcu_read_unlock();
 
     return ppid;
 }
@@ -124,16 +149,86 @@ int64 sys_yield() {
     return 0;
 }
 
+int64 sys_setpriority(int pid, int nice) {
+    return setpriority(pid, nice);
+}
+
+// Return 20 - nice as Linux does, so that a nice value is never mistaken for an errno.
+int64 sys_getpriority(int pid) {
+    int nice;
+    int ret = getpriority(pid, &nice);
+    return ret < 0 ? ret : 20 - nice;
+}
+
+int64 sys_sched_setattr(int pid, uint64 __user va) {
+    struct sched_attr attr;
+
+    if (copy_from_user(curr_proc()->mm, (char *)&attr, va, sizeof(attr)) < 0)
+        return -EINVAL;
+    return sched_setattr(pid, &attr);
+}
+
+// the hart we run on, which may change right after.
+int64 sys_getcpu() {
+    return cpuid();
+}
+
+int64 sys_sched_setaffinity(int pid, uint64 mask) {
+    return sched_setaffinity(pid, mask);
+}
+
+// Return the mask itself, it fits in the positive range.
+int64 sys_sched_getaffinity(int pid) {
+    uint64 mask;
+    int ret = sched_getaffinity(pid, &mask);
+    return ret < 0 ? ret : (int64)mask;
+}
+
+int64 sys_sched_group_create(int parent, uint64 quota_us, uint64 period_us) {
+    return sched_group_create(parent, quota_us, period_us);
+}
+
+int64 sys_sched_group_destroy(int id) {
+    return sched_group_destroy(id);
+}
+
+int64 sys_sched_group_attach(int id, int pid) {
+    return sched_group_attach(id, pid);
+}
+
+int64 sys_sched_group_stat(int id, uint64 __user va) {
+    struct sched_group_stat st;
+    int ret;
+
+    if ((ret = sched_group_stat(id, &st)) < 0)
+        return ret;
+    if (copy_to_user(curr_proc()->mm, va, (char *)&st, sizeof(st)) < 0)
+        return -EINVAL;
+    return 0;
+}
+
+int64 sys_sched_getattr(int pid, uint64 __user va) {
+    struct sched_attr attr;
+    int ret;
+
+    if ((ret = sched_getattr(pid, &attr)) < 0)
+        return ret;
+    if (copy_to_user(curr_proc()->mm, va, (char *)&attr, sizeof(attr)) < 0)
+        return -EINVAL;
+    return 0;
+}
+
 int64 sys_sbrk(int64 n) {
     int64 ret;
     struct proc *p = curr_proc();
 
-    acquire(&p->lock);
-    acquire(&p->mm->lock);
+    // brk lives in the mm, mm->lock is enough.
+    struct mm *mm = p->mm;
+    down_write(&mm->lock);
 
-    struct vma *vma_brk = p->vma_brk;
-    int64 old_brk       = p->brk;
-    int64 new_brk       = (int64)p->brk + n;
+    struct vma *vma_brk = mm->vma_brk;
+    int64 old_brk       = mm->brk;
+    int64 new_brk       = (int64)mm->brk + n;
 
     if (new_brk < vma_brk->vm_start) {
         warnf("userprog requested to shrink brk, but underflow.");
@@ -146,12 +241,11 @@ int64 sys_sbrk(int64 n) {
             ret = mm_remap(vma_brk, vma_brk->vm_start, roundup, vma_brk->pte_flags);
         }
         if (ret == 0) {
-            p->brk = new_brk;
+            mm->brk = new_brk;
         }
     }
 
-    release(&p->mm->lock);
-    release(&p->lock);
+    up_write(&mm->lock);
 
     if (ret == 0) {
         return old_brk;
@@ -176,15 +270,26 @@ void syscall() {
     int id                      = trapframe->a7;
     uint64 ret;
     uint64 args[6] = {trapframe->a0, trapframe->a1, trapframe->a2, trapframe->a3, trapframe->a4, trapframe->a5};
+    uint64 start   = r_time();
     tracef("syscall %d args = [%x, %x, %x, %x, %x, %x]", id, args[0], args[1], args[2], args[3], args[4], args[5]);
     switch (id) {
         case SYS_fork:
             ret = sys_fork();
             break;
         case SYS_exec:
-            ret = sys_exec(args[0], args[1]);
+            ret = sys_execve(args[0], args[1], 0);
+            break;
+        case SYS_execve:
+            ret = sys_execve(args[0], args[1], args[2]);
+            break;
+        case SYS_spawn:
+            ret = sys_spawn(args[0], args[1], args[2]);
+            break;
+        case SYS_vfork:
+            ret = sys_vfork();
             break;
         case SYS_exit:
+            sysstat_account(id, args, 0, start);
             sys_exit(args[0]);
             panic_never_reach();
         case SYS_wait:
@@ -205,6 +310,58 @@ void syscall() {
         case SYS_yield:
             ret = sys_yield();
             break;
+        case SYS_setpriority:
+            ret = sys_setpriority(args[0], args[1]);
+            break;
+        case SYS_getpriority:
+            ret = sys_getpriority(args[0]);
+            break;
+        case SYS_sched_setattr:
+            ret = sys_sched_setattr(args[0], args[1]);
+            break;
+        case SYS_sched_getattr:
+            ret = sys_sched_getattr(args[0], args[1]);
+            break;
+        case SYS_sched_setaffinity:
+            ret = sys_sched_setaffinity(args[0], args[1]);
+            break;
+        case SYS_sched_getaffinity:
+            ret = sys_sched_getaffinity(args[0]);
+            break;
+        case SYS_getcpu:
+            ret = sys_getcpu();
+            break;
+        case SYS_sched_group_create:
+            ret = sys_sched_group_create(args[0], args[1], args[2]);
+            break;
+        case SYS_sched_group_destroy:
+            ret = sys_sched_group_destroy(args[0]);
+            break;
+        case SYS_sched_group_attach:
+            ret = sys_sched_group_attach(args[0], args[1]);
+            break;
+        case SYS_sched_group_stat:
+            ret = sys_sched_group_stat(args[0], args[1]);
+            break;
+        case SYS_sysstat:
+            ret = sys_sysstat(args[0], args[1], args[2], args[3]);
+            break;
+        case SYS_profile:
+            ret = sys_profile(args[0], args[1], args[2], args[3]);
+            break;
+        case SYS_clone:
+            ret = sys_clone(args[0], args[1], args[2], args[3], args[4]);
+            break;
+        case SYS_exit_thread:
+            sysstat_account(id, args, 0, start);
+            ret = sys_exit_thread(args[0]);
+            break;
+        case SYS_gettid:
+            ret = sys_gettid();
+            break;
+        case SYS_futex:
+            ret = sys_futex(args[0], args[1], args[2], args[3], args[4]);
+            break;
         case SYS_sbrk:
             ret = sys_sbrk(args[0]);
             break;
@@ -243,5 +400,6 @@ void syscall() {
             errorf("unknown syscall %d", id);
     }
     trapframe->a0 = ret;
+    sysstat_account(id, args, ret, start);
     tracef("syscall ret %d", ret);
 }
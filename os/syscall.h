@@ -2,7 +2,28 @@
 #define SYSCALL_H
 
 #include "syscall_ids.h"
+#include "types.h"
+#include "vm.h"
 
 void syscall();
 
+// futex.c
+void futex_init();
+int64 sys_futex(uint64 __user uaddr, int op, uint32 val, uint64 timeout, uint64 __user uaddr2);
+
+// sysstat.c
+struct proc;
+void sysstat_init();
+void sysstat_account(int id, uint64 args[6], int64 ret, uint64 start);
+void sysstat_exit(struct proc *p);
+void sysstat_free(struct proc *p);
+int64 sys_sysstat(int op, int who, uint64 __user va, uint64 len);
+
+// profile.c
+struct ktrapframe;
+void profile_init();
+uint64 profile_next_sample();
+void profile_tick(struct ktrapframe *ktf);
+int64 sys_profile(int op, uint64 arg, uint64 __user va, uint64 len);
+
 #endif // SYSCALL_H
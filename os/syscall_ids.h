@@ -8,9 +8,20 @@
 #define SYS_getpid  5
 #define SYS_getppid 6
 #define SYS_kill    7
+#define SYS_spawn   8
+#define SYS_vfork   9
+#define SYS_execve  12
 
 #define SYS_sleep 10
 #define SYS_yield 11
+#define SYS_futex 13
+
+#define SYS_clone       14
+#define SYS_exit_thread 15
+#define SYS_gettid      16
+
+#define SYS_setpriority 17
+#define SYS_getpriority 18
 
 #define SYS_sbrk 20
 #define SYS_mmap 21
@@ -19,6 +30,20 @@
 #define SYS_write 23
 
 #define SYS_gettimeofday 24
+
+#define SYS_sched_setattr     25
+#define SYS_sched_getattr     26
+#define SYS_sched_setaffinity 27
+#define SYS_sched_getaffinity 28
+#define SYS_getcpu            29
+
+#define SYS_sched_group_create  35
+#define SYS_sched_group_destroy 36
+#define SYS_sched_group_attach  37
+#define SYS_sched_group_stat    38
+
+#define SYS_sysstat 39
+#define SYS_profile 40
 #define SYS_ktest 99
 
 #define SYS_sigaction 30
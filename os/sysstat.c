@@ -0,0 +1,337 @@
+#include "sysstat.h"
+
+#include "defs.h"
+#include "syscall.h"
+
+// The per-cpu tables are only written by their cpu, with interrupts off.
+// The table of a process is only written by the process itself, on its way out of syscall().
+// Both are read without locking, so a reader may see a call half accounted for.
+//
+// A process record is reached through p->sysstat under p->lock, and pinned with a reference:
+// the traced process, its readers and SYSSTAT_DISABLE may all drop it.
+
+#define NSYSSTAT_PROC 16  // processes with their own statistics at once
+
+struct sysstat_proc {
+    int ref;
+    int flags;
+    struct syscall_stat stat[NSYSSTAT];
+
+    // trace ring, under lock. Entries [tail, head) are unread, numbered since the start.
+    spinlock_t lock;
+    uint64 head;
+    uint64 tail;
+    int exited;   // no more entries will come
+    int waiting;  // readers sleeping on the ring
+    struct syscall_trace ring[SYSSTAT_TRACE_LEN];
+};
+
+static struct syscall_stat cpu_stat[NCPU][NSYSSTAT];
+
+static allocator_t sysstat_allocator;
+static spinlock_t sysstat_lock;  // nrecords
+static int nrecords;
+
+void sysstat_init() {
+    allocator_init(&sysstat_allocator, "sysstat", sizeof(struct sysstat_proc), NSYSSTAT_PROC);
+    spinlock_init(&sysstat_lock, "sysstat");
+}
+
+static int stat_index(int id) {
+    return (id > 0 && id < NSYSSTAT) ? id : 0;
+}
+
+static void stat_add(struct syscall_stat *st, uint64 duration, int64 ret) {
+    int b = duration == 0 ? 0 : 63 - __builtin_clzl(duration);
+
+    st->count++;
+    if (ret < 0)
+        st->errors++;
+    st->time_total += duration;
+    if (duration > st->time_max)
+        st->time_max = duration;
+    st->hist[b < SYSSTAT_NBUCKET ? b : SYSSTAT_NBUCKET - 1]++;
+}
+
+// Take a reference to the record of p, NULL if it has none.
+static struct sysstat_proc *record_get(struct proc *p) {
+    acquire(&p->lock);
+    struct sysstat_proc *rec = p->sysstat;
+    if (rec != NULL)
+        __atomic_add_fetch(&rec->ref, 1, __ATOMIC_RELAXED);
+    release(&p->lock);
+    return rec;
+}
+
+// Never sleeps.
+static void record_put(struct sysstat_proc *rec) {
+    if (__atomic_sub_fetch(&rec->ref, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+    kfree(&sysstat_allocator, rec);
+    acquire(&sysstat_lock);
+    nrecords--;
+    release(&sysstat_lock);
+}
+
+// Take a reference to the record of process pid, 0 for ourselves.
+static struct sysstat_proc *record_find(int pid) {
+    struct sysstat_proc *rec = NULL;
+
+    rcu_read_lock();
+    struct proc *p = pid == 0 ? curr_proc() : find_proc(pid);
+    if (p != NULL) {
+        acquire(&p->lock);
+        if (p->state != UNUSED && (pid == 0 || p->pid == pid) && (rec = p->sysstat) != NULL)
+            __atomic_add_fetch(&rec->ref, 1, __ATOMIC_RELAXED);
+        release(&p->lock);
+    }
+    rcu_read_unlock();
+    return rec;
+}
+
+// Account for syscall id of the current process, started at `time` start.
+// Called by syscall() before returning to user space, or before exiting.
+void sysstat_account(int id, uint64 args[6], int64 ret, uint64 start) {
+    uint64 now      = r_time();
+    uint64 duration = now - start;
+    int i           = stat_index(id);
+    struct proc *p  = curr_proc();
+
+    push_off();
+    int cpu = cpuid();
+    stat_add(&cpu_stat[cpu][i], duration, ret);
+    pop_off();
+
+    // an unlocked peek: p->sysstat only changes under p->lock, checked again in record_get.
+    if (__atomic_load_n(&p->sysstat, __ATOMIC_RELAXED) == NULL)
+        return;
+    struct sysstat_proc *rec = record_get(p);
+    if (rec == NULL)
+        return;
+    stat_add(&rec->stat[i], duration, ret);
+    if (rec->flags & SYSSTAT_F_TRACE) {
+        acquire(&rec->lock);
+        struct syscall_trace *t = &rec->ring[rec->head % SYSSTAT_TRACE_LEN];
+        t->seq      = rec->head;
+        t->start    = start;
+        t->duration = duration;
+        t->args[0]  = args[0];
+        t->args[1]  = args[1];
+        t->args[2]  = args[2];
+        t->ret      = ret;
+        t->id       = id;
+        t->cpu      = cpu;
+        rec->head++;
+        if (rec->head - rec->tail > SYSSTAT_TRACE_LEN)
+            rec->tail = rec->head - SYSSTAT_TRACE_LEN;
+        if (rec->waiting)
+            wakeup(rec);
+        release(&rec->lock);
+    }
+    record_put(rec);
+}
+
+// The current process is exiting: let the trace readers see the end. Its record lives on until freeproc,
+// so that the statistics of a zombie can still be read.
+void sysstat_exit(struct proc *p) {
+    if (__atomic_load_n(&p->sysstat, __ATOMIC_RELAXED) == NULL)
+        return;
+    struct sysstat_proc *rec = record_get(p);
+    if (rec == NULL)
+        return;
+    acquire(&rec->lock);
+    rec->exited = 1;
+    wakeup(rec);
+    release(&rec->lock);
+    record_put(rec);
+}
+
+// Called by freeproc, with p->lock held.
+void sysstat_free(struct proc *p) {
+    if (p->sysstat != NULL) {
+        record_put(p->sysstat);
+        p->sysstat = NULL;
+    }
+}
+
+static int sysstat_enable(int pid, int flags) {
+    int ret = -EINVAL;
+
+    if (flags & ~SYSSTAT_F_TRACE)
+        return -EINVAL;
+
+    acquire(&sysstat_lock);
+    if (nrecords == NSYSSTAT_PROC) {
+        release(&sysstat_lock);
+        return -ENOMEM;
+    }
+    nrecords++;
+    release(&sysstat_lock);
+
+    struct sysstat_proc *rec = kalloc(&sysstat_allocator);
+    memset(rec, 0, sizeof(*rec));
+    spinlock_init(&rec->lock, "sysstat");
+    rec->ref   = 1;
+    rec->flags = flags;
+
+    rcu_read_lock();
+    struct proc *p = pid == 0 ? curr_proc() : find_proc(pid);
+    if (p != NULL) {
+        acquire(&p->lock);
+        if (p->state != UNUSED && !p->kthread && (pid == 0 || p->pid == pid)) {
+            if (p->sysstat == NULL) {
+                p->sysstat = rec;
+                rec        = NULL;
+            } else {
+                p->sysstat->flags = flags;
+            }
+            ret = 0;
+        }
+        release(&p->lock);
+    }
+    rcu_read_unlock();
+
+    if (rec != NULL)
+        record_put(rec);
+    return ret;
+}
+
+static int sysstat_disable(int pid) {
+    struct sysstat_proc *rec = NULL;
+    int ret                  = -EINVAL;
+
+    rcu_read_lock();
+    struct proc *p = pid == 0 ? curr_proc() : find_proc(pid);
+    if (p != NULL) {
+        acquire(&p->lock);
+        if (p->state != UNUSED && (pid == 0 || p->pid == pid)) {
+            rec        = p->sysstat;
+            p->sysstat = NULL;
+            ret        = rec != NULL ? 0 : -ENOENT;
+        }
+        release(&p->lock);
+    }
+    rcu_read_unlock();
+
+    if (rec != NULL) {
+        acquire(&rec->lock);
+        rec->exited = 1;
+        wakeup(rec);
+        release(&rec->lock);
+        record_put(rec);
+    }
+    return ret;
+}
+
+// Copy the statistics of one cpu, or of all of them, to user buffer va.
+static int sysstat_cpu(int cpu, uint64 __user va, uint64 len) {
+    struct proc *p = curr_proc();
+
+    if (cpu != SYSSTAT_ALL && (cpu < 0 || cpu >= NCPU))
+        return -EINVAL;
+    for (int i = 0; i < NSYSSTAT && (i + 1) * sizeof(struct syscall_stat) <= len; i++) {
+        struct syscall_stat st;
+        memset(&st, 0, sizeof(st));
+        for (int c = 0; c < NCPU; c++) {
+            if (cpu != SYSSTAT_ALL && c != cpu)
+                continue;
+            struct syscall_stat *s = &cpu_stat[c][i];
+            st.count += s->count;
+            st.errors += s->errors;
+            st.time_total += s->time_total;
+            if (s->time_max > st.time_max)
+                st.time_max = s->time_max;
+            for (int b = 0; b < SYSSTAT_NBUCKET; b++)
+                st.hist[b] += s->hist[b];
+        }
+        if (copy_to_user(p->mm, va + i * sizeof(st), (char *)&st, sizeof(st)) < 0)
+            return -EINVAL;
+    }
+    return NSYSSTAT;
+}
+
+static int sysstat_proc(int pid, uint64 __user va, uint64 len) {
+    struct sysstat_proc *rec = record_find(pid);
+    int ret                  = NSYSSTAT;
+
+    if (rec == NULL)
+        return -ENOENT;
+    uint64 n = MIN(len, sizeof(rec->stat));
+    if (copy_to_user(curr_proc()->mm, va, (char *)rec->stat, n) < 0)
+        ret = -EINVAL;
+    record_put(rec);
+    return ret;
+}
+
+#define TRACE_CHUNK 8
+
+// Read the trace of process pid, see SYSSTAT_TRACE.
+static int sysstat_trace(int pid, uint64 __user va, uint64 len) {
+    struct sysstat_proc *rec = record_find(pid);
+    struct syscall_trace buf[TRACE_CHUNK];
+    uint64 max = len / sizeof(struct syscall_trace);
+    int ret    = 0;
+
+    if (rec == NULL)
+        return -ENOENT;
+    if (!(rec->flags & SYSSTAT_F_TRACE)) {
+        record_put(rec);
+        return -EINVAL;
+    }
+
+    acquire(&rec->lock);
+    while (rec->head == rec->tail && !rec->exited && !iskilled(curr_proc())) {
+        rec->waiting++;
+        sleep(rec, &rec->lock);
+        rec->waiting--;
+    }
+    while ((uint64)ret < max && rec->head != rec->tail) {
+        int n = 0;
+        for (; n < TRACE_CHUNK && ret + n < max && rec->head != rec->tail; n++) {
+            buf[n] = rec->ring[rec->tail % SYSSTAT_TRACE_LEN];
+            rec->tail++;
+        }
+        release(&rec->lock);
+        if (copy_to_user(curr_proc()->mm, va + ret * sizeof(buf[0]), (char *)buf, n * sizeof(buf[0])) < 0) {
+            record_put(rec);
+            return -EINVAL;
+        }
+        ret += n;
+        acquire(&rec->lock);
+    }
+    release(&rec->lock);
+    record_put(rec);
+    return ret;
+}
+
+static int sysstat_reset(int pid) {
+    if (pid == SYSSTAT_ALL) {
+        memset(cpu_stat, 0, sizeof(cpu_stat));
+        return 0;
+    }
+    struct sysstat_proc *rec = record_find(pid);
+    if (rec == NULL)
+        return -ENOENT;
+    memset(rec->stat, 0, sizeof(rec->stat));
+    record_put(rec);
+    return 0;
+}
+
+int64 sys_sysstat(int op, int who, uint64 __user va, uint64 len) {
+    switch (op) {
+        case SYSSTAT_CPU:
+            return sysstat_cpu(who, va, len);
+        case SYSSTAT_PROC:
+            return sysstat_proc(who, va, len);
+        case SYSSTAT_ENABLE:
+            return sysstat_enable(who, len);
+        case SYSSTAT_DISABLE:
+            return sysstat_disable(who);
+        case SYSSTAT_TRACE:
+            return sysstat_trace(who, va, len);
+        case SYSSTAT_RESET:
+            return sysstat_reset(who);
+        default:
+            return -EINVAL;
+    }
+}
@@ -0,0 +1,50 @@
+// This file is shared by Kernel and User-space application.
+
+#ifndef SYSSTAT_H
+#define SYSSTAT_H
+
+#include "types.h"
+
+// Syscall statistics, in `time` ticks (CPU_FREQ per second), from the entry of syscall() to its return.
+// They are always kept per cpu. Per process, they are kept once enabled with SYSSTAT_ENABLE,
+// along with a trace of the calls if asked for. Children do not inherit them.
+
+#define NSYSSTAT        64  // statistics are indexed by syscall id, the larger ids (ktest) share entry 0
+#define SYSSTAT_NBUCKET 20  // log2 latency histogram
+
+// sysstat(op, who, buf, len) operations:
+#define SYSSTAT_CPU     0  // fill buf with up to len bytes of syscall_stat of cpu who, SYSSTAT_ALL for all. Return NSYSSTAT.
+#define SYSSTAT_PROC    1  // the same, of process who, 0 for ourselves. -ENOENT if not enabled on it.
+#define SYSSTAT_ENABLE  2  // start keeping the statistics of process who, len holds SYSSTAT_F_* flags
+#define SYSSTAT_DISABLE 3  // stop, and drop them
+#define SYSSTAT_TRACE   4  // read up to len bytes of syscall_trace of process who, oldest first. See below.
+#define SYSSTAT_RESET   5  // clear the statistics of process who, or of all cpus with SYSSTAT_ALL
+
+#define SYSSTAT_ALL (-1)
+
+#define SYSSTAT_F_TRACE 1  // also record every call in a ring of SYSSTAT_TRACE_LEN entries
+
+// SYSSTAT_TRACE sleeps until there is at least one entry, and returns the number of entries read.
+// It returns 0 once the process has exited and every entry was read.
+// The oldest entries are dropped when the reader falls behind, see syscall_trace.seq.
+#define SYSSTAT_TRACE_LEN 128
+
+struct syscall_stat {
+    uint64 count;
+    uint64 errors;      // calls that returned a negative errno
+    uint64 time_total;
+    uint64 time_max;
+    uint32 hist[SYSSTAT_NBUCKET];  // calls that took [2^i, 2^(i+1)) ticks; 0 ticks count in hist[0], the last is open-ended
+};
+
+struct syscall_trace {
+    uint64 seq;  // numbers the calls of the process, a gap means dropped entries
+    uint64 start;
+    uint64 duration;
+    uint64 args[3];
+    int64 ret;
+    uint32 id;
+    uint32 cpu;  // where it returned
+};
+
+#endif  // SYSSTAT_H
@@ -48,10 +48,8 @@ int do_signal(void) {
                 uint64 new_sp    = PGROUNDDOWN(tf->sp - sizeof(struct trapframe) - sizeof(sigset_t));
                 sigset_t oldmask = p->signal.sigmask;
 
-                acquire(&p->mm->lock);
                 copy_to_user(p->mm, new_sp, (char *)tf, sizeof(struct trapframe));                   // 备份 trapframe
                 copy_to_user(p->mm, new_sp + sizeof(struct trapframe), &oldmask, sizeof(sigset_t));  // 备份掩码
-                release(&p->mm->lock);
 
                 // 更新信号掩码并处理信号
                 p->signal.sigmask |= sa->sa_mask;
@@ -72,30 +70,25 @@ int sys_sigaction(int signo, const sigaction_t __user *act, sigaction_t __user *
     struct proc *p = curr_proc();
     if (signo < SIGMIN || signo > SIGMAX)
         return -1;  // 信号编号检查
-    acquire(&p->mm->lock);
     if (oldact) {
         copy_to_user(p->mm, (uint64)oldact, &p->signal.sa[signo], sizeof(sigaction_t));
     }
     if (act) {
         copy_from_user(p->mm, &p->signal.sa[signo], (uint64)act, sizeof(sigaction_t));
     }
-    release(&p->mm->lock);
     return 0;
 }
 int sys_sigreturn(void) {
     struct proc *p       = curr_proc();
     struct trapframe *tf = p->trapframe;
     sigset_t oldmask;
-    acquire(&p->mm->lock);
     copy_from_user(p->mm, (char *)tf, tf->sp, sizeof(struct trapframe));                   // 恢复 trapframe
     copy_from_user(p->mm, &oldmask, tf->sp + sizeof(struct trapframe), sizeof(sigset_t));  // 恢复掩码
-    release(&p->mm->lock);
     p->signal.sigmask = oldmask;
     return 0;
 }
 int sys_sigprocmask(int how, const sigset_t __user *set, sigset_t __user *oldset) {
     struct proc *p = curr_proc();
-    acquire(&p->mm->lock);
     if (oldset) {
         copy_to_user(p->mm, (uint64)oldset, &p->signal.sigmask, sizeof(sigset_t));
     }
@@ -117,24 +110,18 @@ int sys_sigprocmask(int how, const sigset_t __user *set, sigset_t __user *oldset
                 return -1;
         }
     }
-    release(&p->mm->lock);
     return 0;
 }
 int sys_sigpending(sigset_t __user *set) {
     struct proc *p = curr_proc();
-    acquire(&p->mm->lock);
     copy_to_user(p->mm, (uint64)set, &p->signal.sigpending, sizeof(sigset_t));
-    release(&p->mm->lock);
     return 0;
 }
 int sys_sigkill(int pid, int signo, int code) {
-    struct proc *p;
-    for (int i = 0; i < NPROC; i++) {
-        p = pool[i];
-        if (p->pid == pid && p->state != UNUSED) {
-            sigaddset(&p->signal.sigpending, signo);
-            return 0;
-        }
-    }
-    return -1;
+    rcu_read_lock();
+    struct proc *p = find_proc(pid);
+    if (p != NULL)
+        sigaddset(&p->signal.sigpending, signo);
+    rcu_read_unlock();
+    return p != NULL ? 0 : -1;
 }
\ No newline at end of file
@@ -1,10 +1,17 @@
 #include "timer.h"
 
+#include "defs.h"
 #include "riscv.h"
 #include "sbi.h"
+#include "syscall.h"
 
 extern int on_vf2_board;
 
+#define TIMEBASE (CPU_FREQ / TICKS_PER_SEC)
+
+// `time` of the next scheduler tick of each hart. The timer may fire in between for the profiler.
+static uint64 next_tick[NCPU];
+
 /// read the `mtime` regiser
 uint64 get_cycle() {
     return r_time();
@@ -14,15 +21,29 @@ uint64 get_cycle() {
 void timer_init() {
     // Enable supervisor timer interrupt
     w_sie(r_sie() | SIE_STIE);
+    next_tick[cpuid()] = r_time() + TIMEBASE;
     set_next_timer();
 }
 
-// /// Set the next timer interrupt
+// Whether this timer interrupt is a scheduler tick. If it is, the next one is due a tick later.
+int timer_tick_due() {
+    uint64 now = r_time();
+
+    if (now < next_tick[cpuid()])
+        return 0;
+    next_tick[cpuid()] = now + TIMEBASE;
+    return 1;
+}
+
+/// Set the next timer interrupt: the next tick, or the next profiler sample if sooner.
 void set_next_timer() {
-    const uint64 timebase = CPU_FREQ / TICKS_PER_SEC;
+    uint64 next   = next_tick[cpuid()];
+    uint64 sample = profile_next_sample();
+    if (sample < next)
+        next = sample;
     if (on_vf2_board) {
-        set_timer(get_cycle() + timebase);
+        set_timer(next);
     } else {
-        w_stimecmp(r_time() + timebase);
+        w_stimecmp(next);
     }
-}
\ No newline at end of file
+}
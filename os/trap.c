@@ -26,15 +26,24 @@ void plic_handle() {
         plic_complete(irq);
 }
 
-static int handle_intr(void) {
+// ktf is the trap frame of the interrupted kernel code, NULL when the interrupt came from user space.
+// Return 1 for a scheduler tick, 4 for a timer interrupt that only took a profiler sample.
+static int handle_intr(struct ktrapframe *ktf) {
     uint64 cause = r_scause();
     uint64 code  = cause & SCAUSE_EXCEPTION_CODE_MASK;
     if (code == SupervisorTimer) {
         tracef("time interrupt!");
+        int tick = timer_tick_due();
+        profile_tick(ktf);
+        if (!tick) {
+            set_next_timer();
+            return 4;
+        }
         if (cpuid() == 0) {
             acquire(&tickslock);
             ticks++;
             wakeup(&ticks);
+            wakeup_expired(ticks);
             release(&tickslock);
             struct proc *p = curr_proc();
             if (p != NULL && p->alarm_active) {
@@ -46,12 +55,17 @@ static int handle_intr(void) {
                 release(&tickslock);
             }
         }
+        sched_timer_tick();
         set_next_timer();
         return 1;
     } else if (code == SupervisorExternal) {
         tracef("s-external interrupt from usertrap!");
         plic_handle();
         return 2;
+    } else if (code == SupervisorSoft) {
+        // a reschedule IPI: need_resched is set, we yield on the way out of the trap.
+        w_sip(r_sip() & ~SIP_SSIP);
+        return 3;
     } else {
         return 0;
     }
@@ -67,6 +81,9 @@ void kernel_trap(struct ktrapframe *ktf) {
 
     uint64 cause          = r_scause();
     uint64 exception_code = cause & SCAUSE_EXCEPTION_CODE_MASK;
+    uint64 sepc           = r_sepc();
+    uint64 sstatus        = r_sstatus();
+    int which_dev         = 0;
     if (cause & SCAUSE_INTERRUPT) {
         // correctness checking:
         if (mycpu()->inkernel_trap > 1) {
@@ -79,7 +96,7 @@ void kernel_trap(struct ktrapframe *ktf) {
             panic("other CPU has panicked");
         }
         // handle interrupt
-        if (handle_intr() == 0) {
+        if ((which_dev = handle_intr(ktf)) == 0) {
             errorf("unhandled interrupt: %d", cause);
             goto kernel_panic;
         }
@@ -93,6 +110,14 @@ void kernel_trap(struct ktrapframe *ktf) {
 
     mycpu()->inkernel_trap--;
 
+    // the code we interrupted had interrupts on, so it holds no spinlock: it may be preempted.
+    // The process may come back on another cpu, and other traps overwrite sepc and sstatus meanwhile.
+    // Only SPP and SPIE are restored: FS belongs to the hart, see fpu.c.
+    if (sstatus & SSTATUS_SPIE) {
+        preempt_kernel(which_dev == 1);
+        w_sepc(sepc);
+        w_sstatus((r_sstatus() & ~(SSTATUS_SPP | SSTATUS_SPIE)) | (sstatus & (SSTATUS_SPP | SSTATUS_SPIE)));
+    }
     return;
 
 kernel_panic:
@@ -129,13 +154,15 @@ static void handle_pgfault(void) {
     struct proc *p = curr_proc();
     struct mm *mm;
     pte_t *pte;
+    int ret;
 
     acquire(&p->lock);
     mm = p->mm;
-    acquire(&mm->lock);
     release(&p->lock);
+    // faults only read the VMAs: they may run concurrently, pgt_lock serializes the PTE updates.
+    down_read(&mm->lock);
+    acquire(&mm->pgt_lock);
     pte = walk(mm, addr, 0);
-    release(&mm->lock);
 
     //	docs: Volume II: RISC-V Privileged Architectures V1.10, Page 61,
     //		> Two schemes to manage the A and D bits are permitted:
@@ -151,9 +178,30 @@ static void handle_pgfault(void) {
             *pte |= PTE_A;
             if (cause == StorePageFault)
                 *pte |= PTE_D;
+            release(&mm->pgt_lock);
+            up_read(&mm->lock);
+            return;
+        }
+        uint64 need = cause == StorePageFault ? PTE_W : cause == InstructionPageFault ? PTE_X : PTE_R;
+        if (*pte & need) {
+            // a thread on another hart already resolved it: this hart faulted on a stale TLB entry,
+            // which the trap entry flushed. Run the instruction again.
+            release(&mm->pgt_lock);
+            up_read(&mm->lock);
             return;
         }
     }
+    release(&mm->pgt_lock);
+    // not populated yet, or a write to a page shared with the kernel image.
+    ret = mm_fault(mm, addr, cause == StorePageFault);
+    up_read(&mm->lock);
+    if (ret == 0)
+        return;
+    if (ret == -ENOMEM) {
+        infof("out of memory on page fault, addr = %p, killed.", addr);
+        setkilled(p, -ENOMEM);
+        return;
+    }
     // otherwise, it is a page fault due to invalid address
     infof("page fault in application, bad addr = %p, bad instruction = %p, core dumped.", r_stval(), p->trapframe->epc);
     setkilled(p, -2);
@@ -182,9 +230,15 @@ void usertrap() {
     tracef("trap from user epc = %p", trapframe->epc);
     int killed;
 
+    // this hart holds no TLB entries of the mm anymore, see mm_flush_tlb.
+    mm_exit_user(p->mm);
+
     uint64 cause = r_scause();
     if (cause & SCAUSE_INTERRUPT) {
-        which_dev = handle_intr();
+        which_dev = handle_intr(NULL);
+        // user space holds no RCU reference: a task that never leaves it must not stall grace periods.
+        if (which_dev == 1)
+            rcu_quiescent();
     } else if (cause == UserEnvCall) {
         if ((killed = iskilled(p)) != 0)
             exit(killed);
@@ -200,6 +254,8 @@ void usertrap() {
         intr_off();
     } else if (cause == LoadPageFault || cause == StorePageFault || cause == InstructionPageFault) {
         handle_pgfault();
+    } else if (cause == IllegalInstruction && fpu_first_use(p)) {
+        // run the instruction again, now with the FPU on.
     } else {
         unknown_trap();
     }
@@ -208,8 +264,9 @@ void usertrap() {
     if ((killed = iskilled(p)) != 0)
         exit(killed);
 
-    // if it's a timer intr, call yield to give up CPU.
-    if (which_dev == 1)
+    // on a timer intr, give up the CPU if our quantum is over, or a higher priority task waits.
+    // A real-time task queued for this cpu asks for it at once, with need_resched.
+    if ((which_dev == 1 && sched_tick(p)) || need_resched())
         yield();
 
     // prepare for return to user mode
@@ -244,6 +301,9 @@ void usertrapret() {
     // set S Exception Program Counter to the saved user pc.
     w_sepc(trapframe->epc);
 
+    // set sstatus.FS, and load our floating-point registers if this hart does not hold them.
+    fpu_user_enter(curr_proc());
+
     // set S Previous Privilege mode to User.
     uint64 x = r_sstatus();
     x &= ~SSTATUS_SPP;  // clear SPP to 0 for user mode
@@ -251,6 +311,7 @@ void usertrapret() {
     w_sstatus(x);
 
     // tell trampoline.S the user page table to switch to.
+    mm_enter_user(curr_proc()->mm);
     uint64 satp  = MAKE_SATP(KVA_TO_PA(curr_proc()->mm->pgt));
     uint64 stvec = (TRAMPOLINE + (uservec - trampoline)) & ~0x3;
 
@@ -259,5 +320,5 @@ void usertrapret() {
     // and switches to user mode with sret.
     uint64 fn = TRAMPOLINE + (userret - trampoline);
     tracef("return to user @%p, fn %p", trapframe->epc);
-    ((void (*)(uint64, uint64, uint64))fn)(TRAPFRAME, satp, stvec);
+    ((void (*)(uint64, uint64, uint64))fn)(curr_proc()->trapframe_va, satp, stvec);
 }
\ No newline at end of file
@@ -21,9 +21,14 @@ typedef long int64;
 
 // errno
 
-#define ENOMEM 1
-#define EINVAL 2
-#define ECHILD 3
-#define ENOENT 4
+#define ENOMEM    1
+#define EINVAL    2
+#define ECHILD    3
+#define ENOENT    4
+#define E2BIG     5
+#define EAGAIN    6
+#define ETIMEDOUT 7
+#define EINTR     8
+#define EBUSY     9
 
 #endif  // TYPES_H
\ No newline at end of file
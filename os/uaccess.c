@@ -1,93 +1,208 @@
+#include "defs.h"
 #include "memlayout.h"
 #include "riscv.h"
 #include "string.h"
 #include "vm.h"
 
-// Copy from kernel to user.
-// Copy len bytes from src to virtual address dstva in a given page table.
-// Return 0 on success, -1 on error.
-int copy_to_user(struct mm *mm, uint64 __user dstva, char *src, uint64 len) {
-    uint64 n, va0, pa0;
+// The kernel runs on its own page table, which does not map user space.
+// So user memory is reached through the direct mapping of its physical pages.
+//
+// Instead of walking the page table for every page while copying,
+// a user range is translated up front, in batches of up to UACCESS_BATCH physically contiguous segments.
+// The copy itself then runs at memcpy speed.
+//
+// mm->lock is held for reading until the copy is done: the other threads sharing the mm
+// could otherwise unmap and free the pages under us (sbrk).
+
+#define UACCESS_BATCH 16
+
+// A physically contiguous part of a user buffer, addressed through the direct mapping.
+struct useg {
+    char *__kva kva;
+    uint64 len;
+};
+
+// Translate at most UACCESS_BATCH segments of the user range [va, va + len).
+// Adjacent pages that are also physically adjacent are merged into one segment.
+// Pages of lazily mapped VMAs are populated on the way, as if the user had touched them.
+// Return the number of segments filled, or a negative errno if any page is not a valid user page.
+// Called with mm->lock held for reading.
+static int uaccess_translate(struct mm *mm, uint64 __user va, uint64 len, int write, struct useg *segs) {
+    // leaf page table of the last 2 MiB region we walked into, to skip the upper levels for the next pages.
+    pte_t *l0      = NULL;
+    uint64 l0_base = 0;
+    int nseg       = 0;
+    uint64 perm    = PTE_V | PTE_U | (write ? PTE_W : 0);
+    int ret        = -EINVAL;
 
     while (len > 0) {
-        va0 = PGROUNDDOWN(dstva);
-        pa0 = walkaddr(mm, va0);
-        if (pa0 == 0)
-            return -EINVAL;
-        n = PGSIZE - (dstva - va0);
-        if (n > len)
-            n = len;
-        memmove((void *)(PA_TO_KVA(pa0) + (dstva - va0)), src, n);
+        if (!IS_USER_VA(va))
+            return ret;
 
+        uint64 va0 = PGROUNDDOWN(va);
+        pte_t *pte = NULL;
+        if (l0 != NULL && (va0 >> PXSHIFT(1)) == l0_base) {
+            pte = &l0[PX(0, va0)];
+        } else if ((pte = walk(mm, va0, 0)) != NULL) {
+            l0      = pte - PX(0, va0);
+            l0_base = va0 >> PXSHIFT(1);
+        }
+        if (pte == NULL || (*pte & perm) != perm) {
+            if ((ret = mm_fault(mm, va0, write)) < 0)
+                return ret;
+            continue;
+        }
+
+        uint64 n = MIN(PGSIZE - (va - va0), len);
+        char *kva = (char *)(PA_TO_KVA(PTE2PA(*pte)) + (va - va0));
+        if (nseg > 0 && segs[nseg - 1].kva + segs[nseg - 1].len == kva) {
+            segs[nseg - 1].len += n;
+        } else {
+            if (nseg == UACCESS_BATCH)
+                break;
+            segs[nseg].kva = kva;
+            segs[nseg].len = n;
+            nseg++;
+        }
+        va += n;
         len -= n;
-        src += n;
-        dstva = va0 + PGSIZE;
     }
-    return 0;
+    return nseg;
+}
+
+// Copy from kernel to user.
+// Copy len bytes from src to virtual address dstva in a given mm.
+// Caller must not hold mm->lock.
+// Return 0 on success, -EINVAL (bad address) or -ENOMEM on error.
+int copy_to_user(struct mm *mm, uint64 __user dstva, char *src, uint64 len) {
+    struct useg segs[UACCESS_BATCH];
+    int ret = 0;
+
+    down_read(&mm->lock);
+    while (len > 0) {
+        int nseg = uaccess_translate(mm, dstva, len, true, segs);
+        if (nseg < 0) {
+            ret = nseg;
+            break;
+        }
+        for (int i = 0; i < nseg; i++) {
+            memmove(segs[i].kva, src, segs[i].len);
+            src += segs[i].len;
+            dstva += segs[i].len;
+            len -= segs[i].len;
+        }
+    }
+    up_read(&mm->lock);
+    return ret;
 }
 
 // Copy from user to kernel.
-// Copy len bytes to dst from virtual address srcva in a given page table.
-// Return 0 on success, -1 on error.
+// Copy len bytes to dst from virtual address srcva in a given mm.
+// Caller must not hold mm->lock.
+// Return 0 on success, -EINVAL (bad address) or -ENOMEM on error.
 int copy_from_user(struct mm *mm, char *dst, uint64 __user srcva, uint64 len) {
-    uint64 n, va0, pa0;
+    struct useg segs[UACCESS_BATCH];
+    int ret = 0;
 
+    down_read(&mm->lock);
     while (len > 0) {
-        va0 = PGROUNDDOWN(srcva);
-        pa0 = walkaddr(mm, va0);
-        if (pa0 == 0)
-            return -EINVAL;
-        n = PGSIZE - (srcva - va0);
-        if (n > len)
-            n = len;
-        memmove(dst, (void *)(PA_TO_KVA(pa0) + (srcva - va0)), n);
-
-        len -= n;
-        dst += n;
-        srcva = va0 + PGSIZE;
+        int nseg = uaccess_translate(mm, srcva, len, false, segs);
+        if (nseg < 0) {
+            ret = nseg;
+            break;
+        }
+        for (int i = 0; i < nseg; i++) {
+            memmove(dst, segs[i].kva, segs[i].len);
+            dst += segs[i].len;
+            srcva += segs[i].len;
+            len -= segs[i].len;
+        }
     }
-    return 0;
+    up_read(&mm->lock);
+    return ret;
 }
 
 // Copy a null-terminated string from user to kernel.
-// Copy bytes to dst from virtual address srcva in a given page table,
+// Copy bytes to dst from virtual address srcva in a given mm,
 // until a '\0', or max.
+// Caller must not hold mm->lock.
 // Return 0 on success, -1 on error.
 int copystr_from_user(struct mm *mm, char *dst, uint64 __user srcva, uint64 max) {
-    uint64 n, va0, pa0, kva0;
-    int got_null = 0, len = 0;
-
-    while (got_null == 0 && max > 0) {
-        va0 = PGROUNDDOWN(srcva);
-        pa0 = walkaddr(mm, va0);
-        if (pa0 == 0)
-            return -EINVAL;
-        n = PGSIZE - (srcva - va0);
-        if (n > max)
-            n = max;
-
-        kva0    = PA_TO_KVA(pa0);
-        char *p = (char *)(kva0 + (srcva - va0));
-        while (n > 0) {
-            if (*p == '\0') {
-                *dst     = '\0';
-                got_null = 1;
-                break;
-            } else {
-                *dst = *p;
-            }
-            --n;
-            --max;
-            p++;
-            dst++;
-            len++;
+    struct useg seg;
+    int ret = -1;
+
+    down_read(&mm->lock);
+    while (max > 0) {
+        // the string length is unknown, so translate one page at a time.
+        uint64 n = MIN(PGSIZE - (srcva - PGROUNDDOWN(srcva)), max);
+        if (uaccess_translate(mm, srcva, n, false, &seg) < 0) {
+            ret = -EINVAL;
+            break;
         }
 
-        srcva = va0 + PGSIZE;
+        char *p;
+        for (p = seg.kva; p < seg.kva + seg.len; p++, dst++) {
+            *dst = *p;
+            if (*p == '\0')
+                break;
+        }
+        if (p < seg.kva + seg.len) {
+            ret = 0;
+            break;
+        }
+        srcva += n;
+        max -= n;
     }
-    if (got_null) {
-        return 0;
-    } else {
-        return -1;
+    up_read(&mm->lock);
+    return ret;
+}
+
+// Length of a null-terminated user string at srcva, including the '\0'.
+// Caller must not hold mm->lock.
+// Return the length, max + 1 if there is no '\0' in the first max bytes, or -EINVAL.
+int64 strnlen_user(struct mm *mm, uint64 __user srcva, uint64 max) {
+    struct useg seg;
+    uint64 len = 0;
+    int64 ret  = max + 1;
+
+    down_read(&mm->lock);
+    while (len < max) {
+        uint64 n = MIN(PGSIZE - (srcva - PGROUNDDOWN(srcva)), max - len);
+        if (uaccess_translate(mm, srcva, n, false, &seg) < 0) {
+            ret = -EINVAL;
+            break;
+        }
+
+        char *p = seg.kva;
+        while (p < seg.kva + seg.len && *p != '\0')
+            p++;
+        if (p < seg.kva + seg.len) {
+            ret = len + (p - seg.kva) + 1;
+            break;
+        }
+        srcva += n;
+        len += n;
     }
+    up_read(&mm->lock);
+    return ret;
+}
+
+// Translate the user word at va, which must be 4-byte aligned, for futexes.
+// The page is made private and writable first, so that the word keeps its physical address.
+// The caller may then read the word through *kva without mm->lock: if another thread unmaps the page meanwhile,
+// it reads a stale word through the direct mapping, which is harmless, and only happens to buggy programs.
+// Caller must not hold mm->lock.
+// Return 0 on success, -EINVAL (bad address) or -ENOMEM on error.
+int uaccess_word(struct mm *mm, uint64 __user va, uint32 *__kva *kva) {
+    struct useg seg;
+
+    if (!IS_ALIGNED(va, sizeof(uint32)))
+        return -EINVAL;
+    down_read(&mm->lock);
+    int nseg = uaccess_translate(mm, va, sizeof(uint32), true, &seg);
+    up_read(&mm->lock);
+    if (nseg < 0)
+        return nseg;
+    *kva = (uint32 *)seg.kva;
+    return 0;
 }
@@ -2,6 +2,7 @@
 
 #include "defs.h"
 #include "kalloc.h"
+#include "sbi.h"
 
 static allocator_t mm_allocator;
 static allocator_t vma_allocator;
@@ -24,7 +25,8 @@ void uvm_init() {
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
 pte_t *walk(struct mm *mm, uint64 va, int alloc) {
-    assert(holding(&mm->lock));
+    assert(rwsem_held(&mm->lock));
+    assert(!alloc || rwsem_held_write(&mm->lock) || holding(&mm->pgt_lock));
 
     pagetable_t pagetable = mm->pgt;
 
@@ -38,11 +40,10 @@ pte_t *walk(struct mm *mm, uint64 va, int alloc) {
         } else {
             if (!alloc)
                 return 0;
-            void *pa = kallocpage();
+            void *pa = kallocpage_zeroed();
             if (!pa)
                 return 0;
             pagetable = (pagetable_t)PA_TO_KVA(pa);
-            memset(pagetable, 0, PGSIZE);
             *pte = PA2PTE(KVA_TO_PA(pagetable)) | PTE_V;
         }
     }
@@ -59,7 +60,7 @@ uint64 __pa walkaddr(struct mm *mm, uint64 va) {
     }
 
     assert_str(PGALIGNED(va), "unaligned va %p", va);
-    assert(holding(&mm->lock));
+    assert(rwsem_held(&mm->lock));
 
     pte_t *pte;
     uint64 pa;
@@ -89,42 +90,44 @@ uint64 useraddr(struct mm *mm, uint64 va) {
  * @brief Create a new mm structure and a page table.
  *
  * Then map the trapframe and trampoline in the new mm.
+ * Without @tf, the mm can never run (e.g. an app template), and no trapframe is mapped.
  */
 struct mm *mm_create(struct trapframe *tf) {
     struct mm *mm = kalloc(&mm_allocator);
     memset(mm, 0, sizeof(*mm));
-    spinlock_init(&mm->lock, "mm");
+    rwsem_init(&mm->lock, "mm");
+    spinlock_init(&mm->pgt_lock, "pgt");
     mm->vma    = NULL;
     mm->refcnt = 1;
 
-    void *pa = kallocpage();
+    void *pa = kallocpage_zeroed();
     if (!pa) {
         warnf("kallocpage failed for root page table");
         goto free_mm;
     }
     mm->pgt = (pagetable_t)PA_TO_KVA(pa);
-    memset(mm->pgt, 0, PGSIZE);
-    acquire(&mm->lock);
+    down_write(&mm->lock);
 
     // map trapframe and trampoline in the new mm
     if (mm_mappageat(mm, TRAMPOLINE, KIVA_TO_PA(trampoline), PTE_A | PTE_R | PTE_X) < 0)
         goto free_mm;
 
-    if (mm_mappageat(mm, TRAPFRAME, KVA_TO_PA(tf), PTE_A | PTE_D | PTE_R | PTE_W))
+    if (tf && mm_mappageat(mm, TRAPFRAME, KVA_TO_PA(tf), PTE_A | PTE_D | PTE_R | PTE_W))
         goto free_mm;
 
     return mm;
 
 free_mm:
-    if (mm->pgt)
+    if (mm->pgt) {
         kfreepage((void *)KVA_TO_PA(mm->pgt));
-    release(&mm->lock);
+        up_write(&mm->lock);
+    }
     kfree(&mm_allocator, mm);
     return NULL;
 }
 
 struct vma *mm_create_vma(struct mm *mm) {
-    assert(holding(&mm->lock));
+    assert(rwsem_held_write(&mm->lock));
 
     struct vma *vma = kalloc(&vma_allocator);
     memset(vma, 0, sizeof(*vma));
@@ -132,30 +135,113 @@ struct vma *mm_create_vma(struct mm *mm) {
     return vma;
 }
 
-static void freevma(struct vma *vma, int free_phy_page) {
-    assert(holding(&vma->owner->lock));
+// TLB shootdown.
+// A hart only holds TLB entries of a user mm while it runs in user space: the trampoline
+// switches satp and flushes the whole TLB on every entry to and exit from the kernel.
+// So the harts to flush are those between usertrapret and their next trap with this mm,
+// which mm->cpus_active tracks. A thread of a shared mm on another hart may be one of them.
+
+void mm_enter_user(struct mm *mm) {
+    // ordered before the PTEs are walked, against the fence in mm_flush_tlb.
+    __atomic_fetch_or(&mm->cpus_active, 1ull << cpuid(), __ATOMIC_SEQ_CST);
+}
+
+void mm_exit_user(struct mm *mm) {
+    __atomic_fetch_and(&mm->cpus_active, ~(1ull << cpuid()), __ATOMIC_RELAXED);
+}
+
+// Flush the stale TLB entries of mm, on this hart and on the others running it in user space,
+// and wait until they did. Called after PTEs were removed, downgraded or replaced,
+// before the pages they pointed to are freed or reused.
+void mm_flush_tlb(struct mm *mm) {
+    uint64 harts = 0;
+
+    sfence_vma();
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint64 active = __atomic_load_n(&mm->cpus_active, __ATOMIC_RELAXED);
+    push_off();
+    for (int i = 0; i < NCPU; i++) {
+        if (i != cpuid() && ((active >> i) & 1))
+            harts |= 1ull << getcpu(i)->mhart_id;
+    }
+    pop_off();
+    if (harts != 0 && sbi_remote_sfence_vma(harts, 0) < 0)
+        panic("remote sfence.vma failed, harts %p", harts);
+}
+
+// Pages of the kernel image (the embedded user apps) may be mapped into user space, but never freed.
+static int is_image_page(uint64 __pa pa) {
+    return KERNEL_PHYS_BASE <= pa && pa < kernel_image_end_4k;
+}
+
+// Pages unmapped from mm, handed to the page allocator PGBATCH at a time.
+#define PGBATCH 32
+struct pgbatch {
+    struct mm *mm;
+    void *__pa pages[PGBATCH];
+    int n;
+};
+
+// Free the pages of b, once no hart can reach them through a stale TLB entry.
+static void pgbatch_flush(struct pgbatch *b) {
+    mm_flush_tlb(b->mm);
+    if (b->n > 0)
+        kfreepages(b->pages, b->n);
+    b->n = 0;
+}
+
+static void pgbatch_add(struct pgbatch *b, void *__pa pa) {
+    b->pages[b->n++] = pa;
+    if (b->n == PGBATCH)
+        pgbatch_flush(b);
+}
+
+// Unmap the pages of vma, and free them into b if free_phy_page.
+// The TLB is flushed by pgbatch_flush, once for all the VMAs the caller tears down.
+static void __freevma(struct vma *vma, int free_phy_page, struct pgbatch *b) {
+    assert(rwsem_held_write(&vma->owner->lock));
     assert(PGALIGNED(vma->vm_start) && PGALIGNED(vma->vm_end));
 
     struct mm *mm = vma->owner;
+    // leaf page table of the current 2 MiB region, so that the upper levels are walked once per region.
+    pte_t *l0      = NULL;
+    uint64 l0_base = 0;
     for (uint64 va = vma->vm_start; va < vma->vm_end; va += PGSIZE) {
-        pte_t *pte = walk(mm, va, false);
-        if (pte && (*pte & PTE_V)) {
-            if (free_phy_page)
-                kfreepage((void *)PTE2PA(*pte));
-            *pte = 0;
+        pte_t *pte = NULL;
+        if (l0 != NULL && (va >> PXSHIFT(1)) == l0_base) {
+            pte = &l0[PX(0, va)];
+        } else if ((pte = walk(mm, va, false)) != NULL) {
+            l0      = pte - PX(0, va);
+            l0_base = va >> PXSHIFT(1);
         } else {
+            // no page table for the whole region: skip it.
+            if (!vma->backing)
+                debugf("free unmapped region %p", va);
+            va = MIN(ROUNDUP_2N(va + 1, 1ull << PXSHIFT(1)), vma->vm_end) - PGSIZE;
+            continue;
+        }
+        if (*pte & PTE_V) {
+            if (free_phy_page && !is_image_page(PTE2PA(*pte)))
+                pgbatch_add(b, (void *)PTE2PA(*pte));
+            *pte = 0;
+        } else if (!vma->backing) {
             debugf("free unmapped address %p", va);
         }
+        cond_resched();
     }
-    sfence_vma();
 }
 
-void mm_free_vmas(struct mm *mm) {
-    assert(holding(&mm->lock));
+static void freevma(struct vma *vma, int free_phy_page) {
+    struct pgbatch b = {.mm = vma->owner, .n = 0};
 
+    __freevma(vma, free_phy_page, &b);
+    pgbatch_flush(&b);
+}
+
+static void __mm_free_vmas(struct mm *mm, struct pgbatch *b) {
     struct vma *next, *vma = mm->vma;
     while (vma) {
-        freevma(vma, true);
+        __freevma(vma, true, b);
         next = vma->next;
         kfree(&vma_allocator, vma);
         vma = next;
@@ -163,35 +249,66 @@ void mm_free_vmas(struct mm *mm) {
     mm->vma = NULL;
 }
 
+void mm_free_vmas(struct mm *mm) {
+    assert(rwsem_held_write(&mm->lock));
+
+    struct pgbatch b = {.mm = mm, .n = 0};
+    __mm_free_vmas(mm, &b);
+    pgbatch_flush(&b);
+}
+
 /**
  * @brief Free the page table, recursively. But do not free the PA stored in PTE.
  */
-static void freepgt(pagetable_t pgt) {
+static void freepgt(pagetable_t pgt, struct pgbatch *b) {
     for (int i = 0; i < 512; i++) {
         if ((pgt[i] & PTE_V) && (pgt[i] & PTE_RWX) == 0) {
-            freepgt((pagetable_t)PA_TO_KVA(PTE2PA(pgt[i])));
+            freepgt((pagetable_t)PA_TO_KVA(PTE2PA(pgt[i])), b);
             pgt[i] = 0;
         }
     }
-    kfreepage((void *)KVA_TO_PA(pgt));
+    pgbatch_add(b, (void *)KVA_TO_PA(pgt));
 }
 
 /**
  * @brief Free the mm structure, including all VMAs and the page table.
+ * The pages go back to the allocator in batches, with a single TLB flush for the whole mm.
  */
 void mm_free(struct mm *mm) {
-    assert(holding(&mm->lock));
-    assert(mm->refcnt > 0);
+    assert(rwsem_held_write(&mm->lock));
+    assert(mm->refcnt <= 1);
 
-    mm_free_vmas(mm);
-    freepgt(mm->pgt);
+    struct pgbatch b = {.mm = mm, .n = 0};
+    __mm_free_vmas(mm, &b);
+    pgbatch_flush(&b);
+    freepgt(mm->pgt, &b);
+    pgbatch_flush(&b);
 
-    release(&mm->lock);
+    up_write(&mm->lock);
     kfree(&mm_allocator, mm);
 }
 
+static void mm_free_work(struct work *w) {
+    struct mm *mm = (struct mm *)((char *)w - __builtin_offsetof(struct mm, free_work));
+
+    if (!down_write_trylock(&mm->lock))
+        panic("mm_put: unreferenced mm is locked");
+    mm_free(mm);
+}
+
+// Drop a reference to the mm. With the last one, a worker frees it: tearing down a whole address space
+// takes a while, and the callers are on their way out of exit or exec.
+// Caller must not hold mm->lock. Never sleeps: nobody else can hold the lock of an unreferenced mm.
+void mm_put(struct mm *mm) {
+    if (__atomic_sub_fetch(&mm->refcnt, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+    init_work(&mm->free_work, mm_free_work);
+    if (!queue_work(&mm->free_work))
+        mm_free_work(&mm->free_work);  // the workers are not started yet
+}
+
 static int vma_check_overlap(struct mm *mm, uint64 start, uint64 end, struct vma *exclude) {
-    assert(holding(&mm->lock));
+    assert(rwsem_held(&mm->lock));
 
     if (start == end)
         return 0;
@@ -226,7 +343,7 @@ int mm_mappages(struct vma *vma) {
     assert(PGALIGNED(vma->vm_end));
     assert((vma->pte_flags & PTE_R) || (vma->pte_flags & PTE_W) || (vma->pte_flags & PTE_X));
 
-    assert(holding(&vma->owner->lock));
+    assert(rwsem_held_write(&vma->owner->lock));
 
     if (vma_check_overlap(vma->owner, vma->vm_start, vma->vm_end, vma)) {
         errorf("overlap: [%p, %p)", vma->vm_start, vma->vm_end);
@@ -274,6 +391,122 @@ bad:
     return ret;
 }
 
+/**
+ * @brief Map @vma lazily, backed by @size bytes of a read-only image at @src.
+ * No physical page is allocated here, pages are populated by mm_fault on first access.
+ * If the VMA overlaps an existing one, it is freed.
+ */
+int mm_mapimage(struct vma *vma, uint64 __kva src, uint64 size) {
+    assert(PGALIGNED(vma->vm_start));
+    assert(PGALIGNED(vma->vm_end));
+    assert(rwsem_held_write(&vma->owner->lock));
+
+    struct mm *mm = vma->owner;
+    if (vma_check_overlap(mm, vma->vm_start, vma->vm_end, vma)) {
+        errorf("overlap: [%p, %p)", vma->vm_start, vma->vm_end);
+        kfree(&vma_allocator, vma);
+        return -EINVAL;
+    }
+    vma->backing      = src;
+    vma->backing_size = size;
+
+    vma->next = mm->vma;
+    mm->vma   = vma;
+    return 0;
+}
+
+static struct vma *vma_lookup(struct mm *mm, uint64 va) {
+    for (struct vma *vma = mm->vma; vma; vma = vma->next) {
+        if (vma->vm_start <= va && va < vma->vm_end)
+            return vma;
+    }
+    return NULL;
+}
+
+static int __mm_fault(struct mm *mm, uint64 va, int write) {
+
+    va              = PGROUNDDOWN(va);
+    struct vma *vma = vma_lookup(mm, va);
+    if (vma == NULL)
+        return -EINVAL;
+    if (write && !(vma->pte_flags & PTE_W))
+        return -EINVAL;
+
+    pte_t *pte = walk(mm, va, vma->backing != 0);
+    if (pte == NULL)
+        return vma->backing ? -ENOMEM : -EINVAL;
+    if (!(*pte & PTE_V) && !vma->backing)
+        return -EINVAL;
+
+    uint64 off       = va - vma->vm_start;
+    uint64 __kva src = vma->backing + off;
+    uint64 flags     = vma->pte_flags | PTE_V | PTE_A;
+
+    if (*pte & PTE_V) {
+        // only a write to a shared page is expected here.
+        if (!write || (*pte & PTE_W))
+            return -EINVAL;
+        uint64 old = PTE2PA(*pte);
+        if (!is_image_page(old)) {
+            if (kpage_refcnt((void *)old) == 1) {
+                // the others are gone, the page is ours now.
+                *pte |= PTE_W | PTE_D | PTE_A;
+                sfence_vma();
+                return 0;
+            }
+            void *pa = kallocpage();
+            if (!pa)
+                return -ENOMEM;
+            memmove((void *)PA_TO_KVA(pa), (void *)PA_TO_KVA(old), PGSIZE);
+            *pte = PA2PTE(pa) | flags | PTE_D;
+            mm_flush_tlb(mm);
+            kfreepage((void *)old);
+            return 0;
+        }
+    } else if (!write && off + PGSIZE <= vma->backing_size && PGALIGNED(src)) {
+        *pte = PA2PTE(KIVA_TO_PA(src)) | (flags & ~PTE_W);
+        sfence_vma();
+        return 0;
+    }
+
+    uint64 n = off < vma->backing_size ? MIN(vma->backing_size - off, PGSIZE) : 0;
+    void *pa = n == 0 ? kallocpage_zeroed() : kallocpage();
+    if (!pa)
+        return -ENOMEM;
+    void *__kva kva = (void *)PA_TO_KVA(pa);
+    if (n > 0 && n < PGSIZE)
+        pagezero(kva);
+    memmove(kva, (void *)src, n);
+
+    // replacing a shared image page: the other harts must not keep reading the old one.
+    int replace = *pte & PTE_V;
+    *pte        = PA2PTE(pa) | flags | (write ? PTE_D : 0);
+    if (replace)
+        mm_flush_tlb(mm);
+    else
+        sfence_vma();
+    return 0;
+}
+
+/**
+ * @brief Resolve a fault at @va: populate a lazily mapped VMA, or break a copy-on-write sharing.
+ *
+ * Pages fully covered by a page-aligned image are mapped to the image itself, read-only
+ * (even in a writable VMA), and shared by every mm mapping them.
+ * Other pages, and the first write to a shared page, get a private copy.
+ * A page of a writable VMA mapped without PTE_W is shared, with the kernel image or copy-on-write.
+ *
+ * @return 0 if the access can be retried, -EINVAL for a bad access, -ENOMEM.
+ */
+int mm_fault(struct mm *mm, uint64 va, int write) {
+    assert(rwsem_held(&mm->lock));
+
+    acquire(&mm->pgt_lock);
+    int ret = __mm_fault(mm, va, write);
+    release(&mm->pgt_lock);
+    return ret;
+}
+
 // Remap a range of virtual address to a new range.
 // The new range must not overlap with any existing range.
 // Used in sbrk.
@@ -284,8 +517,9 @@ int mm_remap(struct vma *vma, uint64 start, uint64 end, uint64 pte_flags) {
     debugf("remap: [%p, %p), flags = %p", start, end, pte_flags);
 
     pte_t *pte;
-    struct mm *mm = vma->owner;
-    assert(holding(&mm->lock));
+    struct mm *mm    = vma->owner;
+    struct pgbatch b = {.mm = mm, .n = 0};
+    assert(rwsem_held_write(&mm->lock));
 
     if (vma_check_overlap(mm, start, end, vma)) {
         errorf("overlap: [%p, %p)", start, end);
@@ -324,20 +558,22 @@ int mm_remap(struct vma *vma, uint64 start, uint64 end, uint64 pte_flags) {
     }
 
     // then, we are free from trying to allocate new physical pages.
+    // The removed pages are freed once no hart can reach them, and the downgraded flags are in effect.
     for (uint64 va = iterstart; va < iterend; va += PGSIZE) {
         if (va < start || va >= end) {
             // this mapping should be removed
             pte = walk(mm, va, 0);
             if (pte && (*pte & PTE_V)) {
-                kfreepage((void *)PTE2PA(*pte));
+                pgbatch_add(&b, (void *)PTE2PA(*pte));
                 *pte = 0;
             } else {
                 errorf("remap: mapping should exist, va = %p", va);
+                pgbatch_flush(&b);
                 return -EINVAL;
             }
         }
     }
-    sfence_vma();
+    pgbatch_flush(&b);
 
     vma->vm_start  = start;
     vma->vm_end    = end;
@@ -350,7 +586,7 @@ err:
             // this mapping should be removed
             pte = walk(mm, va, 0);
             if (pte && (*pte & PTE_V)) {
-                kfreepage((void *)PTE2PA(*pte));
+                pgbatch_add(&b, (void *)PTE2PA(*pte));
                 *pte = 0;
             }
         } else {
@@ -364,12 +600,13 @@ err:
             }
         }
     }
+    pgbatch_flush(&b);
     return -ENOMEM;
 }
 
 // Map a physical page to a virtual address.
 int mm_mappageat(struct mm *mm, uint64 va, uint64 __pa pa, uint64 flags) {
-    assert(holding(&mm->lock));
+    assert(rwsem_held_write(&mm->lock));
 
     if (!IS_USER_VA(va))
         panic("invalid user VA");
@@ -398,12 +635,52 @@ int mm_mappageat(struct mm *mm, uint64 va, uint64 __pa pa, uint64 flags) {
     return 0;
 }
 
+// Copy the populated pages of a lazily mapped VMA.
+// Kernel image pages are shared, the others are copied.
+static int mm_copy_image_vma(struct vma *vma, struct vma *new_vma) {
+    struct mm *old = vma->owner, *new = new_vma->owner;
+
+    if (mm_mapimage(new_vma, vma->backing, vma->backing_size) < 0)
+        return -EINVAL;
+    for (uint64 va = vma->vm_start; va < vma->vm_end; va += PGSIZE) {
+        pte_t *pte_old = walk(old, va, 0);
+        if (pte_old == NULL || !(*pte_old & PTE_V))
+            continue;
+        pte_t *pte_new = walk(new, va, 1);
+        if (pte_new == NULL)
+            return -ENOMEM;
+        uint64 pa = PTE2PA(*pte_old);
+        if (!is_image_page(pa)) {
+            void *newpa = kallocpage();
+            if (!newpa)
+                return -ENOMEM;
+            memmove((void *)PA_TO_KVA(newpa), (void *)PA_TO_KVA(pa), PGSIZE);
+            pa = (uint64)newpa;
+        }
+        *pte_new = PA2PTE(pa) | PTE_FLAGS(*pte_old);
+    }
+    return 0;
+}
+
+// Unmap a page mapped by mm_mappageat. The physical page is not freed.
+void mm_unmappageat(struct mm *mm, uint64 va) {
+    assert(rwsem_held_write(&mm->lock));
+
+    pte_t *pte = walk(mm, va, 0);
+    if (pte == NULL || !(*pte & PTE_V)) {
+        errorf("unmap unmapped %p", va);
+        return;
+    }
+    *pte = 0;
+    mm_flush_tlb(mm);
+}
+
 // Used in fork.
 // Copy the pagetable page and all the user pages.
 // Return 0 on success, negative on error.
 int mm_copy(struct mm *old, struct mm *new) {
-    assert(holding(&old->lock));
-    assert(holding(&new->lock));
+    assert(rwsem_held_write(&old->lock));
+    assert(rwsem_held_write(&new->lock));
     struct vma *vma = old->vma;
 
     while (vma) {
@@ -412,6 +689,14 @@ int mm_copy(struct mm *old, struct mm *new) {
         new_vma->vm_start   = vma->vm_start;
         new_vma->vm_end     = vma->vm_end;
         new_vma->pte_flags  = vma->pte_flags;
+        if (vma->backing) {
+            if (mm_copy_image_vma(vma, new_vma) < 0) {
+                warnf("mm_copy_image_vma failed");
+                goto err;
+            }
+            vma = vma->next;
+            continue;
+        }
         if (mm_mappages(new_vma)) {
             warnf("mm_mappages failed");
             // when failed, new_vma is not inserted into mm->vma list.
@@ -422,6 +707,7 @@ int mm_copy(struct mm *old, struct mm *new) {
             void *__kva pa_old = (void *)PA_TO_KVA(walkaddr(old, va));
             void *__kva pa_new = (void *)PA_TO_KVA(walkaddr(new, va));
             memmove(pa_new, pa_old, PGSIZE);
+            cond_resched();
         }
         vma = vma->next;
     }
@@ -432,8 +718,53 @@ err:
     return -ENOMEM;
 }
 
+/**
+ * @brief Make @dst a copy-on-write clone of @src: the same VMAs, with every populated page shared.
+ * Writable pages lose PTE_W in both mms, mm_fault copies them on the first write.
+ * @dst must not have any VMA yet.
+ * @return 0 on success, -ENOMEM.
+ */
+int mm_clone(struct mm *src, struct mm *dst) {
+    assert(rwsem_held_write(&src->lock));
+    assert(rwsem_held_write(&dst->lock));
+    assert(dst->vma == NULL);
+
+    for (struct vma *vma = src->vma; vma; vma = vma->next) {
+        struct vma *new_vma   = mm_create_vma(dst);
+        new_vma->vm_start     = vma->vm_start;
+        new_vma->vm_end       = vma->vm_end;
+        new_vma->pte_flags    = vma->pte_flags;
+        new_vma->backing      = vma->backing;
+        new_vma->backing_size = vma->backing_size;
+        new_vma->next         = dst->vma;
+        dst->vma              = new_vma;
+
+        for (uint64 va = vma->vm_start; va < vma->vm_end; va += PGSIZE) {
+            pte_t *pte = walk(src, va, 0);
+            if (pte == NULL || !(*pte & PTE_V))
+                continue;
+            pte_t *new_pte = walk(dst, va, 1);
+            if (new_pte == NULL)
+                goto err;
+            if (!is_image_page(PTE2PA(*pte)))
+                kpage_dup((void *)PTE2PA(*pte));
+            *pte &= ~PTE_W;
+            *new_pte = *pte;
+            cond_resched();
+        }
+    }
+    // the threads of src on other harts must not write to the pages now shared.
+    mm_flush_tlb(src);
+    return 0;
+
+err:
+    mm_flush_tlb(src);
+    mm_free_vmas(dst);
+    return -ENOMEM;
+}
+
 struct vma *mm_find_vma(struct mm *mm, uint64 va) {
-    assert(holding(&mm->lock));
+    assert(rwsem_held(&mm->lock));
 
     struct vma *vma = mm->vma;
     while (vma) {
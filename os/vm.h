@@ -4,6 +4,7 @@
 #include "lock.h"
 #include "riscv.h"
 #include "types.h"
+#include "workqueue.h"
 
 #define __user
 #define __pa
@@ -36,13 +37,27 @@ struct vma {
     uint64 vm_start;
     uint64 vm_end;
     uint64 pte_flags;
+
+    // Lazily populated VMAs (see mm_mapimage) are backed by a read-only image in the kernel.
+    // [vm_start, vm_start + backing_size) comes from backing, the rest is zero-filled.
+    uint64 __kva backing;
+    uint64 backing_size;
 };
+// mm->lock is held for reading to resolve faults and translate user addresses (mm_fault, uaccess),
+// and for writing to change the VMAs or copy the whole mm.
+// Page table updates under the read lock, from mm_fault, are serialized by pgt_lock.
 struct mm {
-    spinlock_t lock;
+    rwsem_t lock;
+    spinlock_t pgt_lock;
 
     pagetable_t __kva pgt;
     struct vma* vma;
+    struct vma* vma_brk;  // special vma for heap, included in the vma list.
+    uint64 brk;           // end address of heap
     int refcnt;
+    uint64 cpus_active;     // cpus running it in user space, see mm_flush_tlb
+    struct work free_work;  // frees it once the last reference is dropped, see mm_put
+    char *app;              // name of the app loaded in it, for the profiler
 };
 
 // kvm.c
@@ -61,16 +76,26 @@ struct mm *mm_create(struct trapframe* tf);
 struct vma* mm_create_vma(struct mm* mm);
 void mm_free_vmas(struct mm* mm);
 void mm_free(struct mm* mm);
+void mm_put(struct mm* mm);
 int mm_mappages(struct vma* vma);
+int mm_mapimage(struct vma* vma, uint64 __kva src, uint64 size);
+int mm_fault(struct mm* mm, uint64 va, int write);
 int mm_remap(struct vma *vma, uint64 start, uint64 end, uint64 pte_flags);
 int mm_mappageat(struct mm *mm, uint64 va, uint64 __pa pa, uint64 flags);
+void mm_unmappageat(struct mm *mm, uint64 va);
 int mm_copy(struct mm* old, struct mm* new);
+int mm_clone(struct mm* src, struct mm* dst);
+void mm_flush_tlb(struct mm* mm);
+void mm_enter_user(struct mm* mm);
+void mm_exit_user(struct mm* mm);
 struct vma* mm_find_vma(struct mm* mm, uint64 va);
 
-// uaccess.c
+// uaccess.c, callers must not hold mm->lock
 int copy_to_user(struct mm* mm, uint64 __user dstva, char* src, uint64 len);
 int copy_from_user(struct mm* mm, char* dst, uint64 __user srcva, uint64 len);
 int copystr_from_user(struct mm* mm, char* dst, uint64 __user srcva, uint64 max);
+int64 strnlen_user(struct mm* mm, uint64 __user srcva, uint64 max);
+int uaccess_word(struct mm* mm, uint64 __user va, uint32* __kva* kva);
 
 void vm_print(pagetable_t pagetable);
 
@@ -0,0 +1,125 @@
+#include "workqueue.h"
+
+#include "defs.h"
+
+// Each cpu has a queue, served by its own worker thread, bound to it:
+// work runs on the cpu that queued it, where its data is likely cached.
+// Only the nr_cpus harts that booted have a worker: a worker bound to a cpu that never runs
+// would never drain its queue.
+
+struct workqueue {
+    spinlock_t lock;
+    struct work *head;  // oldest first
+    struct work *tail;
+    struct proc *worker;
+};
+
+static struct workqueue wqs[NCPU];
+static int wq_ready;  // the workers are started, before that queue_work does nothing
+
+void init_work(struct work *w, void (*func)(struct work *)) {
+    w->next    = NULL;
+    w->func    = func;
+    w->pending = 0;
+}
+
+// Queue w on cpu. Never sleeps: it may be called from interrupt handlers, and with spinlocks held.
+// Return 1 if it was queued, 0 if it is already pending, or the workers are not started yet.
+// Work for a cpu that did not boot goes to cpu 0.
+int queue_work_on(struct work *w, int cpu) {
+    if (!__atomic_load_n(&wq_ready, __ATOMIC_ACQUIRE) || __atomic_exchange_n(&w->pending, 1, __ATOMIC_ACQ_REL))
+        return 0;
+    if (cpu < 0 || cpu >= nr_cpus)
+        cpu = 0;
+
+    struct workqueue *wq = &wqs[cpu];
+    acquire(&wq->lock);
+    w->next = NULL;
+    if (wq->tail != NULL)
+        wq->tail->next = w;
+    else
+        wq->head = w;
+    wq->tail = w;
+
+    // the worker sleeps on wq under wq->lock, so it cannot miss this. See sleep() for the unlocked check.
+    struct proc *p = wq->worker;
+    if (__atomic_load_n(&p->state, __ATOMIC_RELAXED) == SLEEPING) {
+        acquire(&p->lock);
+        if (p->state == SLEEPING && p->sleep_chan == wq)
+            wake_task(p);
+        release(&p->lock);
+    }
+    release(&wq->lock);
+    return 1;
+}
+
+// Queue w on this cpu.
+int queue_work(struct work *w) {
+    push_off();
+    int ret = queue_work_on(w, cpuid());
+    pop_off();
+    return ret;
+}
+
+struct flush_barrier {
+    struct work work;
+    int cpu;
+    int done;
+};
+
+static void flush_done(struct work *w) {
+    struct flush_barrier *b = (struct flush_barrier *)w;
+
+    acquire(&wqs[b->cpu].lock);
+    b->done = 1;
+    wakeup(b);
+    release(&wqs[b->cpu].lock);
+}
+
+// Wait until the work queued on every cpu before the call has run. Sleeps.
+void flush_workqueues() {
+    if (!__atomic_load_n(&wq_ready, __ATOMIC_ACQUIRE))
+        return;
+    for (int i = 0; i < nr_cpus; i++) {
+        struct flush_barrier b = {.cpu = i, .done = 0};
+        init_work(&b.work, flush_done);
+        queue_work_on(&b.work, i);
+        acquire(&wqs[i].lock);
+        while (!b.done)
+            sleep(&b, &wqs[i].lock);
+        release(&wqs[i].lock);
+    }
+}
+
+static void worker(void *arg) {
+    struct workqueue *wq = arg;
+
+    for (;;) {
+        acquire(&wq->lock);
+        while (wq->head == NULL)
+            sleep(wq, &wq->lock);
+        struct work *w = wq->head;
+        wq->head       = NULL;
+        wq->tail       = NULL;
+        release(&wq->lock);
+
+        while (w != NULL) {
+            struct work *next = w->next;
+            // w may be queued again from here on, and its next pointer reused.
+            __atomic_store_n(&w->pending, 0, __ATOMIC_RELEASE);
+            w->func(w);
+            w = next;
+        }
+    }
+}
+
+// Start a worker for each booted cpu. Called at boot, once the first process exists and nr_cpus is known.
+void workqueue_init() {
+    for (int i = 0; i < nr_cpus; i++) {
+        spinlock_init(&wqs[i].lock, "workqueue");
+        wqs[i].worker = kthread_create("kworker", worker, &wqs[i], i);
+        if (wqs[i].worker == NULL)
+            panic("workqueue_init: kthread_create");
+    }
+    __atomic_store_n(&wq_ready, 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,25 @@
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include "types.h"
+
+// Deferred work: a function run later by the worker kernel thread of a cpu, in process context,
+// with interrupts on. Interrupt handlers and syscalls queue what does not need to be done right away,
+// so they spend less time with interrupts off, and return sooner.
+//
+// A work item is queued at most once at a time: queuing it again before its function starts does nothing.
+// It may be queued again from its own function.
+
+struct work {
+    struct work *next;
+    void (*func)(struct work *);
+    int pending;  // queued, and func not started yet
+};
+
+void init_work(struct work *w, void (*func)(struct work *));
+int queue_work(struct work *w);
+int queue_work_on(struct work *w, int cpu);
+void flush_workqueues();
+void workqueue_init();
+
+#endif  // WORKQUEUE_H
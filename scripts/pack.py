@@ -1,13 +1,59 @@
 import os
+import struct
 
 TARGET_DIR = "./user/build/stripped/"
 
+# must match struct user_app in os/loader.h
+APP_MAX_SEGS = 4
+PT_LOAD = 1
+
 import argparse
 
+
+# FNV-1a, seeded. Must match app_name_hash() in os/loader.c
+def fnv1a(name, seed):
+    h = (2166136261 ^ seed) & 0xffffffff
+    for b in name.encode():
+        h ^= b
+        h = (h * 16777619) & 0xffffffff
+    return h
+
+
+# Find a seed and a power-of-two table size such that every app lands in its own slot,
+# so a lookup is a single probe.
+def perfect_hash(names):
+    size = 8
+    while size < 4 * len(names):
+        size *= 2
+    while True:
+        for seed in range(4096):
+            slots = set(fnv1a(n, seed) & (size - 1) for n in names)
+            if len(slots) == len(names):
+                return seed, size
+        size *= 2
+
+
+# Summarize the ELF: entry point and PT_LOAD segments.
+def parse_elf(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    assert data[:4] == b"\x7fELF", f"{path}: not an ELF file"
+    entry, phoff = struct.unpack_from("<QQ", data, 24)
+    phentsize, phnum = struct.unpack_from("<HH", data, 54)
+    segs = []
+    for i in range(phnum):
+        p_type, p_flags, p_offset, p_vaddr, _, p_filesz, p_memsz, _ = struct.unpack_from("<IIQQQQQQ", data, phoff + i * phentsize)
+        if p_type == PT_LOAD:
+            segs.append((p_vaddr, p_memsz, p_filesz, p_offset, p_flags))
+    assert len(segs) <= APP_MAX_SEGS, f"{path}: too many PT_LOAD segments"
+    return entry, segs
+
+
 if __name__ == '__main__':
     f = open("os/link_app.S", mode="w")
     apps = os.listdir(TARGET_DIR)
     apps.sort()
+    seed, size = perfect_hash(apps)
     f.write(
 '''
     .align 3
@@ -18,23 +64,54 @@ user_apps:
     )
 
     for app in apps:
-        size = os.path.getsize(TARGET_DIR + app)
+        size_bytes = os.path.getsize(TARGET_DIR + app)
+        entry, segs = parse_elf(TARGET_DIR + app)
         f.write(f'''
     .quad .str_{app}
     .quad .elf_{app}
-    .quad {size}
+    .quad {size_bytes}
+    .quad {len(app)}
+    .quad {fnv1a(app, seed)}
+    .quad {entry}
+    .quad {len(segs)}
 '''
         )
-    
+        for i in range(APP_MAX_SEGS):
+            vaddr, memsz, filesz, offset, flags = segs[i] if i < len(segs) else (0, 0, 0, 0, 0)
+            f.write(f'''    .quad {vaddr}, {memsz}, {filesz}, {offset}, {flags}
+'''
+            )
+
     # in the end, append a NULL structure.
     f.write(
 f'''
     .quad 0
     .quad 0
     .quad 0
+    .zero {(4 + 5 * APP_MAX_SEGS) * 8}
 '''
     )
 
+    # hash table: slot -> index in user_apps + 1, 0 for an empty slot.
+    slots = [0] * size
+    for i, app in enumerate(apps):
+        slots[fnv1a(app, seed) & (size - 1)] = i + 1
+    f.write(
+f'''
+    .align 3
+    .global user_apps_hash_seed
+user_apps_hash_seed:
+    .quad {seed}
+    .global user_apps_hash_mask
+user_apps_hash_mask:
+    .quad {size - 1}
+    .global user_apps_hash
+user_apps_hash:
+'''
+    )
+    for i in range(0, size, 16):
+        f.write("    .short " + ", ".join(str(s) for s in slots[i:i + 16]) + "\n")
+
     # include apps elf file.
     f.write(
 '''
@@ -46,9 +123,10 @@ f'''
 f'''
 .str_{app}:
     .string "{app}"
-.align 3
+# page-aligned, so the kernel can map the read-only segments of the app directly.
+.align 12
 .elf_{app}:
     .incbin "{TARGET_DIR}{app}"
 '''
-    )
-    f.close()
\ No newline at end of file
+        )
+    f.close()
@@ -0,0 +1,119 @@
+import argparse
+import bisect
+import os
+import re
+import sys
+from collections import Counter
+
+# Turn the samples printed by the `prof` user program (see user/src/prof.c) into folded stacks,
+# one line per distinct stack with its sample count, the outermost frame first:
+#   app;user frames..;kernel frames.. count
+# which is what flamegraph.pl and speedscope read. For example:
+#   make run | tee qemu.log        # then `prof -u proctest` in the shell
+#   python3 scripts/profile.py qemu.log > out.folded
+#   flamegraph.pl out.folded > out.svg
+
+
+class Symbols:
+    def __init__(self, syms):
+        syms.sort()
+        self.addrs = [a for a, _ in syms]
+        self.names = [n for _, n in syms]
+
+    def lookup(self, pc):
+        i = bisect.bisect_right(self.addrs, pc) - 1
+        if i < 0:
+            return f"{pc:#x}"
+        return self.names[i]
+
+
+# build/kernel.sym: "address name" lines, from objdump -t.
+def load_kernel_sym(path):
+    syms = []
+    with open(path) as f:
+        for line in f:
+            parts = line.split()
+            if len(parts) != 2:
+                continue
+            try:
+                addr = int(parts[0], 16)
+            except ValueError:
+                continue
+            # skip the section names and the absolute symbols at 0.
+            if addr != 0 and not parts[1].startswith("."):
+                syms.append((addr, parts[1]))
+    return Symbols(syms)
+
+
+FUNC_RE = re.compile(r"^([0-9a-f]+) <([^>]+)>:$")
+
+
+# user/build/<app>.asm: objdump -S output, functions start with "address <name>:".
+def load_user_asm(path):
+    syms = []
+    with open(path) as f:
+        for line in f:
+            m = FUNC_RE.match(line.strip())
+            if m:
+                syms.append((int(m.group(1), 16), m.group(2)))
+    return Symbols(syms)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="symbolize prof samples into folded stacks")
+    parser.add_argument("log", nargs="?", help="console output with @prof lines, stdin by default")
+    parser.add_argument("-k", "--kernel-sym", default="build/kernel.sym")
+    parser.add_argument("-u", "--user-dir", default="user/build", help="where the <app>.asm files are")
+    parser.add_argument("--pid", type=int, help="only the samples of this pid")
+    parser.add_argument("--top", type=int, help="print the N functions with the most samples instead")
+    args = parser.parse_args()
+
+    kernel = load_kernel_sym(args.kernel_sym)
+    apps = {}
+
+    def user_symbols(app):
+        if app not in apps:
+            path = os.path.join(args.user_dir, app + ".asm")
+            apps[app] = load_user_asm(path) if os.path.exists(path) else None
+        return apps[app]
+
+    stacks = Counter()
+    leaves = Counter()
+    f = open(args.log) if args.log else sys.stdin
+    for line in f:
+        # the console may have other output on the same line before ours.
+        at = line.find("@prof ")
+        if at < 0:
+            continue
+        parts = line[at:].split()
+        try:
+            cpu, pid, app, nkernel = int(parts[1]), int(parts[2]), parts[3], int(parts[4])
+            pcs = [int(p, 16) for p in parts[5:]]
+        except (IndexError, ValueError):
+            continue  # a line cut by other output
+        if args.pid is not None and pid != args.pid:
+            continue
+
+        # return addresses point after the call, look up the call itself.
+        # The first pc of each part is where the trap landed, exact.
+        def frames(pcs, syms):
+            return [syms.lookup(pc if i == 0 else pc - 1) if syms else f"{pc:#x}" for i, pc in enumerate(pcs)]
+
+        kframes = frames(pcs[:nkernel], kernel)
+        uframes = frames(pcs[nkernel:], user_symbols(app)) if app != "-" else []
+        root = app if pid != 0 else "[idle]"
+        stack = [root] + uframes[::-1] + kframes[::-1]
+        stacks[";".join(stack)] += 1
+        leaves[stack[-1]] += 1
+
+    if args.top:
+        total = sum(leaves.values())
+        for name, n in leaves.most_common(args.top):
+            print(f"{n * 100 / total:6.2f}% {n:8d} {name}")
+    else:
+        for stack, n in sorted(stacks.items()):
+            print(f"{stack} {n}")
+
+
+if __name__ == '__main__':
+    main()
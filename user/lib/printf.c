@@ -16,6 +16,7 @@ struct print_buf {
     int len;
 };
 
+static mutex_t stdout_lock;  // threads share stdoutbuf
 static char stdout_buf[1024];
 static struct print_buf stdoutbuf = {
     .buf  = stdout_buf,
@@ -152,5 +153,7 @@ void printf(const char *fmt, ...) {
     va_list ap;
 
     va_start(ap, fmt);
+    mutex_lock(&stdout_lock);
     vprintf(&stdoutbuf, fmt, ap);
+    mutex_unlock(&stdout_lock);
 }
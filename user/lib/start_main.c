@@ -1,9 +1,15 @@
 #include "syscall.h"
+#include "user.h"
 
 extern int main(int, char **);
+extern thread_t main_thread;
 
-__attribute__((section(".text.entry"))) int __start_main(int argc, char *argv[])
+char **environ;
+
+__attribute__((section(".text.entry"))) int __start_main(int argc, char *argv[], char *envp[])
 {
+	environ = envp;
+	asm volatile("mv tp, %0" ::"r"(&main_thread));
 	exit(main(argc, argv));
 	return 0;
 }
\ No newline at end of file
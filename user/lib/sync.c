@@ -0,0 +1,98 @@
+#include "user.h"
+
+// The fast paths are a single atomic instruction, futex() is only called when a task must sleep,
+// or when there may be someone to wake up.
+
+#define xchg(p, v)   __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST)
+#define cas(p, o, n) ({ int __o = (o); __atomic_compare_exchange_n(p, &__o, n, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); })
+
+void mutex_init(mutex_t *m) {
+    m->state = 0;
+}
+
+// Take m, assuming others may be waiting: we then wake one of them up when we unlock.
+static void mutex_lock_contended(mutex_t *m) {
+    while (xchg(&m->state, 2) != 0)
+        futex(&m->state, FUTEX_WAIT, 2, 0, NULL);
+}
+
+void mutex_lock(mutex_t *m) {
+    if (!cas(&m->state, 0, 1))
+        mutex_lock_contended(m);
+}
+
+int mutex_trylock(mutex_t *m) {
+    return cas(&m->state, 0, 1);
+}
+
+void mutex_unlock(mutex_t *m) {
+    if (__atomic_fetch_sub(&m->state, 1, __ATOMIC_SEQ_CST) != 1) {
+        __atomic_store_n(&m->state, 0, __ATOMIC_SEQ_CST);
+        futex(&m->state, FUTEX_WAKE, 1, 0, NULL);
+    }
+}
+
+void cond_init(cond_t *c) {
+    c->seq = 0;
+    c->m   = NULL;
+}
+
+int cond_timedwait(cond_t *c, mutex_t *m, uint64 ticks) {
+    int seq = __atomic_load_n(&c->seq, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&c->m, m, __ATOMIC_RELAXED);
+
+    mutex_unlock(m);
+    // returns at once if a signal came in since we read seq.
+    int ret = futex(&c->seq, FUTEX_WAIT, seq, ticks, NULL);
+    mutex_lock_contended(m);
+    return ret == -ETIMEDOUT ? -ETIMEDOUT : 0;
+}
+
+void cond_wait(cond_t *c, mutex_t *m) {
+    cond_timedwait(c, m, 0);
+}
+
+void cond_signal(cond_t *c) {
+    __atomic_add_fetch(&c->seq, 1, __ATOMIC_SEQ_CST);
+    futex(&c->seq, FUTEX_WAKE, 1, 0, NULL);
+}
+
+// Wake up one waiter, and move the others to the mutex: they would only fight for it anyway.
+void cond_broadcast(cond_t *c) {
+    mutex_t *m = __atomic_load_n(&c->m, __ATOMIC_RELAXED);
+
+    __atomic_add_fetch(&c->seq, 1, __ATOMIC_SEQ_CST);
+    if (m == NULL)
+        futex(&c->seq, FUTEX_WAKE, 0x7fffffff, 0, NULL);
+    else
+        futex(&c->seq, FUTEX_REQUEUE, 1, 0x7fffffff, &m->state);
+}
+
+void sem_init(sem_t *s, int count) {
+    s->count   = count;
+    s->waiters = 0;
+}
+
+int sem_trywait(sem_t *s) {
+    int v = __atomic_load_n(&s->count, __ATOMIC_SEQ_CST);
+    while (v > 0) {
+        if (__atomic_compare_exchange_n(&s->count, &v, v - 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            return 1;
+    }
+    return 0;
+}
+
+void sem_wait(sem_t *s) {
+    while (!sem_trywait(s)) {
+        // sem_post raises count before it reads waiters, so either it sees us, or the kernel sees count > 0.
+        __atomic_add_fetch(&s->waiters, 1, __ATOMIC_SEQ_CST);
+        futex(&s->count, FUTEX_WAIT, 0, 0, NULL);
+        __atomic_sub_fetch(&s->waiters, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+void sem_post(sem_t *s) {
+    __atomic_add_fetch(&s->count, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&s->waiters, __ATOMIC_SEQ_CST) > 0)
+        futex(&s->count, FUTEX_WAKE, 1, 0, NULL);
+}
@@ -4,18 +4,62 @@
 #include "../../os/types.h"
 #include "../../os/syscall_ids.h"
 #include "../../os/signal/signal.h"
+#include "../../os/spawn.h"
+#include "../../os/futex.h"
+#include "../../os/sched.h"
+#include "../../os/sysstat.h"
+#include "../../os/profile.h"
 
 // we only put syscall prototypes here, usys.pl will generate the actual syscall entry code
 int fork();
 int exec(char *path, char *argv[]);
+int execve(char *path, char *argv[], char *envp[]);
+// spawn: create a child running path, attr may be NULL. Return the child's pid.
+int spawn(char *path, char *argv[], struct spawnattr *attr);
+// vfork: the child borrows our memory and must only exec or exit, we are suspended until it does.
+int vfork();
 void __attribute__((noreturn)) exit(int status);
 void kill(int pid);
 int wait(int pid, int *status);
 int getpid();
 int getppid();
+int gettid();
+// clone: start a thread of ours running entry(arg) on stack, with tp = tls. Return its tid.
+// If ctid is not NULL, the kernel stores the tid there, then clears it and wakes it up as a futex when the thread exits.
+int clone(void (*entry)(void *), void *arg, void *stack, void *tls, int *ctid);
+// exit_thread: exit the calling thread only. exit() ends all the threads of the process.
+void __attribute__((noreturn)) exit_thread(int status);
 
 int sleep(int ticks);
 void yield();
+// setpriority: set the nice value (-20 .. 19, lower runs first) of task pid, 0 for ourselves.
+int setpriority(int pid, int nice);
+// getpriority: return 20 - the nice value of task pid, 0 for ourselves, or a negative errno.
+int getpriority(int pid);
+// sched_setattr: set the scheduling policy of task pid, 0 for ourselves, see os/sched.h.
+// Return -EBUSY if a SCHED_DEADLINE task would exceed the bandwidth available.
+int sched_setattr(int pid, struct sched_attr *attr);
+int sched_getattr(int pid, struct sched_attr *attr);
+// sched_setaffinity: run task pid, 0 for ourselves, only on the harts (cpuids) in mask. Inherited by children.
+int sched_setaffinity(int pid, uint64 mask);
+// sched_getaffinity: return the hart mask of task pid, or a negative errno.
+int64 sched_getaffinity(int pid);
+// getcpu: the hart we run on.
+int getcpu();
+// sched_group_create: create a bandwidth group under group parent, whose tasks get quota_us of cpu time
+// every period_us together, or no limit if quota_us is 0. Return its id. Children join the group of their parent.
+int sched_group_create(int parent, uint64 quota_us, uint64 period_us);
+// sched_group_destroy: remove a group, -EBUSY while it has tasks or groups.
+int sched_group_destroy(int id);
+// sched_group_attach: move task pid, 0 for ourselves, to group id.
+int sched_group_attach(int id, int pid);
+int sched_group_stat(int id, struct sched_group_stat *st);
+// sysstat: syscall statistics and tracing, see os/sysstat.h for the operations. Return a negative errno on error.
+int sysstat(int op, int who, void *buf, uint64 len);
+// profile: the sampling profiler, see os/profile.h for the operations. Return a negative errno on error.
+int profile(int op, uint64 arg, void *buf, uint64 len);
+// futex: see os/futex.h for the operations. Return a negative errno on error.
+int futex(int *uaddr, int op, int val, uint64 timeout, int *uaddr2);
 
 void *sbrk(int increment);
 
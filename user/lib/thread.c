@@ -0,0 +1,49 @@
+#include "user.h"
+
+// Each thread has its thread_t in tp, the main thread has main_thread, set by __start_main.
+thread_t main_thread;
+
+thread_t *thread_self() {
+    thread_t *t;
+    asm volatile("mv %0, tp" : "=r"(t));
+    return t;
+}
+
+static void __attribute__((noreturn)) thread_start(void *arg) {
+    thread_t *t = arg;
+    thread_exit(t->fn(t->arg));
+}
+
+// Start fn(arg) in a new thread, described by t until thread_join(t). Return its tid, or a negative errno.
+int thread_create(thread_t *t, void *(*fn)(void *), void *arg) {
+    t->fn    = fn;
+    t->arg   = arg;
+    t->ret   = NULL;
+    t->stack = malloc(THREAD_STACK_SIZE);
+    if (t->stack == NULL)
+        return -ENOMEM;
+
+    // the stack grows down, from a 16-byte aligned top.
+    uint64 top = ((uint64)t->stack + THREAD_STACK_SIZE) & ~15ull;
+    int tid    = clone(thread_start, t, (void *)top, t, &t->tid);
+    if (tid < 0) {
+        free(t->stack);
+        t->stack = NULL;
+    }
+    return tid;
+}
+
+// Wait for t to exit, and return what its function returned.
+void *thread_join(thread_t *t) {
+    int tid;
+    while ((tid = __atomic_load_n(&t->tid, __ATOMIC_ACQUIRE)) != 0)
+        futex(&t->tid, FUTEX_WAIT, tid, 0, NULL);
+    free(t->stack);
+    t->stack = NULL;
+    return t->ret;
+}
+
+void thread_exit(void *ret) {
+    thread_self()->ret = ret;
+    exit_thread(0);
+}
@@ -22,33 +22,75 @@ int strncmp(const char *_l, const char *_r, uint64 n) {
     return *l - *r;
 }
 
+// Word-at-a-time helpers, see os/string.c.
+#define WSIZE      sizeof(uint64)
+#define WMASK      (WSIZE - 1)
+#define ONES       0x0101010101010101ull
+#define HIGHS      0x8080808080808080ull
+#define HASZERO(w) (((w) - ONES) & ~(w) & HIGHS)
+
 uint strlen(const char *s) {
-    int n;
+    const char *p = s;
 
-    for (n = 0; s[n]; n++);
-    return n;
+    while ((uint64)p & WMASK) {
+        if (*p == '\0')
+            return p - s;
+        p++;
+    }
+    // an aligned word never crosses a page boundary, so reading past the NUL is safe.
+    const uint64 *w = (const uint64 *)p;
+    while (!HASZERO(*w)) w++;
+    for (p = (const char *)w; *p; p++);
+    return p - s;
 }
 
 void *memset(void *dst, int c, uint n) {
-    char *cdst = (char *)dst;
-    int i;
-    for (i = 0; i < n; i++) {
-        cdst[i] = c;
+    uchar *d = (uchar *)dst;
+
+    if (n >= 2 * WSIZE) {
+        uint64 w = (uchar)c * ONES;
+        while ((uint64)d & WMASK) {
+            *d++ = c;
+            n--;
+        }
+        uint64 *wd = (uint64 *)d;
+        for (; n >= WSIZE; n -= WSIZE) *wd++ = w;
+        d = (uchar *)wd;
     }
+    while (n-- > 0) *d++ = c;
     return dst;
 }
 
 void *memmove(void *vdst, const void *vsrc, int n) {
     char *dst;
     const char *src;
+    // word copies only when both pointers can be aligned together.
+    int words = n >= (int)(2 * WSIZE) && (((uint64)vdst ^ (uint64)vsrc) & WMASK) == 0;
 
     dst = vdst;
     src = vsrc;
     if (src > dst) {
+        if (words) {
+            while ((uint64)dst & WMASK) {
+                *dst++ = *src++;
+                n--;
+            }
+            for (; n >= (int)WSIZE; n -= WSIZE, dst += WSIZE, src += WSIZE) *(uint64 *)dst = *(const uint64 *)src;
+        }
         while (n-- > 0) *dst++ = *src++;
     } else {
         dst += n;
         src += n;
+        if (words) {
+            while ((uint64)dst & WMASK) {
+                *--dst = *--src;
+                n--;
+            }
+            for (; n >= (int)WSIZE; n -= WSIZE) {
+                dst -= WSIZE, src -= WSIZE;
+                *(uint64 *)dst = *(const uint64 *)src;
+            }
+        }
         while (n-- > 0) *--dst = *--src;
     }
     return vdst;
@@ -56,6 +98,19 @@ void *memmove(void *vdst, const void *vsrc, int n) {
 
 int memcmp(const void *s1, const void *s2, uint n) {
     const char *p1 = s1, *p2 = s2;
+    if (n >= 2 * WSIZE && (((uint64)p1 ^ (uint64)p2) & WMASK) == 0) {
+        while ((uint64)p1 & WMASK) {
+            if (*p1 != *p2) {
+                return *p1 - *p2;
+            }
+            p1++, p2++, n--;
+        }
+        // skip equal words, the loop below finds the first differing byte.
+        while (n >= WSIZE && *(const uint64 *)p1 == *(const uint64 *)p2) {
+            p1 += WSIZE, p2 += WSIZE;
+            n -= WSIZE;
+        }
+    }
     while (n-- > 0) {
         if (*p1 != *p2) {
             return *p1 - *p2;
@@ -110,3 +165,11 @@ int atoi(const char *s) {
     while ('0' <= *s && *s <= '9') n = n * 10 + *s++ - '0';
     return n;
 }
+
+// Add inc to our nice value. Return 0, or a negative errno.
+int nice(int inc) {
+    int prio = getpriority(0);
+    if (prio < 0)
+        return prio;
+    return setpriority(0, 20 - prio + inc);
+}
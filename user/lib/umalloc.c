@@ -1,5 +1,6 @@
 #include "../../os/types.h"
 #include "syscall.h"
+#include "user.h"
 
 // Memory allocator by Kernighan and Ritchie,
 // The C programming Language, 2nd ed.  Section 8.7.
@@ -18,8 +19,9 @@ typedef union header Header;
 
 static Header base;
 static Header *freep;
+static mutex_t lock;  // threads share the heap
 
-void free(void *ap) {
+static void __free(void *ap) {
     Header *bp, *p;
 
     bp = (Header *)ap - 1;
@@ -50,11 +52,17 @@ static Header *morecore(uint nu) {
         return 0;
     hp         = (Header *)p;
     hp->s.size = nu;
-    free((void *)(hp + 1));
+    __free((void *)(hp + 1));
     return freep;
 }
 
-void *malloc(uint nbytes) {
+void free(void *ap) {
+    mutex_lock(&lock);
+    __free(ap);
+    mutex_unlock(&lock);
+}
+
+static void *__malloc(uint nbytes) {
     Header *p, *prevp;
     uint nunits;
 
@@ -80,3 +88,10 @@ void *malloc(uint nbytes) {
                 return 0;
     }
 }
+
+void *malloc(uint nbytes) {
+    mutex_lock(&lock);
+    void *p = __malloc(nbytes);
+    mutex_unlock(&lock);
+    return p;
+}
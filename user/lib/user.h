@@ -1,6 +1,12 @@
+#ifndef __USER_H__
+#define __USER_H__
+
 #include "../../os/types.h"
 #include "syscall.h"
 
+// start_main.c
+extern char **environ;
+
 // stdlib.c
 char *strcpy(char *, const char *);
 int strcmp(const char *, const char *);
@@ -17,6 +23,7 @@ char *gets(char *, int max);
 int putchar(char c);
 int puts(char *buf);
 int atoi(const char *);
+int nice(int inc);
 
 // printf.c
 void fprintf(int, const char *, ...);
@@ -28,6 +35,53 @@ void stdout_nobuf(void);
 void *malloc(uint);
 void free(void *);
 
+// sync.c: blocking synchronization on futexes, for tasks sharing memory.
+typedef struct {
+    int state;  // 0: unlocked, 1: locked, 2: locked and maybe contended
+} mutex_t;
+
+typedef struct {
+    int seq;     // bumped by every signal and broadcast
+    mutex_t *m;  // the mutex of the last waiter, broadcast requeues the waiters onto it
+} cond_t;
+
+typedef struct {
+    int count;
+    int waiters;
+} sem_t;
+
+void mutex_init(mutex_t *m);
+void mutex_lock(mutex_t *m);
+int mutex_trylock(mutex_t *m);
+void mutex_unlock(mutex_t *m);
+
+void cond_init(cond_t *c);
+void cond_wait(cond_t *c, mutex_t *m);
+int cond_timedwait(cond_t *c, mutex_t *m, uint64 ticks);
+void cond_signal(cond_t *c);
+void cond_broadcast(cond_t *c);
+
+void sem_init(sem_t *s, int count);
+void sem_wait(sem_t *s);
+int sem_trywait(sem_t *s);
+void sem_post(sem_t *s);
+
+// thread.c
+#define THREAD_STACK_SIZE (16 * 1024)
+
+typedef struct thread {
+    void *(*fn)(void *);
+    void *arg;
+    void *ret;
+    int tid;      // cleared by the kernel when the thread exits
+    char *stack;  // malloc-ed, NULL for the main thread
+} thread_t;
+
+int thread_create(thread_t *t, void *(*fn)(void *), void *arg);
+void *thread_join(thread_t *t);
+void __attribute__((noreturn)) thread_exit(void *ret);
+thread_t *thread_self();
+
 // assert
 #define _STRINGIFY(s) #s
 #define STRINGIFY(s)  _STRINGIFY(s)
@@ -53,4 +107,6 @@ void free(void *);
             "%p != %p",         \
             a,                  \
             b);
-#endif
\ No newline at end of file
+#endif
+
+#endif // __USER_H__
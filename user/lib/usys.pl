@@ -17,6 +17,9 @@ sub entry {
 	
 entry("fork");
 entry("exec");
+entry("execve");
+entry("spawn");
+entry("vfork");
 entry("exit");
 entry("wait");
 entry("kill");
@@ -24,6 +27,23 @@ entry("getpid");
 entry("getppid");
 entry("sleep");
 entry("yield");
+entry("setpriority");
+entry("getpriority");
+entry("sched_setattr");
+entry("sched_getattr");
+entry("sched_setaffinity");
+entry("sched_getaffinity");
+entry("getcpu");
+entry("sched_group_create");
+entry("sched_group_destroy");
+entry("sched_group_attach");
+entry("sched_group_stat");
+entry("sysstat");
+entry("profile");
+entry("futex");
+entry("clone");
+entry("exit_thread");
+entry("gettid");
 entry("sbrk");
 entry("mmap");
 entry("read");
@@ -0,0 +1,46 @@
+#include "../../os/ktest/ktest.h"
+#include "../lib/user.h"
+
+// Lock contention: 1 to all the online harts take the same kernel lock BENCH_LOCK_ROUNDS times each.
+// Times are in `time` CSR ticks, until the last hart is done.
+
+#define MAXCPU 16
+
+static const char *names[] = {"test-and-set", "ticket", "mcs"};
+static struct schedstat_cpu st[MAXCPU];
+
+int main(int argc, char *argv[]) {
+    int nharts = 0;
+    int ncpu   = ktest(KTEST_SCHEDSTAT, st, sizeof(st));
+    for (int i = 0; i < ncpu; i++)
+        nharts += st[i].online != 0;
+    if (nharts == 0) {
+        printf("lockbench: no online hart, %d\n", ncpu);
+        return 1;
+    }
+
+    for (int kind = BENCH_LOCK_TAS; kind <= BENCH_LOCK_MCS; kind++) {
+        for (int n = 1; n <= nharts; n++) {
+            // n - 1 children and us, the kernel makes them start together.
+            for (int i = 1; i < n; i++) {
+                int pid = fork();
+                if (pid < 0) {
+                    printf("lockbench: fork failed\n");
+                    return 1;
+                }
+                if (pid == 0)
+                    exit(ktest(KTEST_BENCH_LOCK, (void *)(uint64)kind, n) < 0);
+            }
+            int64 ticks = ktest(KTEST_BENCH_LOCK, (void *)(uint64)kind, n);
+            for (int i = 1; i < n; i++)
+                wait(-1, NULL);
+            if (ticks < 0) {
+                printf("lockbench: ktest failed, %d\n", (int)ticks);
+                return 1;
+            }
+            uint64 ops = (uint64)n * BENCH_LOCK_ROUNDS;
+            printf("%s, %d harts: %l ticks, %l acquisitions per 1000 ticks\n", names[kind], n, ticks, ops * 1000 / (ticks ? ticks : 1));
+        }
+    }
+    return 0;
+}
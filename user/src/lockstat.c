@@ -0,0 +1,37 @@
+#include "../../os/ktest/ktest.h"
+#include "../lib/user.h"
+
+// Print the kernel lock statistics, the most contended classes first.
+// `lockstat reset` clears them, e.g. before running a workload.
+// Needs a kernel built with LOCKSTAT=y.
+
+#define MAXCLASS 32
+
+static struct lockstat_entry e[MAXCLASS];
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "reset") == 0)
+        return ktest(KTEST_LOCKSTAT_RESET, 0, 0) < 0;
+
+    int n = ktest(KTEST_LOCKSTAT, e, sizeof(e));
+    if (n < 0) {
+        printf("lockstat: not available, build the kernel with LOCKSTAT=y\n");
+        return 1;
+    }
+
+    // insertion sort by total spin time.
+    for (int i = 1; i < n; i++) {
+        struct lockstat_entry t = e[i];
+        int j = i;
+        for (; j > 0 && e[j - 1].spin_total < t.spin_total; j--)
+            e[j] = e[j - 1];
+        e[j] = t;
+    }
+
+    printf("class: acquired contended, spin total/max, hold total/max (time ticks)\n");
+    for (int i = 0; i < n; i++) {
+        printf("%s: %l %l, %l/%l, %l/%l\n", e[i].name, e[i].acquisitions, e[i].contended,
+               e[i].spin_total, e[i].spin_max, e[i].hold_total, e[i].hold_max);
+    }
+    return 0;
+}
@@ -21,6 +21,110 @@ void exec_badarg(char *s) {
     exit(0);
 }
 
+static char *utoa(uint64 x, char *buf) {
+    char tmp[24];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + x % 10;
+        x /= 10;
+    } while (x);
+    for (int i = 0; i < n; i++) buf[i] = tmp[n - 1 - i];
+    buf[n] = '\0';
+    return buf;
+}
+
+// long argument lists span several argument pages, and are checked by bigargs_check in the new image.
+// argv[0] and argv[1] name the program and the helper mode, followed by BIGARGS_N arguments.
+#define BIGARGS_N   150
+#define BIGARGS_LEN 50
+
+static char bigargs_str[BIGARGS_N + 2][BIGARGS_LEN + 1];
+
+static void bigargs_fill(char *argv[], int n, char c) {
+    for (int i = 0; i < n; i++) {
+        memset(bigargs_str[i], c + i % 26, BIGARGS_LEN);
+        bigargs_str[i][BIGARGS_LEN] = '\0';
+        argv[i] = bigargs_str[i];
+    }
+    argv[n] = NULL;
+}
+
+static int bigargs_check(int argc, char *argv[]) {
+    if (argc != BIGARGS_N + 2)
+        return 1;
+    for (int i = 2; i < argc; i++) {
+        if (strlen(argv[i]) != BIGARGS_LEN || argv[i][0] != 'a' + i % 26)
+            return 2;
+    }
+    int envc = 0;
+    for (; environ[envc]; envc++) {
+        if (strlen(environ[envc]) != BIGARGS_LEN || environ[envc][BIGARGS_LEN - 1] != 'A' + envc % 26)
+            return 3;
+    }
+    return envc == BIGARGS_N / 2 ? 0 : 4;
+}
+
+void exec_bigargs(char *s) {
+    static char *argv[BIGARGS_N + 3], *envp[BIGARGS_N / 2 + 1];
+    int pid, xstatus;
+
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        bigargs_fill(argv, BIGARGS_N + 2, 'a');
+        argv[0] = "proctest";
+        argv[1] = "bigargs";
+        execve("proctest", argv, NULL);
+        exit(100);
+    }
+    wait(-1, &xstatus);
+    assert_eq(xstatus, 4);  // no environment
+
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        bigargs_fill(argv, BIGARGS_N + 2, 'a');
+        argv[0] = "proctest";
+        argv[1] = "bigargs";
+        static char envstr[BIGARGS_N / 2][BIGARGS_LEN + 1];
+        for (int i = 0; i < BIGARGS_N / 2; i++) {
+            memset(envstr[i], 'A' + i % 26, BIGARGS_LEN);
+            envp[i] = envstr[i];
+        }
+        envp[BIGARGS_N / 2] = NULL;
+        execve("proctest", argv, envp);
+        exit(100);
+    }
+    wait(-1, &xstatus);
+    assert_eq(xstatus, 0);
+
+    // more than EXEC_ARG_PAGES pages of arguments.
+    static char huge[4096 * 5];
+    memset(huge, 'x', sizeof(huge) - 1);
+    char *hargv[] = {"proctest", huge, NULL};
+    assert_eq(exec("proctest", hargv), -E2BIG);
+    exit(0);
+}
+
+// apps are looked up by their exact name: neither a prefix nor an extension of a name resolves.
+void execname(char *s) {
+    char *bad[]  = {"", "test", "test_ar", "test_argx", "test_arg ", "proctes", NULL};
+    char *argv[] = {"test_arg", NULL};
+    int pid, xstatus;
+
+    for (int i = 0; bad[i]; i++)
+        assert_eq(exec(bad[i], argv), -ENOENT);
+
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        exec("test_arg", argv);
+        exit(100);
+    }
+    wait(-1, &xstatus);
+    assert_eq(xstatus, 0);
+}
+
 /**
  * Test if exec() and fork() leaks memory when fails.
  */
@@ -28,7 +132,9 @@ void exec_nomem(char *s) {
     char *argv[] = {
         "verybig",
         NULL,
+        NULL,
     };
+    char freemem_str[24];
     int pid, remaining;
     int freemem = getfreemem();
     if (freemem % 1000 == 0) {
@@ -38,6 +144,8 @@ void exec_nomem(char *s) {
     pid = fork();
     assert(pid >= 0);
     if (pid == 0) {
+        // pages are populated lazily, let verybig touch its memory up to exactly 1000 pages.
+        argv[1]  = utoa(freemem, freemem_str);
         int ret = exec("verybig", argv);
         if (ret < 0)
             exit(100 - ret);
@@ -82,6 +190,125 @@ void exec_nomem(char *s) {
     assert_eq(remaining, freemem);
 }
 
+// `proctest sigstate`: report the signal state a new image starts with, as the exit status:
+// 1 if SIGUSR1 is blocked, | 2 if SIGUSR2 is ignored, | 4 if SIGINT is ignored.
+static int sigstate_report() {
+    sigset_t mask;
+    sigaction_t sa;
+    int state = 0;
+
+    sigprocmask(SIG_BLOCK, NULL, &mask);
+    if (sigismember(&mask, SIGUSR1))
+        state |= 1;
+    sigaction(SIGUSR2, NULL, &sa);
+    if (sa.sa_sigaction == SIG_IGN)
+        state |= 2;
+    sigaction(SIGINT, NULL, &sa);
+    if (sa.sa_sigaction == SIG_IGN)
+        state |= 4;
+    return state;
+}
+
+static int spawn_wait(char *argv[], struct spawnattr *attr) {
+    int xstatus;
+
+    int pid = spawn(argv[0], argv, attr);
+    if (pid < 0)
+        return pid;
+    assert_eq(wait(pid, &xstatus), pid);
+    return xstatus;
+}
+
+// spawn builds the child straight from the app: it inherits the signal mask and the ignored signals,
+// unless the attributes reset them.
+void spawntest(char *s) {
+    char *argv[]  = {"proctest", "sigstate", NULL};
+    char *targv[] = {"test_arg", NULL};
+    sigaction_t ign;
+    struct spawnattr attr;
+    sigset_t mask;
+
+    int freemem = getfreemem();
+    assert_eq(spawn_wait(targv, NULL), 0);
+    assert_eq(spawn("test_ar", targv, NULL), -ENOENT);
+
+    memset(&ign, 0, sizeof(ign));
+    ign.sa_sigaction = SIG_IGN;
+    sigaction(SIGUSR2, &ign, NULL);
+    sigaction(SIGINT, &ign, NULL);
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    assert_eq(spawn_wait(argv, NULL), 1 | 2 | 4);
+
+    memset(&attr, 0, sizeof(attr));
+    attr.flags = SPAWN_SETSIGMASK;
+    sigemptyset(&attr.sigmask);
+    assert_eq(spawn_wait(argv, &attr), 2 | 4);
+
+    attr.flags = SPAWN_SETSIGDEF;
+    sigemptyset(&attr.sigdefault);
+    sigaddset(&attr.sigdefault, SIGUSR2);
+    assert_eq(spawn_wait(argv, &attr), 1 | 4);
+
+    attr.flags = SPAWN_SETSIGMASK | SPAWN_SETSIGDEF;
+    assert_eq(spawn_wait(argv, &attr), 4);
+
+    // our own state is untouched.
+    assert_eq(sigstate_report(), 1 | 2 | 4);
+    assert_eq(getfreemem(), freemem);
+}
+
+// vfork: the child runs on our memory, and we resume once it gave it back, by exec or exit.
+static volatile int vfork_seen;
+
+static int vfork_run() {
+    char *argv[] = {"test_arg", NULL};
+    int pid, xstatus;
+
+    // exit gives the mm back. The child's writes are ours.
+    vfork_seen = 0;
+    pid        = vfork();
+    if (pid < 0)
+        return 1;
+    if (pid == 0) {
+        vfork_seen = 1;
+        exit(7);
+    }
+    if (vfork_seen != 1 || wait(pid, &xstatus) != pid || xstatus != 7)
+        return 2;
+
+    // so does exec, long before the new image exits. A failed exec keeps the borrowed mm.
+    pid = vfork();
+    if (pid < 0)
+        return 3;
+    if (pid == 0) {
+        vfork_seen = 2;
+        if (exec("test_ar", argv) != -ENOENT)
+            exit(100);
+        vfork_seen = 3;
+        exec("test_arg", argv);
+        exit(101);
+    }
+    if (vfork_seen != 3 || wait(pid, &xstatus) != pid || xstatus != 0)
+        return 4;
+    return 0;
+}
+
+void vforktest(char *s) {
+    int xstatus;
+
+    // run it in a process of its own: the mm must be freed once, after the last of its users is gone.
+    int freemem = getfreemem();
+    int pid     = fork();
+    assert(pid >= 0);
+    if (pid == 0)
+        exit(vfork_run());
+    wait(pid, &xstatus);
+    assert_eq(xstatus, 0);
+    assert_eq(getfreemem(), freemem);
+}
+
 // test if child is killed (status = -1)
 void killstatus(char *s) {
     int xst;
@@ -330,6 +557,92 @@ void bsstest(char *s) {
     }
 }
 
+// initialized data is shared with the app image until written,
+// a write in the child must not be seen by the parent.
+int imagedata = 42;
+void imagecow(char *s) {
+    int pid, xstatus;
+
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        imagedata = 43;
+        exit(imagedata == 43 ? 0 : 1);
+    }
+    wait(-1, &xstatus);
+    if (xstatus != 0 || imagedata != 42) {
+        printf("%s: data page not private, %d\n", s, imagedata);
+        exit(1);
+    }
+
+    // text is mapped from the image read-only.
+    pid = fork();
+    if (pid == 0) {
+        volatile int *addr = (int *)imagecow;
+        *addr              = 10;
+        printf("%s: write to text %p did not fail!\n", s, addr);
+        exit(0);
+    }
+    wait(-1, &xstatus);
+    if (xstatus == 0)
+        exit(1);
+    exit(0);
+}
+
+// `proctest tmpldata`: run from a fresh exec, check that the data and bss start out clean,
+// whatever the previous processes cloned from the same template wrote, then that a fork shares nothing.
+static int tmpldata_check() {
+    int xstatus;
+
+    if (imagedata != 42 || uninit[0] != 0 || uninit[sizeof(uninit) - 1] != 0)
+        return 1;
+    imagedata                  = 43;
+    uninit[0]                  = 1;
+    uninit[sizeof(uninit) - 1] = 1;
+    int pid = fork();
+    if (pid < 0)
+        return 2;
+    if (pid == 0) {
+        imagedata = 44;
+        uninit[0] = 2;
+        exit(imagedata == 44 && uninit[0] == 2 ? 0 : 1);
+    }
+    wait(pid, &xstatus);
+    if (xstatus != 0 || imagedata != 43 || uninit[0] != 1)
+        return 3;
+    return 0;
+}
+
+// exec clones a template of the app, built by the first exec and shared copy-on-write by the later ones.
+// The template is given back, page for page, when memory is short (as getfreemem() makes it).
+void templates(char *s) {
+    char *argv[] = {"proctest", "tmpldata", NULL};
+    struct template_stat st0, st;
+    int pid, xstatus;
+
+    int freemem = getfreemem();
+    assert_eq(ktest(KTEST_TEMPLATESTAT, &st0, sizeof(st0)), 0);
+    assert_eq(st0.cached, 0);
+    for (int i = 0; i < 3; i++) {
+        pid = fork();
+        assert(pid >= 0);
+        if (pid == 0) {
+            exec("proctest", argv);
+            exit(100);
+        }
+        wait(pid, &xstatus);
+        assert_eq(xstatus, 0);
+    }
+    assert_eq(ktest(KTEST_TEMPLATESTAT, &st, sizeof(st)), 0);
+    assert_eq(st.cached, 1);
+    assert_eq(st.builds - st0.builds, 1);
+    assert_eq(st.clones - st0.clones, 3);
+
+    assert_eq(getfreemem(), freemem);
+    assert_eq(ktest(KTEST_TEMPLATESTAT, &st, sizeof(st)), 0);
+    assert_eq(st.cached, 0);
+}
+
 // check that writes to a few forbidden addresses
 // cause a fault, e.g. process's text and TRAMPOLINE.
 void nowrite(char *s) {
@@ -357,12 +670,417 @@ void nowrite(char *s) {
     exit(0);
 }
 
+// futex semantics that a single task can check, and the uncontended paths of the sync library.
+void futexbasic(char *s) {
+    int word = 1;
+
+    assert_eq(futex(&word, FUTEX_WAIT, 0, 0, NULL), -EAGAIN);
+    assert_eq(futex(&word, FUTEX_WAKE, 1, 0, NULL), 0);
+    assert_eq(futex(&word, FUTEX_REQUEUE, 1, 1, &word), 0);
+    assert_eq(futex((int *)((char *)&word + 1), FUTEX_WAKE, 1, 0, NULL), -EINVAL);
+    assert_eq(futex((int *)0x1000, FUTEX_WAIT, 0, 0, NULL), -EINVAL);
+    assert_eq(futex(&word, 42, 0, 0, NULL), -EINVAL);
+
+    assert_eq(futex(&word, FUTEX_WAIT, 1, 5, NULL), -ETIMEDOUT);
+
+    mutex_t m;
+    mutex_init(&m);
+    mutex_lock(&m);
+    assert(!mutex_trylock(&m));
+    mutex_unlock(&m);
+    assert(mutex_trylock(&m));
+
+    cond_t c;
+    cond_init(&c);
+    assert_eq(cond_timedwait(&c, &m, 2), -ETIMEDOUT);
+    assert(!mutex_trylock(&m));
+    cond_broadcast(&c);
+    mutex_unlock(&m);
+
+    sem_t sem;
+    sem_init(&sem, 2);
+    sem_wait(&sem);
+    assert(sem_trywait(&sem));
+    assert(!sem_trywait(&sem));
+    sem_post(&sem);
+    sem_wait(&sem);
+    exit(0);
+}
+
+#define NTHREADS       4
+#define THREAD_ROUNDS  10000
+
+static mutex_t counter_lock;
+static int counter;
+static sem_t items;
+static mutex_t queue_lock;
+static cond_t queue_cond;
+static int queued;
+
+static void *thread_count(void *arg) {
+    for (int i = 0; i < THREAD_ROUNDS; i++) {
+        mutex_lock(&counter_lock);
+        counter++;
+        mutex_unlock(&counter_lock);
+    }
+    if (getpid() != (int)(uint64)arg || gettid() == getpid() || thread_self()->arg != arg)
+        return (void *)1;
+    return NULL;
+}
+
+static void *thread_produce(void *arg) {
+    for (int i = 0; i < THREAD_ROUNDS; i++)
+        sem_post(&items);
+    mutex_lock(&queue_lock);
+    queued = 1;
+    cond_broadcast(&queue_cond);
+    mutex_unlock(&queue_lock);
+    return NULL;
+}
+
+// threads share memory, and block on contended futexes.
+void threads(char *s) {
+    thread_t t[NTHREADS];
+
+    mutex_init(&counter_lock);
+    for (int i = 0; i < NTHREADS; i++)
+        assert(thread_create(&t[i], thread_count, (void *)(uint64)getpid()) > 0);
+    for (int i = 0; i < NTHREADS; i++)
+        assert_eq(thread_join(&t[i]), NULL);
+    if (counter != NTHREADS * THREAD_ROUNDS) {
+        printf("%s: lost updates, counter %d\n", s, counter);
+        exit(1);
+    }
+
+    sem_init(&items, 0);
+    mutex_init(&queue_lock);
+    cond_init(&queue_cond);
+    assert(thread_create(&t[0], thread_produce, NULL) > 0);
+    for (int i = 0; i < THREAD_ROUNDS; i++)
+        sem_wait(&items);
+    mutex_lock(&queue_lock);
+    while (!queued)
+        cond_wait(&queue_cond, &queue_lock);
+    mutex_unlock(&queue_lock);
+    thread_join(&t[0]);
+    assert(!sem_trywait(&items));
+    exit(0);
+}
+
+// spins until the process exits.
+static void *thread_spin(void *arg) {
+    volatile int *never = arg;
+    while (!*never)
+        ;
+    return NULL;
+}
+
+static void *thread_exit_code(void *arg) {
+    exit(7);
+}
+
+// exit() from any thread ends the whole process, with its code.
+void threadexit(char *s) {
+    thread_t t[2];
+    int xstatus, never = 0;
+
+    int pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        thread_create(&t[0], thread_spin, &never);
+        thread_create(&t[1], thread_exit_code, NULL);
+        thread_join(&t[0]);
+        exit(0);
+    }
+    assert_eq(wait(pid, &xstatus), pid);
+    if (xstatus != 7) {
+        printf("%s: exit code %d\n", s, xstatus);
+        exit(1);
+    }
+
+    // the process outlives its main thread.
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        thread_create(&t[0], thread_exit_code, NULL);
+        thread_exit(NULL);
+    }
+    assert_eq(wait(pid, &xstatus), pid);
+    assert_eq(xstatus, 7);
+    exit(0);
+}
+
+// Floating-point registers are saved lazily, only by processes that use them:
+// parent and child keep their own ft0 and rounding mode across many context switches.
+static void fpstate_check(char *s, uint64 bits, uint64 frm) {
+    uint64 got, gotrm;
+
+    asm volatile("fmv.d.x ft0, %0" ::"r"(bits));
+    asm volatile("fsrm %0" ::"r"(frm));
+    for (int i = 0; i < 200; i++) {
+        yield();
+        asm volatile("fmv.x.d %0, ft0" : "=r"(got));
+        asm volatile("frrm %0" : "=r"(gotrm));
+        if (got != bits || gotrm != frm) {
+            printf("%s: lost fp state, %p %d\n", s, got, gotrm);
+            exit(1);
+        }
+    }
+}
+
+void fpstate(char *s) {
+    int xstatus;
+
+    int pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        fpstate_check(s, 0x400921fb54442d18ull, 1);  // pi, round toward zero
+        exit(0);
+    }
+    fpstate_check(s, 0x4005bf0a8b145769ull, 3);  // e, round up
+    assert_eq(wait(pid, &xstatus), pid);
+    assert_eq(xstatus, 0);
+    exit(0);
+}
+
+// nice values are clamped, inherited by children, and reported as 20 - nice.
+void priority(char *s) {
+    int xstatus;
+
+    assert_eq(getpriority(0), 20);
+    assert_eq(nice(5), 0);
+    assert_eq(getpriority(0), 15);
+    assert_eq(getpriority(getpid()), 15);
+    assert_eq(setpriority(0, 100), 0);
+    assert_eq(getpriority(0), 1);
+    assert_eq(setpriority(0, -100), 0);
+    assert_eq(getpriority(0), 40);
+    assert(getpriority(1 << 20) < 0);
+    assert(setpriority(1 << 20, 0) < 0);
+
+    assert_eq(setpriority(0, 7), 0);
+    int pid = fork();
+    assert(pid >= 0);
+    if (pid == 0)
+        exit(getpriority(0));
+    assert_eq(setpriority(pid, 3), 0);
+    assert_eq(wait(pid, &xstatus), pid);
+    // the child may have exited before setpriority.
+    assert(xstatus == 13 || xstatus == 17);
+    exit(0);
+}
+
+// Real-time policies: parameters are checked, SCHED_FIFO is inherited, SCHED_DEADLINE is not.
+void rtsched(char *s) {
+    struct sched_attr attr = {0}, got;
+    int xstatus;
+
+    attr.policy   = SCHED_FIFO;
+    attr.priority = 0;
+    assert(sched_setattr(0, &attr) < 0);
+    attr.priority = SCHED_PRIO_MAX + 1;
+    assert(sched_setattr(0, &attr) < 0);
+    attr.priority = 10;
+    assert_eq(sched_setattr(0, &attr), 0);
+    assert_eq(sched_getattr(0, &got), 0);
+    assert(got.policy == SCHED_FIFO && got.priority == 10);
+
+    int pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        assert_eq(sched_getattr(0, &got), 0);
+        exit(got.policy == SCHED_FIFO && got.priority == 10 ? 0 : 1);
+    }
+    assert_eq(wait(pid, &xstatus), pid);
+    assert_eq(xstatus, 0);
+
+    // runtime <= deadline <= period
+    attr.policy   = SCHED_DEADLINE;
+    attr.runtime  = 20000;
+    attr.deadline = 10000;
+    attr.period   = 0;
+    assert(sched_setattr(0, &attr) < 0);
+    attr.runtime = 2000;
+    attr.period  = 5000;
+    assert(sched_setattr(0, &attr) < 0);
+    attr.period = 100000;
+    assert_eq(sched_setattr(0, &attr), 0);
+    assert_eq(sched_getattr(0, &got), 0);
+    assert(got.policy == SCHED_DEADLINE && got.runtime == 2000 && got.deadline == 10000 && got.period == 100000);
+    // we still run, within our runtime of 2 ms every 100 ms.
+    for (int i = 0; i < 20; i++)
+        yield();
+
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        assert_eq(sched_getattr(0, &got), 0);
+        exit(got.policy);
+    }
+    assert_eq(wait(pid, &xstatus), pid);
+    assert_eq(xstatus, SCHED_NORMAL);
+
+    attr.policy = SCHED_NORMAL;
+    attr.nice   = 0;
+    assert_eq(sched_setattr(0, &attr), 0);
+    exit(0);
+}
+
+// A task pinned to one hart stays there, and children inherit the mask.
+void affinity(char *s) {
+    int xstatus;
+
+    int64 all = sched_getaffinity(0);
+    assert(all > 0);
+    assert(sched_setaffinity(0, 0) < 0);
+    assert_eq(sched_setaffinity(0, 1), 0);
+    assert_eq(sched_getaffinity(0), 1);
+    for (int i = 0; i < 20; i++) {
+        yield();
+        assert_eq(getcpu(), 0);
+    }
+
+    int pid = fork();
+    assert(pid >= 0);
+    if (pid == 0)
+        exit(sched_getaffinity(0));
+    assert_eq(wait(pid, &xstatus), pid);
+    assert_eq(xstatus, 1);
+    assert_eq(sched_setaffinity(0, all), 0);
+    exit(0);
+}
+
+// A bandwidth group caps the cpu time of its tasks, and of the groups below it.
+void bwgroup(char *s) {
+    struct sched_group_stat st;
+    int xstatus;
+
+    assert(sched_group_create(SCHED_GROUP_ROOT, 10000, 100) < 0);
+    assert(sched_group_create(1 << 20, 10000, 100000) < 0);
+    // 10 ms every 100 ms
+    int g = sched_group_create(SCHED_GROUP_ROOT, 10000, 100000);
+    assert(g > 0);
+    int sub = sched_group_create(g, 0, 100000);
+    assert(sub > 0);
+    assert_eq(sched_group_destroy(g), -EBUSY);
+
+    int pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        for (;;)
+            ;
+    }
+    assert_eq(sched_group_attach(sub, pid), 0);
+    sleep(30);
+    assert_eq(sched_group_stat(g, &st), 0);
+    assert_eq(sched_group_destroy(sub), -EBUSY);
+    kill(pid);
+    assert_eq(wait(pid, &xstatus), pid);
+
+    // about 10 ms every 100 ms, plus a tick of overrun now and then, instead of the whole 300 ms.
+    assert_eq(st.nr_children, 1);
+    assert(st.nr_throttled > 0);
+    assert(st.usage < 200000);
+    assert_eq(sched_group_destroy(sub), 0);
+    assert_eq(sched_group_destroy(g), 0);
+    exit(0);
+}
+
+// Syscalls are counted per cpu, and per process once enabled, with an optional trace.
+static struct syscall_stat stats[NSYSSTAT];
+static struct syscall_trace trace[SYSSTAT_TRACE_LEN];
+
+void syscallstat(char *s) {
+    int xstatus;
+
+    assert_eq(sysstat(SYSSTAT_PROC, 0, stats, sizeof(stats)), -ENOENT);
+    assert_eq(sysstat(SYSSTAT_ENABLE, 0, NULL, 0), 0);
+    for (int i = 0; i < 3; i++)
+        getpid();
+    assert_eq(sysstat(-1, 0, NULL, 0), -EINVAL);
+    assert_eq(sysstat(SYSSTAT_PROC, 0, stats, sizeof(stats)), NSYSSTAT);
+    assert_eq(stats[SYS_getpid].count, 3);
+    assert_eq(stats[SYS_getpid].errors, 0);
+    assert_eq(stats[SYS_sysstat].errors, 1);
+    uint64 n = 0;
+    for (int b = 0; b < SYSSTAT_NBUCKET; b++)
+        n += stats[SYS_getpid].hist[b];
+    assert_eq(n, 3);
+    assert_eq(sysstat(SYSSTAT_DISABLE, 0, NULL, 0), 0);
+    assert_eq(sysstat(SYSSTAT_CPU, SYSSTAT_ALL, stats, sizeof(stats)), NSYSSTAT);
+    assert(stats[SYS_getpid].count >= 3);
+
+    // trace a child until it exits.
+    int pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        if (sysstat(SYSSTAT_ENABLE, 0, NULL, SYSSTAT_F_TRACE) < 0)
+            exit(1);
+        for (int i = 0; i < 3; i++)
+            getpid();
+        exit(0);
+    }
+    int ret, total = 0, getpids = 0;
+    while ((ret = sysstat(SYSSTAT_TRACE, pid, trace, sizeof(trace))) == -ENOENT)
+        yield();
+    for (; ret > 0; ret = sysstat(SYSSTAT_TRACE, pid, trace, sizeof(trace))) {
+        for (int i = 0; i < ret; i++) {
+            assert_eq(trace[i].seq, total + i);
+            if (trace[i].id == SYS_getpid) {
+                assert_eq(trace[i].ret, pid);
+                getpids++;
+            }
+        }
+        total += ret;
+    }
+    assert_eq(ret, 0);
+    // sysstat itself, the getpids and exit.
+    assert_eq(total, 5);
+    assert_eq(getpids, 3);
+    assert_eq(wait(pid, &xstatus), pid);
+    assert_eq(xstatus, 0);
+    exit(0);
+}
+
+// The profiler samples us while we spin, and unwinds our user stack.
+static struct prof_sample samples[16];
+
+void profiler(char *s) {
+    volatile uint64 x = 0;
+    int found = 0;
+
+    assert_eq(profile(PROFILE_START, 1, NULL, 0), -EINVAL);
+    assert_eq(profile(PROFILE_START, 1000, NULL, PROFILE_F_USER), 0);
+    for (int round = 0; round < 100 && !found; round++) {
+        for (int i = 0; i < 1000000; i++)
+            x += i;
+        for (int cpu = 0; profile(PROFILE_READ, cpu, NULL, 0) >= 0; cpu++) {
+            int n;
+            while ((n = profile(PROFILE_READ, cpu, samples, sizeof(samples))) > 0) {
+                for (int i = 0; i < n; i++) {
+                    if (samples[i].pid == getpid() && samples[i].nkernel == 0 && samples[i].nuser > 0) {
+                        assert_eq(strcmp(samples[i].app, "proctest"), 0);
+                        found = 1;
+                    }
+                }
+            }
+        }
+    }
+    assert_eq(profile(PROFILE_STOP, 0, NULL, 0), 0);
+    assert(found);
+    exit(0);
+}
+
 struct test {
     void (*f)(char *);
     char *s;
 } proctests[] = {
     {exec_badarg, "exec_badarg"},
     {exec_nomem,  "exec_nomem" },
+    {exec_bigargs, "exec_bigargs"},
+    {execname,    "execname"   },
+    {spawntest,   "spawntest"  },
+    {vforktest,   "vforktest"  },
     {killstatus,  "killstatus" },
     {exitwait,    "exitwait"   },
     {reparent,    "reparent"   },
@@ -370,7 +1088,19 @@ struct test {
     {sbrkbasic,   "sbrkbasic"  },
     {sbrkmuch,    "sbrkmuch"   },
     {bsstest,     "bsstest"    },
+    {imagecow,    "imagecow"   },
+    {templates,   "templates"  },
     {nowrite,     "nowrite"    },
+    {futexbasic,  "futexbasic" },
+    {threads,     "threads"    },
+    {threadexit,  "threadexit" },
+    {fpstate,     "fpstate"    },
+    {priority,    "priority"   },
+    {rtsched,     "rtsched"    },
+    {affinity,    "affinity"   },
+    {bwgroup,     "bwgroup"    },
+    {syscallstat, "syscallstat"},
+    {profiler,    "profiler"   },
     {NULL,        NULL         },
 };
 
@@ -433,6 +1163,12 @@ int drivetests(int quick, int continuous, char *whichone) {
 }
 
 int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "bigargs") == 0)
+        return bigargs_check(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "tmpldata") == 0)
+        return tmpldata_check();
+    if (argc > 1 && strcmp(argv[1], "sigstate") == 0)
+        return sigstate_report();
     printf("=== TESTSUITE ===\nproctest\n\n");
     drivetests(0, 0, NULL);
     return 0;
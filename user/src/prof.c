@@ -0,0 +1,98 @@
+#include "../lib/user.h"
+
+// Profile a command: sample what the harts run until it exits, see os/profile.h.
+//   prof [-u] [-p period_us] cmd args..
+// -u also unwinds the user stack of the processes interrupted in the kernel.
+// Each sample is printed as a line for scripts/profile.py, the innermost frame first:
+//   @prof cpu pid app nkernel pc..
+
+#define NSAMPLE 16
+#define MAXCPU  64
+
+static struct prof_sample buf[NSAMPLE];
+static int done;
+static uint64 nsamples, ndropped;
+static uint64 next_seq[MAXCPU];  // of the next sample of each cpu, to count the dropped ones
+
+static void drain() {
+    for (int cpu = 0;; cpu++) {
+        int n;
+        while ((n = profile(PROFILE_READ, cpu, buf, sizeof(buf))) > 0) {
+            for (int i = 0; i < n; i++) {
+                struct prof_sample *s = &buf[i];
+                if (cpu < MAXCPU) {
+                    ndropped += s->seq - next_seq[cpu];
+                    next_seq[cpu] = s->seq + 1;
+                }
+                nsamples++;
+                printf("@prof %d %d %s %d", cpu, s->pid, s->app[0] ? s->app : "-", s->nkernel);
+                for (int j = 0; j < s->nkernel + s->nuser; j++)
+                    printf(" %p", s->pc[j]);
+                printf("\n");
+            }
+        }
+        // past the last cpu.
+        if (n < 0)
+            break;
+    }
+}
+
+static void *drainer(void *arg) {
+    while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+        drain();
+        sleep(1);
+    }
+    drain();
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    uint64 period = 0;
+    int flags     = 0;
+    int xstatus, ret, i;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-u") == 0)
+            flags |= PROFILE_F_USER;
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+            period = atoi(argv[++i]);
+        else
+            break;
+    }
+    if (i == argc) {
+        printf("usage: prof [-u] [-p period_us] cmd args..\n");
+        return 1;
+    }
+
+    if ((ret = profile(PROFILE_START, period, NULL, flags)) < 0) {
+        printf("prof: cannot start, %d\n", ret);
+        return 1;
+    }
+    // fork before starting the drainer thread: the child gets a single-threaded copy.
+    int pid = fork();
+    if (pid < 0) {
+        printf("prof: fork failed\n");
+        profile(PROFILE_STOP, 0, NULL, 0);
+        return 1;
+    }
+    if (pid == 0) {
+        exec(argv[i], argv + i);
+        printf("prof: exec %s failed\n", argv[i]);
+        exit(1);
+    }
+
+    // without the drainer, only the last samples of each cpu are left at the end.
+    thread_t t;
+    int threaded = thread_create(&t, drainer, NULL) >= 0;
+    if (!threaded)
+        printf("prof: cannot start the drainer thread, samples will be dropped\n");
+    wait(pid, &xstatus);
+    profile(PROFILE_STOP, 0, NULL, 0);
+    __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+    if (threaded)
+        thread_join(&t);
+    else
+        drain();
+    printf("prof: %l samples, %l dropped\n", nsamples, ndropped);
+    return 0;
+}
@@ -0,0 +1,34 @@
+#include "../../os/ktest/ktest.h"
+#include "../lib/user.h"
+
+// Print the load of each hart, as seen by the kernel load balancer,
+// and the imbalance between the busiest and the idlest one.
+
+#define MAXCPU 16
+
+static struct schedstat_cpu st[MAXCPU];
+
+int main(int argc, char *argv[]) {
+    int n = ktest(KTEST_SCHEDSTAT, st, sizeof(st));
+    if (n < 0) {
+        printf("schedstat: ktest failed, %d\n", n);
+        return 1;
+    }
+
+    // loads are printed in percent of one always runnable task.
+    uint64 max = 0, min = (uint64)-1;
+    printf("cpu: queued, load%%, migrations (idle pulls), balancer runs\n");
+    for (int i = 0; i < n; i++) {
+        if (!st[i].online)
+            continue;
+        printf("%d: %l, %l, %l (%l), %l\n", i, st[i].nr_queued, st[i].load_avg * 100 / 1024,
+               st[i].migrations, st[i].idle_pulls, st[i].balance_runs);
+        if (st[i].load_avg > max)
+            max = st[i].load_avg;
+        if (st[i].load_avg < min)
+            min = st[i].load_avg;
+    }
+    if (max >= min)
+        printf("imbalance: %l%%\n", (max - min) * 100 / 1024);
+    return 0;
+}
@@ -86,11 +86,9 @@ int main() {
                 s++;
             }
         }
-        int pid = fork();
-        if (pid == 0) {
-            exec(argv[0], argv);
+        int pid = spawn(argv[0], argv, NULL);
+        if (pid < 0) {
             printf("sh > exec %s failed\n", argv[0]);
-            exit(-1);
         } else {
             int code;
             wait(pid, &code);
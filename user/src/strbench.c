@@ -0,0 +1,32 @@
+#include "../../os/ktest/ktest.h"
+#include "../lib/user.h"
+
+// Compare the kernel's word-wise string functions with byte-at-a-time loops.
+// Times are in `time` CSR ticks for BENCH_STRING_ROUNDS calls on a 4 KiB buffer.
+
+static void report(const char *name, uint64 byte, uint64 fast) {
+    if (fast == 0)
+        fast = 1;
+    printf("%s: byte %l, optimized %l, speedup %d.%dx\n", name, byte, fast, (int)(byte / fast), (int)(byte * 10 / fast % 10));
+}
+
+int main(int argc, char *argv[]) {
+    struct bench_string res;
+    int ret = ktest(KTEST_BENCH_STRING, &res, sizeof(res));
+    if (ret < 0) {
+        printf("strbench: ktest failed, %d\n", ret);
+        return 1;
+    }
+
+    report("memset  ", res.memset_byte, res.memset_word);
+    report("pagezero", res.memset_byte, res.pagezero_words);
+    if (res.has_cboz)
+        report("cbo.zero", res.memset_byte, res.pagezero_cboz);
+    else
+        printf("cbo.zero: not supported by this machine\n");
+    report("memmove ", res.memmove_byte, res.memmove_word);
+    report("memmove (misaligned)", res.memmove_byte, res.memmove_unaligned);
+    report("memcmp  ", res.memcmp_byte, res.memcmp_word);
+    report("strlen  ", res.strlen_byte, res.strlen_word);
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include "../../os/timer.h"
+#include "../lib/user.h"
+
+// Syscall statistics, see os/sysstat.h.
+//   sysstat              calls, errors and latencies over all cpus, the most time consuming first
+//   sysstat -p pid       the same, for a process with statistics enabled
+//   sysstat reset        clear the per-cpu statistics
+//   sysstat trace cmd .. run cmd, printing each of its syscalls, then its statistics
+
+static char *names[NSYSSTAT] = {
+    [0]                       = "other",
+    [SYS_fork]                = "fork",
+    [SYS_exec]                = "exec",
+    [SYS_exit]                = "exit",
+    [SYS_wait]                = "wait",
+    [SYS_getpid]              = "getpid",
+    [SYS_getppid]             = "getppid",
+    [SYS_kill]                = "kill",
+    [SYS_spawn]               = "spawn",
+    [SYS_vfork]               = "vfork",
+    [SYS_sleep]               = "sleep",
+    [SYS_yield]               = "yield",
+    [SYS_execve]              = "execve",
+    [SYS_futex]               = "futex",
+    [SYS_clone]               = "clone",
+    [SYS_exit_thread]         = "exit_thread",
+    [SYS_gettid]              = "gettid",
+    [SYS_setpriority]         = "setpriority",
+    [SYS_getpriority]         = "getpriority",
+    [SYS_sbrk]                = "sbrk",
+    [SYS_mmap]                = "mmap",
+    [SYS_read]                = "read",
+    [SYS_write]               = "write",
+    [SYS_gettimeofday]        = "gettimeofday",
+    [SYS_sched_setattr]       = "sched_setattr",
+    [SYS_sched_getattr]       = "sched_getattr",
+    [SYS_sched_setaffinity]   = "sched_setaffinity",
+    [SYS_sched_getaffinity]   = "sched_getaffinity",
+    [SYS_getcpu]              = "getcpu",
+    [SYS_sigaction]           = "sigaction",
+    [SYS_sigreturn]           = "sigreturn",
+    [SYS_sigprocmask]         = "sigprocmask",
+    [SYS_sigkill]             = "sigkill",
+    [SYS_sigpending]          = "sigpending",
+    [SYS_sched_group_create]  = "sched_group_create",
+    [SYS_sched_group_destroy] = "sched_group_destroy",
+    [SYS_sched_group_attach]  = "sched_group_attach",
+    [SYS_sched_group_stat]    = "sched_group_stat",
+    [SYS_sysstat]             = "sysstat",
+};
+
+static struct syscall_stat st[NSYSSTAT];
+static struct syscall_trace trace[SYSSTAT_TRACE_LEN];
+
+static char *name(int id) {
+    if (id >= 0 && id < NSYSSTAT && names[id] != NULL)
+        return names[id];
+    return "?";
+}
+
+// Print the entries that were called, by total time, with their histogram up to the last used bucket.
+// Bucket i holds the calls that took 2^i ticks or more.
+static void print_stats() {
+    int order[NSYSSTAT], n = 0;
+
+    for (int i = 0; i < NSYSSTAT; i++) {
+        if (st[i].count == 0)
+            continue;
+        int j = n++;
+        for (; j > 0 && st[order[j - 1]].time_total < st[i].time_total; j--)
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+
+    printf("syscall: calls errors, time total/avg/max (%d ticks/s), log2 histogram\n", CPU_FREQ);
+    for (int k = 0; k < n; k++) {
+        struct syscall_stat *s = &st[order[k]];
+        printf("%s: %l %l, %l/%l/%l,", name(order[k]), s->count, s->errors, s->time_total, s->time_total / s->count,
+               s->time_max);
+        int last = SYSSTAT_NBUCKET - 1;
+        while (last > 0 && s->hist[last] == 0)
+            last--;
+        for (int b = 0; b <= last; b++)
+            printf(" %d", s->hist[b]);
+        printf("\n");
+    }
+}
+
+static int trace_cmd(char *argv[]) {
+    int xstatus;
+
+    int pid = fork();
+    if (pid < 0) {
+        printf("sysstat: fork failed\n");
+        return 1;
+    }
+    if (pid == 0) {
+        int ret = sysstat(SYSSTAT_ENABLE, 0, NULL, SYSSTAT_F_TRACE);
+        if (ret < 0) {
+            printf("sysstat: cannot trace, %d\n", ret);
+            exit(1);
+        }
+        exec(argv[0], argv);
+        printf("sysstat: exec %s failed\n", argv[0]);
+        exit(1);
+    }
+
+    int n;
+    uint64 next = 0;
+    while ((n = sysstat(SYSSTAT_TRACE, pid, trace, sizeof(trace))) == -ENOENT)
+        yield();
+    for (; n > 0; n = sysstat(SYSSTAT_TRACE, pid, trace, sizeof(trace))) {
+        for (int i = 0; i < n; i++) {
+            struct syscall_trace *t = &trace[i];
+            if (t->seq != next)
+                printf("... %l calls dropped\n", t->seq - next);
+            next = t->seq + 1;
+            printf("[%d] %s(%p, %p, %p) = %l, %l ticks\n", t->cpu, name(t->id), t->args[0], t->args[1],
+                   t->args[2], t->ret, t->duration);
+        }
+    }
+    // the process is a zombie until we wait for it: its statistics are still there.
+    if (sysstat(SYSSTAT_PROC, pid, st, sizeof(st)) == NSYSSTAT)
+        print_stats();
+    wait(pid, &xstatus);
+    printf("exit status %d\n", xstatus);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int ret;
+
+    if (argc > 1 && strcmp(argv[1], "reset") == 0)
+        return sysstat(SYSSTAT_RESET, SYSSTAT_ALL, NULL, 0) < 0;
+    if (argc > 2 && strcmp(argv[1], "trace") == 0)
+        return trace_cmd(argv + 2);
+
+    if (argc > 2 && strcmp(argv[1], "-p") == 0)
+        ret = sysstat(SYSSTAT_PROC, atoi(argv[2]), st, sizeof(st));
+    else
+        ret = sysstat(SYSSTAT_CPU, SYSSTAT_ALL, st, sizeof(st));
+    if (ret < 0) {
+        printf("sysstat: %d\n", ret);
+        return 1;
+    }
+    print_stats();
+    return 0;
+}
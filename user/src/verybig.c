@@ -1,11 +1,24 @@
+#include "../../os/ktest/ktest.h"
 #include "../lib/user.h"
 
-char hugebuf[4096 * (1000 - 19)];
+#define TARGET_PAGES 1000
+
+char hugebuf[4096 * TARGET_PAGES] __attribute__((aligned(4096)));
+
 // verybig should use exactly 1000 pages of memory.
-// 19 pages are used by the stack, pagetable and so on.
+// Its pages are populated on first access, so it touches hugebuf until
+// the pages it holds (stack, page tables, data and so on) add up to 1000.
+// argv[1] is the number of free pages before the exec.
+// Without it, all of hugebuf is touched.
+int main(int argc, char *argv[]) {
+    int before = argc > 1 ? atoi(argv[1]) : 0;
 
-int main() {
+    for (int i = 0; i < TARGET_PAGES; i++) {
+        if (before && before - ktest(KTEST_GET_NRFREEPGS, 0, 0) >= TARGET_PAGES)
+            break;
+        hugebuf[i * 4096] = 1;
+    }
     sleep(10);
     exit(1);
     return 0;
-}
\ No newline at end of file
+}